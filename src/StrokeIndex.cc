@@ -0,0 +1,170 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+#include "StrokeIndex.h"
+
+static i64
+strokes_per_node(i32 level)
+{
+    i64 n = STROKEINDEX_LEAF_SIZE;
+    for ( i32 i = 0; i < level; ++i ) {
+        n *= STROKEINDEX_BRANCHING;
+    }
+    return n;
+}
+
+StrokeRange
+stroke_index_node_range(StrokeIndex* index, i32 level, i64 node_i)
+{
+    i64 n = strokes_per_node(level);
+    StrokeRange range = { node_i * n, min((node_i + 1) * n, index->count) };
+    return range;
+}
+
+static Rect
+union_of_children(StrokeIndex* index, i32 level, i64 node_i)
+{
+    mlt_assert(level > 0);
+    DArray<StrokeIndexNode>* children = &index->levels[level - 1];
+    Rect bounds = rect_without_size();
+    i64 end = min((node_i + 1) * STROKEINDEX_BRANCHING, children->count);
+    for ( i64 ci = node_i * STROKEINDEX_BRANCHING; ci < end; ++ci ) {
+        bounds = rect_union(bounds, children->data[ci].bounds);
+    }
+    return bounds;
+}
+
+void
+stroke_index_push(StrokeIndex* index, Rect bounds)
+{
+    i64 node_i = index->count / STROKEINDEX_LEAF_SIZE;
+    index->count += 1;
+
+    for ( i32 level = 0; level < STROKEINDEX_MAX_LEVELS; ++level ) {
+        DArray<StrokeIndexNode>* nodes = &index->levels[level];
+        if ( level == index->num_levels ) {
+            // New root. It has to cover every node in the level below, not
+            // just the new stroke.
+            StrokeIndexNode root = {};
+            root.bounds = level > 0 ? union_of_children(index, level, 0) : bounds;
+            push(nodes, root);
+            index->num_levels += 1;
+        }
+        else if ( node_i == nodes->count ) {
+            StrokeIndexNode node = {};
+            node.bounds = bounds;
+            push(nodes, node);
+        }
+        else {
+            nodes->data[node_i].bounds = rect_union(nodes->data[node_i].bounds, bounds);
+        }
+
+        if ( level == index->num_levels - 1 && nodes->count == 1 ) {
+            break;
+        }
+        node_i /= STROKEINDEX_BRANCHING;
+    }
+    mlt_assert(index->levels[index->num_levels - 1].count == 1);
+}
+
+void
+stroke_index_pop(StrokeIndex* index, StrokeList* strokes)
+{
+    mlt_assert(index->count > 0);
+    mlt_assert(index->count == strokes->count + 1);
+
+    index->count -= 1;
+    i64 node_i = index->count / STROKEINDEX_LEAF_SIZE;
+
+    for ( i32 level = 0; level < index->num_levels; ++level ) {
+        DArray<StrokeIndexNode>* nodes = &index->levels[level];
+        StrokeRange range = stroke_index_node_range(index, level, node_i);
+        if ( range.begin == range.end ) {
+            pop(nodes);
+        }
+        else if ( level == 0 ) {
+            Rect bounds = rect_without_size();
+            for ( i64 i = range.begin; i < range.end; ) {
+                i64 offset = 0;
+                StrokeBucket* bucket = strokelist_bucket_at(strokes, i, &offset);
+                i64 end = min(bucket->capacity, offset + (range.end - i));
+                for ( i64 bi = offset; bi < end; ++bi, ++i ) {
+                    bounds.left   = min(bounds.left, bucket->left[bi]);
+                    bounds.top    = min(bounds.top, bucket->top[bi]);
+                    bounds.right  = max(bounds.right, bucket->right[bi]);
+                    bounds.bottom = max(bounds.bottom, bucket->bottom[bi]);
+                }
+            }
+            nodes->data[node_i].bounds = bounds;
+        }
+        else {
+            nodes->data[node_i].bounds = union_of_children(index, level, node_i);
+        }
+        node_i /= STROKEINDEX_BRANCHING;
+    }
+
+    // Drop roots with a single child.
+    while ( index->num_levels > 1 && index->levels[index->num_levels - 2].count <= 1 ) {
+        reset(&index->levels[index->num_levels - 1]);
+        index->num_levels -= 1;
+    }
+    if ( index->count == 0 ) {
+        reset(&index->levels[0]);
+        index->num_levels = 0;
+    }
+}
+
+void
+stroke_index_release(StrokeIndex* index)
+{
+    for ( i32 level = 0; level < STROKEINDEX_MAX_LEVELS; ++level ) {
+        release(&index->levels[level]);
+    }
+    *index = {};
+}
+
+i64
+stroke_index_memory_bytes(StrokeIndex* index)
+{
+    i64 bytes = 0;
+    for ( i32 level = 0; level < STROKEINDEX_MAX_LEVELS; ++level ) {
+        bytes += index->levels[level].capacity * (i64)sizeof(StrokeIndexNode);
+    }
+    return bytes;
+}
+
+static void
+query_node(StrokeIndex* index, i32 level, i64 node_i, Rect rect, DArray<StrokeRange>* out)
+{
+    Rect b = index->levels[level].data[node_i].bounds;
+    b32 outside =    rect.left   > b.right
+                  || rect.top    > b.bottom
+                  || rect.right  < b.left
+                  || rect.bottom < b.top;
+    if ( !outside ) {
+        if ( level == 0 ) {
+            StrokeRange range = stroke_index_node_range(index, 0, node_i);
+            StrokeRange* last = peek(out);
+            if ( last && last->end == range.begin ) {
+                last->end = range.end;
+            }
+            else {
+                push(out, range);
+            }
+        }
+        else {
+            i64 end = min((node_i + 1) * STROKEINDEX_BRANCHING, index->levels[level - 1].count);
+            for ( i64 ci = node_i * STROKEINDEX_BRANCHING; ci < end; ++ci ) {
+                query_node(index, level - 1, ci, rect, out);
+            }
+        }
+    }
+}
+
+void
+stroke_index_query(StrokeIndex* index, Rect rect, DArray<StrokeRange>* out)
+{
+    if ( index->num_levels > 0 ) {
+        query_node(index, index->num_levels - 1, 0, rect, out);
+    }
+}
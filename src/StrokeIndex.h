@@ -0,0 +1,57 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+// StrokeIndex
+//
+// - Bounding volume hierarchy over the strokes of a layer, in paint order.
+// - Leaves cover STROKEINDEX_LEAF_SIZE consecutive strokes. Every node above
+//   the leaves covers STROKEINDEX_BRANCHING consecutive nodes of the level below.
+// - Like the StrokeList, strokes can only be pushed and popped at the end.
+//   Both operations are O(log n).
+// - Queries return ranges of stroke indices, in paint order, so the cost of
+//   clipping is proportional to the number of visible strokes.
+
+
+#pragma once
+
+#include "DArray.h"
+#include "StrokeList.h"
+
+#define STROKEINDEX_LEAF_SIZE       64
+#define STROKEINDEX_BRANCHING       16
+#define STROKEINDEX_MAX_LEVELS      8
+
+struct StrokeIndexNode
+{
+    Rect    bounds;
+};
+
+// Indices of strokes in [begin, end)
+struct StrokeRange
+{
+    i64 begin;
+    i64 end;
+};
+
+struct StrokeIndex
+{
+    // levels[0] are the leaves. levels[num_levels-1] has a single node.
+    DArray<StrokeIndexNode> levels[STROKEINDEX_MAX_LEVELS];
+    i32                     num_levels;
+
+    i64                     count;  // Number of strokes in the index.
+};
+
+void stroke_index_push(StrokeIndex* index, Rect bounds);
+// Call after popping the last stroke of the list.
+void stroke_index_pop(StrokeIndex* index, StrokeList* strokes);
+void stroke_index_release(StrokeIndex* index);
+i64  stroke_index_memory_bytes(StrokeIndex* index);
+
+// Appends to `out` the ranges of strokes whose leaves intersect `rect`, in
+// paint order. Adjacent ranges are merged. Strokes within a range still need
+// to be tested individually.
+void stroke_index_query(StrokeIndex* index, Rect rect, DArray<StrokeRange>* out);
+
+// Stroke range covered by node `node_i` at level `level`
+StrokeRange stroke_index_node_range(StrokeIndex* index, i32 level, i64 node_i);
@@ -3,36 +3,84 @@
 
 #include "StrokeList.h"
 
-void
-strokelist_init_bucket(StrokeBucket* bucket)
+// Number of strokes that fit in the buckets that grow in size.
+#define STROKELIST_GROWING_COUNT \
+    (((1 << (STROKELIST_BUCKET_COUNT_LOG2 - STROKELIST_FIRST_BUCKET_LOG2)) - 1) << STROKELIST_FIRST_BUCKET_LOG2)
+
+static i64
+bucket_capacity(i64 bucket_i)
 {
-    bucket->bounding_rect = rect_without_size();
+    i64 log2 = min(STROKELIST_FIRST_BUCKET_LOG2 + bucket_i, (i64)STROKELIST_BUCKET_COUNT_LOG2);
+    return (i64)1 << log2;
+}
+
+// Finds the bucket holding stroke `idx` and the position within that bucket.
+static void
+locate(i64 idx, i64* out_bucket_i, i64* out_offset)
+{
+    if ( idx < STROKELIST_GROWING_COUNT ) {
+        // Bucket b starts at (2^b - 1) * first_size
+        i64 q = (idx >> STROKELIST_FIRST_BUCKET_LOG2) + 1;
+        i64 b = 0;
+        while ( q >>= 1 ) {
+            ++b;
+        }
+        *out_bucket_i = b;
+        *out_offset = idx - ((((i64)1 << b) - 1) << STROKELIST_FIRST_BUCKET_LOG2);
+    }
+    else {
+        i64 j = idx - STROKELIST_GROWING_COUNT;
+        *out_bucket_i = (STROKELIST_BUCKET_COUNT_LOG2 - STROKELIST_FIRST_BUCKET_LOG2) + (j >> STROKELIST_BUCKET_COUNT_LOG2);
+        *out_offset = j & (STROKELIST_BUCKET_COUNT - 1);
+    }
 }
 
 static StrokeBucket*
-create_bucket(Arena* arena)
+add_bucket(StrokeList* list)
 {
-    StrokeBucket* bucket = arena_alloc_elem(arena, StrokeBucket);
-    strokelist_init_bucket(bucket);
+    if ( list->num_buckets == list->buckets_capacity ) {
+        i64 capacity = list->buckets_capacity ? 2 * list->buckets_capacity : 16;
+        StrokeBucket** buckets = arena_alloc_array(list->arena, capacity, StrokeBucket*);
+        if ( list->buckets ) {
+            memcpy(buckets, list->buckets, (size_t)list->num_buckets * sizeof(StrokeBucket*));
+        }
+        list->buckets = buckets;
+        list->buckets_capacity = capacity;
+        list->allocated_bytes += capacity * (i64)sizeof(StrokeBucket*);
+    }
+    StrokeBucket* bucket = arena_alloc_elem(list->arena, StrokeBucket);
+    bucket->capacity = bucket_capacity(list->num_buckets);
+    bucket->left = arena_alloc_array(list->arena, bucket->capacity, i64);
+    bucket->top = arena_alloc_array(list->arena, bucket->capacity, i64);
+    bucket->right = arena_alloc_array(list->arena, bucket->capacity, i64);
+    bucket->bottom = arena_alloc_array(list->arena, bucket->capacity, i64);
+    bucket->render_handles = arena_alloc_array(list->arena, bucket->capacity, RenderHandle);
+    bucket->data = arena_alloc_array(list->arena, bucket->capacity, Stroke);
+    bucket->bounding_rect = rect_without_size();
+    list->allocated_bytes += (i64)sizeof(StrokeBucket) +
+                             bucket->capacity * (i64)(4*sizeof(i64) + sizeof(RenderHandle) + sizeof(Stroke));
+
+    list->buckets[list->num_buckets++] = bucket;
     return bucket;
 }
 
 void
 push(StrokeList* list, const Stroke& element)
 {
-    int bucket_i = list->count / STROKELIST_BUCKET_COUNT;
-    int i = list->count % STROKELIST_BUCKET_COUNT;
+    i64 bucket_i = 0;
+    i64 i = 0;
+    locate(list->count, &bucket_i, &i);
 
-    StrokeBucket* bucket = &list->root;
-    while ( bucket_i != 0 ) {
-        if ( !bucket->next ) {
-            bucket->next = create_bucket(list->arena);
-        }
-        bucket = bucket->next;
-        bucket_i -= 1;
-    }
+    // Buckets are kept around after reset(), so there is a new one only when
+    // the list grows past its high-water mark.
+    StrokeBucket* bucket = bucket_i < list->num_buckets ? list->buckets[bucket_i] : add_bucket(list);
 
     bucket->data[i] = element;
+    bucket->left[i] = element.bounding_rect.left;
+    bucket->top[i] = element.bounding_rect.top;
+    bucket->right[i] = element.bounding_rect.right;
+    bucket->bottom[i] = element.bounding_rect.bottom;
+    bucket->render_handles[i] = element.render_handle;
 
     bucket->bounding_rect = rect_union(bucket->bounding_rect, element.bounding_rect);
 
@@ -42,14 +90,28 @@ push(StrokeList* list, const Stroke& element)
 Stroke*
 get(StrokeList* list, i64 idx)
 {
-    int bucket_i = idx / STROKELIST_BUCKET_COUNT;
-    int i = idx % STROKELIST_BUCKET_COUNT;
-    StrokeBucket* bucket = &list->root;
-    while ( bucket_i != 0 ) {
-        bucket = bucket->next;
-        bucket_i -= 1;
-    }
-    return &bucket->data[i];
+    i64 bucket_i = 0;
+    i64 i = 0;
+    locate(idx, &bucket_i, &i);
+    mlt_assert(idx >= 0 && bucket_i < list->num_buckets);
+    return &list->buckets[bucket_i]->data[i];
+}
+
+StrokeBucket*
+strokelist_bucket_at(StrokeList* list, i64 idx, i64* out_offset)
+{
+    i64 bucket_i = 0;
+    locate(idx, &bucket_i, out_offset);
+    mlt_assert(idx >= 0 && bucket_i < list->num_buckets);
+    return list->buckets[bucket_i];
+}
+
+void
+strokelist_set_render_handle(StrokeBucket* bucket, i64 offset, RenderHandle handle)
+{
+    mlt_assert(offset >= 0 && offset < bucket->capacity);
+    bucket->data[offset].render_handle = handle;
+    bucket->render_handles[offset] = handle;
 }
 
 Stroke
@@ -72,11 +134,8 @@ void
 reset(StrokeList* list)
 {
     list->count = 0;
-    StrokeBucket* bucket = &list->root;
-
-    while( bucket ) {
-        bucket->bounding_rect = rect_without_size();
-        bucket = bucket->next;
+    for ( i64 bi = 0; bi < list->num_buckets; ++bi ) {
+        list->buckets[bi]->bounding_rect = rect_without_size();
     }
 }
 
@@ -96,29 +155,31 @@ StrokeList::operator[] (i64 i)
 
 struct StrokeIterator
 {
+    StrokeList* list;
     StrokeBucket* cur_bucket;
-    int i;
-    int count;
+    i64 bucket_i;
+    i64 offset;  // Position within cur_bucket
+    i64 i;
+    i64 count;
 };
 
 Stroke* stroke_iter_init_at(StrokeList* list, StrokeIterator* iter, u64 stroke_i)
 {
     Stroke* result = NULL;
 
-    iter->cur_bucket = &list->root;
+    iter->list = list;
+    iter->cur_bucket = NULL;
     iter->count = list->count;
     iter->i = 0;
 
-    if (stroke_i < iter->count) {
-        iter->i = stroke_i;
-        for (u64 i = 0; i < stroke_i / STROKELIST_BUCKET_COUNT; ++i) {
-            iter->cur_bucket = iter->cur_bucket->next;
-        }
+    if (stroke_i < (u64)iter->count) {
+        iter->i = (i64)stroke_i;
+        locate(iter->i, &iter->bucket_i, &iter->offset);
+        iter->cur_bucket = list->buckets[iter->bucket_i];
 
-        result = &iter->cur_bucket->data[iter->i % STROKELIST_BUCKET_COUNT];
+        result = &iter->cur_bucket->data[iter->offset];
     }
 
-
     return result;
 }
 
@@ -134,13 +195,17 @@ Stroke* stroke_iter_next(StrokeIterator* iter)
 
     if (iter->cur_bucket) {
         iter->i++;
-        if ((iter->i % STROKELIST_BUCKET_COUNT) == 0) {
-            iter->cur_bucket = iter->cur_bucket->next;
-        }
+        iter->offset++;
 
         if (iter->i < iter->count) {
-            int bucket_i = iter->i % STROKELIST_BUCKET_COUNT;
-            result = &iter->cur_bucket->data[bucket_i];
+            if (iter->offset == iter->cur_bucket->capacity) {
+                iter->cur_bucket = iter->list->buckets[++iter->bucket_i];
+                iter->offset = 0;
+            }
+            result = &iter->cur_bucket->data[iter->offset];
+        }
+        else {
+            iter->cur_bucket = NULL;
         }
     }
 
@@ -5,6 +5,10 @@
 //
 // - Works as a dynamically-sized array for Strokes.
 // - Pointers to elements in the StrokeList stay valid for the lifetime of the program.
+// - Buckets are reached through a directory of pointers, so indexing and
+//   appending are O(1). Growing the directory never moves the buckets.
+// - Nothing is allocated until the first push. Bucket sizes grow
+//   geometrically, so lists with few strokes stay small.
 
 
 #pragma once
@@ -12,27 +16,50 @@
 #include "stroke.h"
 
 #include "memory.h"
+#include "cull.h"
 
-#define STROKELIST_BUCKET_COUNT 4196
+// The first bucket holds 2^STROKELIST_FIRST_BUCKET_LOG2 strokes. Every bucket
+// after it doubles in size, up to STROKELIST_BUCKET_COUNT.
+#define STROKELIST_FIRST_BUCKET_LOG2    6
+#define STROKELIST_BUCKET_COUNT_LOG2    12
+#define STROKELIST_BUCKET_COUNT         (1 << STROKELIST_BUCKET_COUNT_LOG2)
 
 struct StrokeBucket
 {
-    Stroke          data[STROKELIST_BUCKET_COUNT];
-    StrokeBucket*   next;
+    // Hot data: dense per-stroke arrays for loops that visit every stroke,
+    // like clipping. They mirror the fields in `data`, which is what the
+    // Stroke* API hands out. Bounds are written by push() only, and render
+    // handles by push() and strokelist_set_render_handle().
+    // Bounds are split by side, for cull_rects.
+    i64*            left;
+    i64*            top;
+    i64*            right;
+    i64*            bottom;
+    RenderHandle*   render_handles;
+
+    // Cold data: brush, points, pressures...
+    Stroke*         data;
+
+    i64             capacity;   // Number of strokes that fit in the bucket.
     Rect            bounding_rect;
 };
 
 struct StrokeList
 {
-    StrokeBucket    root;
+    // Bucket directory. Allocated from the arena. When it grows, the old
+    // directory is left behind; the buckets themselves never move.
+    StrokeBucket**  buckets;
+    i64             num_buckets;
+    i64             buckets_capacity;
+
+    i64             allocated_bytes;  // Buckets and directories.
+
     i64             count;
     Stroke*         operator[](i64 i);
 
     Arena*          arena;
 };
 
-void strokelist_init_bucket(StrokeBucket* bucket);
-
 void push(StrokeList* list, const Stroke& element);
 Stroke* get(StrokeList* list, i64 idx);
 Stroke pop(StrokeList* list);
@@ -40,7 +67,15 @@ Stroke* peek(StrokeList* list);
 void reset(StrokeList* list);
 i64 count(StrokeList* list);
 
+// Returns the bucket holding stroke `idx` and writes the position of the stroke
+// within the bucket to `out_offset`.
+StrokeBucket* strokelist_bucket_at(StrokeList* list, i64 idx, i64* out_offset);
+
+// Sets the render handle of the stroke at `offset` in both of its copies.
+void strokelist_set_render_handle(StrokeBucket* bucket, i64 offset, RenderHandle handle);
+
 struct StrokeIterator;
 
 Stroke* stroke_iter_init(StrokeList* list, StrokeIterator* iter);
+Stroke* stroke_iter_init_at(StrokeList* list, StrokeIterator* iter, u64 stroke_i);
 Stroke* stroke_iter_next(StrokeIterator* iter);
\ No newline at end of file
@@ -0,0 +1,267 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+#include "buffer_pool.h"
+
+#include "gl_helpers.h"
+#include "memory.h"
+
+static PoolPage*
+find_page(BufferPool* pool, GLuint buffer)
+{
+    for ( i64 pi = 0; pi < pool->pages.count; ++pi ) {
+        if ( pool->pages.data[pi].buffer == buffer ) {
+            return &pool->pages.data[pi];
+        }
+    }
+    return NULL;
+}
+
+static PoolPage*
+new_page(BufferPool* pool)
+{
+    PoolPage page = {};
+    glGenBuffers(1, &page.buffer);
+    gl::bind_buffer(GL_ARRAY_BUFFER, page.buffer);
+    glBufferData(GL_ARRAY_BUFFER, BUFFER_POOL_PAGE_SIZE, NULL, GL_STATIC_DRAW);
+    PoolRange all = { 0, BUFFER_POOL_PAGE_SIZE };
+    push(&page.free_list, all);
+    return push(&pool->pages, page);
+}
+
+static void
+release_page(PoolPage* page)
+{
+    gl::delete_buffers(1, &page->buffer);
+    release(&page->free_list);
+    release(&page->allocations);
+}
+
+static void
+remove_range(DArray<PoolRange>* list, i64 i)
+{
+    for ( i64 j = i; j < list->count - 1; ++j ) {
+        list->data[j] = list->data[j + 1];
+    }
+    pop(list);
+}
+
+static void
+insert_range(DArray<PoolRange>* list, i64 i, PoolRange range)
+{
+    push(list, range);
+    for ( i64 j = list->count - 1; j > i; --j ) {
+        list->data[j] = list->data[j - 1];
+    }
+    list->data[i] = range;
+}
+
+static b32
+alloc_from_page(PoolPage* page, PoolAllocation* a, i64 size)
+{
+    DArray<PoolRange>* list = &page->free_list;
+    for ( i64 ri = 0; ri < list->count; ++ri ) {
+        PoolRange* range = &list->data[ri];
+        if ( range->size >= size ) {
+            a->buffer = page->buffer;
+            a->offset = range->offset;
+            a->size = size;
+            a->slot = page->allocations.count;
+            push(&page->allocations, a);
+            page->used_bytes += size;
+
+            range->offset += size;
+            range->size -= size;
+            if ( range->size == 0 ) {
+                remove_range(list, ri);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+buffer_pool_alloc(BufferPool* pool, PoolAllocation* a, i64 size)
+{
+    if ( a->buffer != 0 ) {
+        buffer_pool_free(pool, a);
+    }
+    size = (size + BUFFER_POOL_ALIGNMENT - 1) / BUFFER_POOL_ALIGNMENT * BUFFER_POOL_ALIGNMENT;
+    mlt_assert(size > 0 && size <= BUFFER_POOL_MAX_ALLOCATION);
+
+    b32 found = false;
+    for ( i64 pi = 0; !found && pi < pool->pages.count; ++pi ) {
+        found = alloc_from_page(&pool->pages.data[pi], a, size);
+    }
+    if ( !found ) {
+        found = alloc_from_page(new_page(pool), a, size);
+    }
+    mlt_assert(found);
+    pool->used_bytes += size;
+}
+
+void
+buffer_pool_free(BufferPool* pool, PoolAllocation* a)
+{
+    if ( a->buffer == 0 ) {
+        return;
+    }
+    PoolPage* page = find_page(pool, a->buffer);
+    mlt_assert(page && page->allocations.data[a->slot] == a);
+
+    // Swap-remove from the allocation list.
+    PoolAllocation* last = pop(&page->allocations);
+    if ( last != a ) {
+        page->allocations.data[a->slot] = last;
+        last->slot = a->slot;
+    }
+    page->used_bytes -= a->size;
+    pool->used_bytes -= a->size;
+
+    // Insert into the free list and merge with the neighbors.
+    DArray<PoolRange>* list = &page->free_list;
+    i64 lo = 0;
+    i64 hi = list->count;
+    while ( lo < hi ) {
+        i64 mid = (lo + hi) / 2;
+        if ( list->data[mid].offset < a->offset ) { lo = mid + 1; }
+        else                                      { hi = mid; }
+    }
+    PoolRange range = { a->offset, a->size };
+    if ( lo > 0 && list->data[lo - 1].offset + list->data[lo - 1].size == range.offset ) {
+        lo -= 1;
+        list->data[lo].size += range.size;
+    }
+    else {
+        insert_range(list, lo, range);
+    }
+    if ( lo + 1 < list->count && list->data[lo].offset + list->data[lo].size == list->data[lo + 1].offset ) {
+        list->data[lo].size += list->data[lo + 1].size;
+        remove_range(list, lo + 1);
+    }
+
+    *a = {};
+
+    // Give empty pages back to the driver, but keep one around.
+    if ( page->used_bytes == 0 && pool->pages.count > 1 ) {
+        release_page(page);
+        *page = pool->pages.data[pool->pages.count - 1];
+        pop(&pool->pages);
+    }
+}
+
+static int
+compare_allocation_offsets(const void* a, const void* b)
+{
+    i64 oa = (*(PoolAllocation**)a)->offset;
+    i64 ob = (*(PoolAllocation**)b)->offset;
+    return oa < ob ? -1 : oa > ob ? 1 : 0;
+}
+
+static f32
+page_fragmentation(PoolPage* page)
+{
+    i64 free_bytes = BUFFER_POOL_PAGE_SIZE - page->used_bytes;
+    i64 largest = 0;
+    for ( i64 ri = 0; ri < page->free_list.count; ++ri ) {
+        largest = max(largest, page->free_list.data[ri].size);
+    }
+    f32 fragmentation = free_bytes > 0 ? 1.0f - (f32)largest / (f32)free_bytes : 0.0f;
+    return fragmentation;
+}
+
+b32
+buffer_pool_compact(BufferPool* pool)
+{
+    // Only pages with a lot of scattered free space are worth a round trip
+    // through system memory. One page per call, to keep hitches short.
+    PoolPage* page = NULL;
+    for ( i64 pi = 0; pi < pool->pages.count; ++pi ) {
+        PoolPage* p = &pool->pages.data[pi];
+        if (    BUFFER_POOL_PAGE_SIZE - p->used_bytes >= BUFFER_POOL_PAGE_SIZE / 4
+             && page_fragmentation(p) >= 0.5f
+             && (page == NULL || p->free_list.count > page->free_list.count) ) {
+            page = p;
+        }
+    }
+    if ( page == NULL ) {
+        return false;
+    }
+
+    DArray<PoolAllocation*>* allocations = &page->allocations;
+    qsort(allocations->data, (size_t)allocations->count, sizeof(PoolAllocation*), compare_allocation_offsets);
+
+    i64 end = 0;
+    if ( allocations->count > 0 ) {
+        PoolAllocation* last = allocations->data[allocations->count - 1];
+        end = last->offset + last->size;
+    }
+
+    u8* contents = (u8*)mlt_calloc((size_t)end, 1, "GPU");
+    gl::bind_buffer(GL_ARRAY_BUFFER, page->buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)end, contents);
+
+    i64 packed = 0;
+    for ( i64 ai = 0; ai < allocations->count; ++ai ) {
+        PoolAllocation* a = allocations->data[ai];
+        if ( a->offset != packed ) {
+            memmove(contents + packed, contents + a->offset, (size_t)a->size);
+            pool->bytes_moved += a->size;
+            a->offset = packed;
+        }
+        a->slot = ai;
+        packed += a->size;
+    }
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)packed, contents);
+    mlt_free(contents, "GPU");
+
+    reset(&page->free_list);
+    PoolRange rest = { packed, BUFFER_POOL_PAGE_SIZE - packed };
+    push(&page->free_list, rest);
+
+    pool->num_compactions += 1;
+    return true;
+}
+
+void
+buffer_pool_release(BufferPool* pool)
+{
+    for ( i64 pi = 0; pi < pool->pages.count; ++pi ) {
+        PoolPage* page = &pool->pages.data[pi];
+        for ( i64 ai = 0; ai < page->allocations.count; ++ai ) {
+            *page->allocations.data[ai] = {};
+        }
+        release_page(page);
+    }
+    release(&pool->pages);
+    *pool = {};
+}
+
+BufferPoolStats
+buffer_pool_stats(BufferPool* pool)
+{
+    BufferPoolStats stats = {};
+    i64 free_bytes = 0;
+    for ( i64 pi = 0; pi < pool->pages.count; ++pi ) {
+        PoolPage* page = &pool->pages.data[pi];
+        stats.num_allocations += page->allocations.count;
+        stats.used_bytes += page->used_bytes;
+        stats.num_free_ranges += page->free_list.count;
+        for ( i64 ri = 0; ri < page->free_list.count; ++ri ) {
+            stats.largest_free_range = max(stats.largest_free_range, page->free_list.data[ri].size);
+            free_bytes += page->free_list.data[ri].size;
+        }
+    }
+    stats.num_pages = pool->pages.count;
+    stats.capacity_bytes = pool->pages.count * (i64)BUFFER_POOL_PAGE_SIZE;
+    if ( stats.capacity_bytes > 0 ) {
+        stats.occupancy = (f32)stats.used_bytes / (f32)stats.capacity_bytes;
+    }
+    if ( free_bytes > 0 ) {
+        stats.fragmentation = 1.0f - (f32)stats.largest_free_range / (f32)free_bytes;
+    }
+    stats.num_compactions = pool->num_compactions;
+    stats.bytes_moved = pool->bytes_moved;
+    return stats;
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+// BufferPool
+//
+// - Sub-allocates stroke geometry out of a few large GL buffers (pages), so
+//   that cooking and freeing strokes does not create and delete buffer
+//   objects.
+// - Each page keeps a free list sorted by offset. Allocation is first-fit,
+//   and freed ranges are merged with their neighbors.
+// - Every allocation is owned by a PoolAllocation that the pool can write
+//   to. Compaction packs the live allocations of a fragmented page and
+//   updates their owners, so owners must not move while they are allocated.
+// - Pages hold vertex attributes and indices alike. They are bound to both
+//   GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER.
+
+
+#pragma once
+
+#include "common.h"
+#include "DArray.h"
+#include "gl.h"
+
+#define BUFFER_POOL_PAGE_SIZE   (4*1024*1024)
+
+// Every allocation starts and ends on a multiple of this. It is the size of a
+// stroke segment, so that batched draws can address segments by their index
+// in the page. Not a power of two.
+#define BUFFER_POOL_ALIGNMENT   24
+
+#define BUFFER_POOL_MAX_ALLOCATION  (BUFFER_POOL_PAGE_SIZE / BUFFER_POOL_ALIGNMENT * BUFFER_POOL_ALIGNMENT)
+
+struct PoolAllocation
+{
+    GLuint  buffer;     // 0 when nothing is allocated.
+    i64     offset;     // Bytes from the start of `buffer`.
+    i64     size;
+    i64     slot;       // Position in the page's allocation list.
+};
+
+struct PoolRange
+{
+    i64 offset;
+    i64 size;
+};
+
+struct PoolPage
+{
+    GLuint                  buffer;
+    i64                     used_bytes;
+    DArray<PoolRange>       free_list;      // Sorted by offset. No two ranges touch.
+    DArray<PoolAllocation*> allocations;    // Live allocations, in no particular order.
+};
+
+struct BufferPool
+{
+    DArray<PoolPage>    pages;
+    i64                 used_bytes;     // Sum of the sizes of live allocations.
+
+    // Counters for the debug window.
+    i64                 num_compactions;
+    i64                 bytes_moved;
+};
+
+struct BufferPoolStats
+{
+    i64 num_pages;
+    i64 num_allocations;
+    i64 capacity_bytes;
+    i64 used_bytes;
+    i64 num_free_ranges;
+    i64 largest_free_range;
+
+    f32 occupancy;      // used / capacity
+    f32 fragmentation;  // 1 - largest free range / free bytes. 0 when free space is contiguous.
+
+    i64 num_compactions;
+    i64 bytes_moved;
+};
+
+// Frees `a` first if it already holds an allocation.
+void buffer_pool_alloc(BufferPool* pool, PoolAllocation* a, i64 size);
+void buffer_pool_free(BufferPool* pool, PoolAllocation* a);
+
+// Packs the most fragmented page, if any page is fragmented enough to be
+// worth it. Returns true if some allocation moved. Copies of PoolAllocation
+// made before the call are stale after it.
+b32  buffer_pool_compact(BufferPool* pool);
+
+// Deletes every page. Owners of live allocations are reset to zero.
+void buffer_pool_release(BufferPool* pool);
+
+BufferPoolStats buffer_pool_stats(BufferPool* pool);
@@ -205,14 +205,40 @@ namespace layer
         return l;
     }
 
+    static u64 g_layer_generation;
+
     // Push stroke at the top of the current layer
     Stroke*
     layer_push_stroke(Layer* layer, Stroke stroke)
     {
         push(&layer->strokes, stroke);
+        stroke_index_push(&layer->stroke_index, stroke.bounding_rect);
+        layer->generation = ++g_layer_generation;
         return peek(&layer->strokes);
     }
 
+    // Pop the stroke at the top of the layer
+    Stroke
+    layer_pop_stroke(Layer* layer)
+    {
+        Stroke stroke = pop(&layer->strokes);
+        stroke_index_pop(&layer->stroke_index, &layer->strokes);
+        layer->clip_valid_count = min(layer->clip_valid_count, layer->strokes.count);
+        layer->generation = ++g_layer_generation;
+        return stroke;
+    }
+
+    i64
+    layer_memory_bytes(Layer* layer)
+    {
+        i64 bytes = (i64)sizeof(Layer) + layer->strokes.allocated_bytes + stroke_index_memory_bytes(&layer->stroke_index);
+        StrokeIterator iter;
+        for ( Stroke* s = stroke_iter_init(&layer->strokes, &iter); s != NULL; s = stroke_iter_next(&iter) ) {
+            bytes += s->num_points * (i64)(sizeof(*s->points) + sizeof(*s->pressures));
+        }
+        return bytes;
+    }
+
     b32
     layer_has_blur_effect(Layer* layer)
     {
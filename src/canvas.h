@@ -6,6 +6,7 @@
 
 #include "vector.h"
 #include "StrokeList.h"
+#include "StrokeIndex.h"
 
 #define MAX_LAYER_NAME_LEN          64
 
@@ -37,6 +38,9 @@ struct Layer
     i32 id;
 
     StrokeList strokes;
+    StrokeIndex stroke_index;  // Spatial index for strokes. Kept in sync by layer_push_stroke / layer_pop_stroke
+    i64 clip_valid_count;      // Strokes below this index are unchanged since the renderer last clipped the layer. Lowered by layer_pop_stroke.
+    u64 generation;            // Changes whenever a stroke is pushed or popped. No two layers ever share a non-zero value.
     char    name[MAX_LAYER_NAME_LEN];
 
     i32     flags;  // LayerFlags
@@ -122,8 +126,10 @@ namespace layer {
     void    layer_toggle_visibility (Layer* layer);
     b32     layer_has_blur_effect (Layer* layer);
     Stroke* layer_push_stroke (Layer* layer, Stroke stroke);
+    Stroke  layer_pop_stroke (Layer* layer);
     i32     number_of_layers (Layer* root);
     void    free_layers (Layer* root);
     i64     count_strokes (Layer* root);
+    i64     layer_memory_bytes (Layer* layer);  // Strokes, points and index. Slow, it visits every stroke.
     i64     count_clipped_strokes (Layer* root, i32 num_workers);
 }
@@ -5,13 +5,25 @@
 // Per-stroke uniforms
 uniform vec4 u_brush_color;
 
-// CanvasView elements:
+// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc
+#if HAS_UNIFORM_BLOCKS
+layout(std140) uniform ViewBlock
+{
+    mat2  u_rotation;
+    mat2  u_rotation_inverse;
+    ivec2 u_pan_center;
+    vec2  u_zoom_center;
+    vec2  u_screen_size;
+    int   u_scale;
+};
+#else
 uniform mat2 u_rotation;
 uniform mat2 u_rotation_inverse;
 uniform ivec2 u_pan_center;
-uniform ivec2 u_zoom_center;
+uniform vec2  u_zoom_center;
 uniform vec2  u_screen_size;
 uniform int   u_scale;
+#endif
 uniform int   u_radius;
 
 vec2
@@ -0,0 +1,103 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+#include "cull.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+    #define CULL_TARGET_AVX2
+#else
+    #include <immintrin.h>
+    #define CULL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Left-packing: for each 4-bit mask, the positions of its set bits followed
+// by padding, and how many there are.
+static const i32 k_cull_pack_positions[16][4] =
+{
+    {0,0,0,0}, {0,0,0,0}, {1,0,0,0}, {0,1,0,0},
+    {2,0,0,0}, {0,2,0,0}, {1,2,0,0}, {0,1,2,0},
+    {3,0,0,0}, {0,3,0,0}, {1,3,0,0}, {0,1,3,0},
+    {2,3,0,0}, {0,2,3,0}, {1,2,3,0}, {0,1,2,3},
+};
+static const i32 k_cull_pack_count[16] = { 0,1,1,2, 1,2,2,3, 1,2,2,3, 2,3,3,4 };
+
+typedef i64 CullRectsFunc(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                          i64 count, Rect rect, i32 cull_flags, i32* out_indices);
+
+// Scalar loop over [begin, count). Appends to out_indices starting at n.
+static i64
+cull_rects_tail(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                i64 begin, i64 count, Rect rect, i32 cull_flags, i32* out_indices, i64 n)
+{
+    b32 want_outside = (cull_flags & CullFlags_OUTSIDE) != 0;
+    for ( i64 i = begin; i < count; ++i ) {
+        b32 outside =    rect.left   > right[i]
+                      || rect.top    > bottom[i]
+                      || rect.right  < left[i]
+                      || rect.bottom < top[i];
+        if ( outside == want_outside ) {
+            out_indices[n++] = (i32)i;
+        }
+    }
+    return n;
+}
+
+i64
+cull_rects_scalar(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                  i64 count, Rect rect, i32 cull_flags, i32* out_indices)
+{
+    return cull_rects_tail(left, top, right, bottom, 0, count, rect, cull_flags, out_indices, 0);
+}
+
+CULL_TARGET_AVX2 i64
+cull_rects_avx2(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                i64 count, Rect rect, i32 cull_flags, i32* out_indices)
+{
+    const __m256i rl = _mm256_set1_epi64x(rect.left);
+    const __m256i rt = _mm256_set1_epi64x(rect.top);
+    const __m256i rr = _mm256_set1_epi64x(rect.right);
+    const __m256i rb = _mm256_set1_epi64x(rect.bottom);
+    int flip = (cull_flags & CullFlags_OUTSIDE) ? 0 : 0xf;
+
+    i64 n = 0;
+    i64 i = 0;
+    for ( ; i + 4 <= count; i += 4 ) {
+        __m256i outside = _mm256_cmpgt_epi64(rl, _mm256_loadu_si256((__m256i const*)(right + i)));
+        outside = _mm256_or_si256(outside, _mm256_cmpgt_epi64(rt, _mm256_loadu_si256((__m256i const*)(bottom + i))));
+        outside = _mm256_or_si256(outside, _mm256_cmpgt_epi64(_mm256_loadu_si256((__m256i const*)(left + i)), rr));
+        outside = _mm256_or_si256(outside, _mm256_cmpgt_epi64(_mm256_loadu_si256((__m256i const*)(top + i)), rb));
+
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(outside)) ^ flip;
+        // Writes four indices, but only the ones selected by the mask are
+        // kept. Since n <= i, this never writes past out_indices[count-1].
+        __m128i positions = _mm_loadu_si128((__m128i const*)k_cull_pack_positions[mask]);
+        _mm_storeu_si128((__m128i*)(out_indices + n), _mm_add_epi32(_mm_set1_epi32((i32)i), positions));
+        n += k_cull_pack_count[mask];
+    }
+    return cull_rects_tail(left, top, right, bottom, i, count, rect, cull_flags, out_indices, n);
+}
+
+b32
+cull_has_avx2()
+{
+    return SDL_HasAVX2() == SDL_TRUE;
+}
+
+static CullRectsFunc*
+cull_select_impl()
+{
+    CullRectsFunc* impl = cull_rects_scalar;
+    if ( cull_has_avx2() ) {
+        impl = cull_rects_avx2;
+    }
+    return impl;
+}
+
+i64
+cull_rects(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+           i64 count, Rect rect, i32 cull_flags, i32* out_indices)
+{
+    static CullRectsFunc* impl = cull_select_impl();
+    return impl(left, top, right, bottom, count, rect, cull_flags, out_indices);
+}
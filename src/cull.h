@@ -0,0 +1,39 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+// Rectangle culling
+//
+// - Tests many rectangles, stored as separate left/top/right/bottom arrays,
+//   against a single rectangle.
+// - Writes the indices of the rectangles that pass to a compact list.
+// - cull_rects picks the AVX2 version at runtime, with a scalar fallback.
+//   There is no SSE2 version: without a 64-bit compare it is slower than the
+//   scalar loop.
+
+
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+
+enum CullFlags
+{
+    CullFlags_NONE = 0,
+
+    // Output the rectangles that do *not* overlap.
+    CullFlags_OUTSIDE = 1<<0,
+};
+
+// Returns the number of indices written to out_indices, which must have room
+// for `count` elements. Rectangles that touch `rect` count as overlapping,
+// same as the scalar tests in the renderer.
+i64 cull_rects(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+               i64 count, Rect rect, i32 cull_flags, i32* out_indices);
+
+// Each implementation, for tests and benchmarks. Do not call the AVX2 one
+// unless cull_has_avx2() returns true.
+i64 cull_rects_scalar(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                      i64 count, Rect rect, i32 cull_flags, i32* out_indices);
+i64 cull_rects_avx2(i64 const* left, i64 const* top, i64 const* right, i64 const* bottom,
+                    i64 count, Rect rect, i32 cull_flags, i32* out_indices);
+b32 cull_has_avx2();
@@ -25,12 +25,15 @@
     X(void,     glBindFramebufferEXT,     GLenum target, GLuint framebuffer)                      \
     X(void,     glBindTexture,            GLenum target, GLuint text) \
     X(void,     glBufferData,             GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) \
+    X(void,     glBufferSubData,          GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) \
+    X(void,     glGetBufferSubData,       GLenum target, GLintptr offset, GLsizeiptr size, GLvoid *data) \
     X(void,     glCompileShader,          GLuint shader)                                          \
     X(void,     glEnable, GLenum cap )\
     X(void,     glFramebufferTexture2DEXT, GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) \
     X(void,     glGenFramebuffersEXT,     GLsizei n, GLuint* framebuffers)                        \
     X(void,     glGenTextures,            GLsizei n, GLuint* textures) \
     X(void,     glAttachShader,           GLuint program, GLuint shader)                          \
+    X(void,     glBindAttribLocation,     GLuint program, GLuint index, GLchar* name)       \
     X(GLboolean, glIsProgram,             GLuint program)                                         \
     X(GLboolean, glIsShader,              GLuint shader)                                          \
     X(GLuint,   glCreateShader,           GLenum type)                                            \
@@ -72,13 +75,28 @@
     X(void,     glClearColor, GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)\
     X(void,     glClearDepth,             GLclampd depth) \
     X(void,     glCopyTexImage2D,         GLenum target, GLint level, GLenum internalformat, GLint x, GLint y, GLsizei width, GLsizei height, GLint border)\
+    X(void,     glCopyTexSubImage2D,      GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)\
     X(void,     glDeleteBuffers,          GLsizei n, GLuint* buffers)                       \
     X(void,     glDeleteVertexArrays,     GLsizei n, GLuint* arrays)                        \
     X(void,     glDepthFunc,              GLenum func) \
     X(void,     glDisable,                GLenum cap) \
     X(void,     glDrawArrays, GLenum mode, GLint first, GLsizei count)\
     X(void,     glDrawElements,           GLenum mode, GLsizei count, GLenum type, const void *indices)\
+    X(void,     glDrawArraysInstanced,    GLenum mode, GLint first, GLsizei count, GLsizei instancecount)\
+    X(void,     glVertexAttribDivisor,    GLuint index, GLuint divisor)\
+    X(void,     glMultiDrawArrays,        GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount)\
+    X(void,     glTexBuffer,              GLenum target, GLenum internalformat, GLuint buffer)\
+    X(void,     glGetActiveUniform,       GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)\
+    X(void,     glGetActiveAttrib,        GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)\
+    X(GLuint,   glGetUniformBlockIndex,   GLuint program, const GLchar* uniformBlockName)\
+    X(void,     glUniformBlockBinding,    GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding)\
+    X(void,     glBindBufferBase,         GLenum target, GLuint index, GLuint buffer)\
     X(void,     glEnableVertexAttribArray, GLuint index)                                          \
+    X(void,     glGenQueries,             GLsizei n, GLuint* ids)\
+    X(void,     glBeginQuery,             GLenum target, GLuint id)\
+    X(void,     glEndQuery,               GLenum target)\
+    X(void,     glGetQueryObjectiv,       GLuint id, GLenum pname, GLint* params)\
+    X(void,     glGetQueryObjectui64v,    GLuint id, GLenum pname, GLuint64* params)\
     X(void,     glPixelStorei,            GLenum pname, GLint param)\
     X(void,     glReadPixels,             GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void *pixels)\
     X(void,     glScissor,                GLint x, GLint y, GLsizei width, GLsizei height) \
@@ -91,7 +109,6 @@
     X(void,     glDeleteShader,           GLuint shader)                                          \
     X(void, glPolygonMode,  GLenum face, GLenum mode) \
 
-    // X(void,     glBindAttribLocation,     GLuint program, GLuint index, GLchar* name)       \
     // X(void,     glDeleteFramebuffersEXT,  GLsizei n, GLuint *framebuffers)                  \
     // X(void,     glDisableVertexAttribArray, GLuint index)                                         \
     // X(void,     glEnableClientState, GLenum array)\
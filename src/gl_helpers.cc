@@ -19,6 +19,38 @@
 // Global variable that keeps track of Milton's GL configuration. See GLHelperFlags.
 static int g_gl_helper_flags;
 
+// Locations of the active uniforms and attributes of every linked program,
+// resolved once by link_program. Uniforms also keep the last value that was
+// uploaded, so setting the same value again does not reach the driver.
+#define MAX_PROGRAMS                32
+#define MAX_PROGRAM_VARIABLES       32
+#define MAX_VARIABLE_NAME           64
+#define MAX_SHADOWED_UNIFORM_SIZE   16  // Bytes. Larger uniforms are always uploaded.
+
+struct ProgramVariable
+{
+    char    name[MAX_VARIABLE_NAME];
+    GLint   location;
+    b32     has_value;
+    u8      value[MAX_SHADOWED_UNIFORM_SIZE];
+};
+
+struct ProgramLocations
+{
+    GLuint          program;
+    i32             num_uniforms;
+    i32             num_attributes;
+    ProgramVariable uniforms[MAX_PROGRAM_VARIABLES];
+    ProgramVariable attributes[MAX_PROGRAM_VARIABLES];
+};
+
+static ProgramLocations g_programs[MAX_PROGRAMS];
+static i32              g_num_programs;
+
+// Shadowed GL state. Code that binds these directly has to restore them.
+static GLuint g_current_program;
+static GLuint g_array_buffer;
+
 namespace gl {
 
 // Static helpers
@@ -99,20 +131,34 @@ load ()
     bool ok = true;
     // Extension checking.
 
-#if MULTISAMPLING_ENABLED
+    b32 has_instanced_arrays = false;
+    b32 has_timer_query = false;
+    auto check_extension = [&has_instanced_arrays, &has_timer_query](const char* extension_string) {
+        #if MULTISAMPLING_ENABLED
+            if ( strcmp(extension_string, "GL_ARB_sample_shading") == 0 ) {
+                gl::set_flags(GLHelperFlags_SAMPLE_SHADING);
+            }
+            if ( strcmp(extension_string, "GL_ARB_texture_multisample") == 0 ) {
+                gl::set_flags(GLHelperFlags_TEXTURE_MULTISAMPLE);
+            }
+        #endif
+        if ( strcmp(extension_string, "GL_ARB_instanced_arrays") == 0 ) {
+            has_instanced_arrays = true;
+        }
+        if ( strcmp(extension_string, "GL_ARB_timer_query") == 0 ) {
+            has_timer_query = true;
+        }
+    };
+
     i64 num_extensions = 0;
-    glGetIntegerv(GL_NUM_EXTENSIONS, (GLint*)&num_extensions);
+    if ( glGetStringi ) {
+        glGetIntegerv(GL_NUM_EXTENSIONS, (GLint*)&num_extensions);
+    }
 
     if ( num_extensions > 0 ) {
         for ( i64 extension_i = 0; extension_i < num_extensions; ++extension_i ) {
             char* extension_string = (char*)glGetStringi(GL_EXTENSIONS, (GLuint)extension_i);
-
-                if ( strcmp(extension_string, "GL_ARB_sample_shading") == 0 ) {
-                    gl::set_flags(GLHelperFlags_SAMPLE_SHADING);
-                }
-                if ( strcmp(extension_string, "GL_ARB_texture_multisample") == 0 ) {
-                    gl::set_flags(GLHelperFlags_TEXTURE_MULTISAMPLE);
-                }
+            check_extension(extension_string);
         }
     }
     // glGetStringi probably does not handle GL_EXTENSIONS
@@ -122,7 +168,7 @@ load ()
         char ext[MAX_EXTENSION_LEN] = {};
         const char* begin = extensions;
         for ( const char* end = extensions;
-              *end != '\0';
+              extensions && *end != '\0';
               ++end ) {
             if ( *end == ' ' ) {
                 size_t len = (size_t)end - (size_t)begin;
@@ -130,12 +176,7 @@ load ()
                 if ( len < MAX_EXTENSION_LEN ) {
                     memcpy((void*)ext, (void*)begin, len);
                     ext[len]='\0';
-                        if ( strcmp(ext, "GL_ARB_sample_shading") == 0 ) {
-                            gl::set_flags(GLHelperFlags_SAMPLE_SHADING);
-                        }
-                        if ( strcmp(ext, "GL_ARB_texture_multisample") == 0 ) {
-                            gl::set_flags(GLHelperFlags_TEXTURE_MULTISAMPLE);
-                        }
+                    check_extension(ext);
                     begin = end+1;
                 }
                 else {
@@ -144,7 +185,51 @@ load ()
             }
         }
     }
-#endif
+
+    // Instancing is core in GL 3.3. Before that, and on GL 2.1, it comes
+    // with ARB_instanced_arrays.
+    {
+        GLint major = 0;
+        GLint minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        glGetError();  // GL 2.1 does not know about GL_MAJOR_VERSION.
+        b32 core_instancing = major > 3 || (major == 3 && minor >= 3);
+
+        if ( !core_instancing && has_instanced_arrays ) {
+            glDrawArraysInstanced = (decltype(glDrawArraysInstanced)) platform_get_gl_proc("glDrawArraysInstancedARB");
+            glVertexAttribDivisor = (decltype(glVertexAttribDivisor)) platform_get_gl_proc("glVertexAttribDivisorARB");
+        }
+        if ( (core_instancing || has_instanced_arrays) && glDrawArraysInstanced && glVertexAttribDivisor ) {
+            gl::set_flags(GLHelperFlags_INSTANCING);
+        }
+        else {
+            milton_log("Instancing not available. Strokes will be drawn without it.\n");
+        }
+
+        b32 core_texture_buffer = major > 3 || (major == 3 && minor >= 1);
+        if ( core_texture_buffer && glTexBuffer && glMultiDrawArrays ) {
+            gl::set_flags(GLHelperFlags_TEXTURE_BUFFER);
+        }
+
+        b32 core_timer_query = major > 3 || (major == 3 && minor >= 3);
+        if ( (core_timer_query || has_timer_query) && glGenQueries && glGetQueryObjectui64v ) {
+            gl::set_flags(GLHelperFlags_TIMER_QUERY);
+        }
+    }
+
+    // Drivers usually hand out their newest compatibility context when
+    // asked for 2.1, so newer shaders can still be compiled on the side.
+    {
+        const char* glsl_version = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
+        int glsl_major = 0;
+        int glsl_minor = 0;
+        if ( glsl_version && sscanf(glsl_version, "%d.%d", &glsl_major, &glsl_minor) == 2 ) {
+            if ( glsl_major > 3 || (glsl_major == 3 && glsl_minor >= 30) ) {
+                gl::set_flags(GLHelperFlags_GLSL_330);
+            }
+        }
+    }
 
 #if defined(_WIN32)
 #pragma warning(push, 0)
@@ -167,19 +252,21 @@ log (char* str)
 #endif
 }
 
-GLuint
-compile_shader (const char* in_src, GLuint type, char* config, char* variation_config)
+static GLuint
+compile_shader_version (const char* in_src, GLuint type, char* config, char* variation_config, b32 glsl_330)
 {
     const char* sources[] = {
+        glsl_330 ? "#version 330 \n" : "#version 120\n",
+        //"#extension GL_ARB_gpu_shader5 : disable \n",
+        // "#extension GL_ARB_gpu_shader4 : enable \n",
+        glsl_330 ? "" : (type == GL_VERTEX_SHADER) ? "#define in attribute \n#define out varying\n"
+                                                   : "#define in varying   \n#define out\n#define out_color gl_FragColor\n",
+        glsl_330 ? "" : "#define texture texture2D\n",
+        // Uniform blocks are set up only in GL 3.2 builds.
         #if USE_GL_3_2
-            "#version 330 \n",
+            "#define HAS_UNIFORM_BLOCKS 1\n",
         #else
-            "#version 120\n",
-            //"#extension GL_ARB_gpu_shader5 : disable \n",
-            // "#extension GL_ARB_gpu_shader4 : enable \n",
-            (type == GL_VERTEX_SHADER) ? "#define in attribute \n#define out varying\n"
-                                       : "#define in varying   \n#define out\n#define out_color gl_FragColor\n",
-            "#define texture texture2D\n",
+            "#define HAS_UNIFORM_BLOCKS 0\n",
         #endif
         #if STROKE_DEBUG_VIZ
             "#define STROKE_DEBUG_VIZ 1\n",
@@ -192,9 +279,7 @@ compile_shader (const char* in_src, GLuint type, char* config, char* variation_c
         "#extension GL_ARB_sample_shading : enable\n",
         //" #extension GL_ARB_texture_multisample : enable\n",
         "#endif\n",
-#if USE_GL_3_2
-        (type == GL_FRAGMENT_SHADER) ? "out vec4 out_color; \n" : "\n",
-#endif
+        (glsl_330 && type == GL_FRAGMENT_SHADER) ? "out vec4 out_color; \n" : "\n",
 
         config,
         variation_config,
@@ -232,6 +317,161 @@ compile_shader (const char* in_src, GLuint type, char* config, char* variation_c
     return obj;
 }
 
+GLuint
+compile_shader (const char* in_src, GLuint type, char* config, char* variation_config)
+{
+    return compile_shader_version(in_src, type, config, variation_config, USE_GL_3_2);
+}
+
+GLuint
+compile_shader_glsl_330 (const char* in_src, GLuint type, char* config, char* variation_config)
+{
+    mlt_assert(check_flags(GLHelperFlags_GLSL_330));
+    return compile_shader_version(in_src, type, config, variation_config, true);
+}
+
+static ProgramLocations*
+find_program(GLuint program)
+{
+    static i32 last = 0;
+    if ( last < g_num_programs && g_programs[last].program == program ) {
+        return &g_programs[last];
+    }
+    for ( i32 pi = 0; pi < g_num_programs; ++pi ) {
+        if ( g_programs[pi].program == program ) {
+            last = pi;
+            return &g_programs[pi];
+        }
+    }
+    return NULL;
+}
+
+static ProgramVariable*
+find_variable(ProgramVariable* variables, i32 count, char* name)
+{
+    for ( i32 vi = 0; vi < count; ++vi ) {
+        if ( strcmp(variables[vi].name, name) == 0 ) {
+            return &variables[vi];
+        }
+    }
+    return NULL;
+}
+
+// Appends the variable unless it has no location, like members of uniform blocks.
+static void
+add_variable(ProgramVariable* variables, i32* count, char* name, GLint location)
+{
+    if ( location >= 0 && *count < MAX_PROGRAM_VARIABLES ) {
+        ProgramVariable* v = &variables[(*count)++];
+        *v = {};
+        // Arrays are reported as "name[0]"
+        char* bracket = strchr(name, '[');
+        if ( bracket ) {
+            *bracket = '\0';
+        }
+        strncpy(v->name, name, MAX_VARIABLE_NAME - 1);
+        v->location = location;
+    }
+    else if ( location >= 0 ) {
+        milton_log("WARNING: Too many variables in program to cache %s\n", name);
+    }
+}
+
+static void
+resolve_locations(GLuint program)
+{
+    ProgramLocations* p = find_program(program);
+    if ( p == NULL ) {
+        if ( g_num_programs == MAX_PROGRAMS ) {
+            milton_log("WARNING: Too many programs. Locations will be queried every time.\n");
+            return;
+        }
+        p = &g_programs[g_num_programs++];
+    }
+    *p = {};
+    p->program = program;
+
+    char name[MAX_VARIABLE_NAME];
+    GLint num_uniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    for ( GLint ui = 0; ui < num_uniforms; ++ui ) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, (GLuint)ui, MAX_VARIABLE_NAME, &length, &size, &type, (GLchar*)name);
+        add_variable(p->uniforms, &p->num_uniforms, name, glGetUniformLocation(program, (GLchar*)name));
+    }
+
+    GLint num_attributes = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &num_attributes);
+    for ( GLint ai = 0; ai < num_attributes; ++ai ) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveAttrib(program, (GLuint)ai, MAX_VARIABLE_NAME, &length, &size, &type, (GLchar*)name);
+        add_variable(p->attributes, &p->num_attributes, name, glGetAttribLocation(program, (GLchar*)name));
+    }
+}
+
+GLint
+uniform_location(GLuint program, char* name)
+{
+    GLint loc = -1;
+    ProgramLocations* p = find_program(program);
+    if ( p ) {
+        ProgramVariable* v = find_variable(p->uniforms, p->num_uniforms, name);
+        loc = v ? v->location : -1;
+    }
+    else {
+        loc = glGetUniformLocation(program, (GLchar*)name);
+    }
+    return loc;
+}
+
+GLint
+attrib_location(GLuint program, char* name)
+{
+    GLint loc = -1;
+    ProgramLocations* p = find_program(program);
+    if ( p ) {
+        ProgramVariable* v = find_variable(p->attributes, p->num_attributes, name);
+        loc = v ? v->location : -1;
+    }
+    else {
+        loc = glGetAttribLocation(program, (GLchar*)name);
+    }
+    return loc;
+}
+
+// Location of the uniform, or -1. `upload` is false when `value` is what the
+// uniform already holds.
+static GLint
+prepare_uniform(GLuint program, char* name, void* value, size_t size, bool* upload)
+{
+    GLint loc = -1;
+    *upload = true;
+    ProgramLocations* p = find_program(program);
+    if ( p ) {
+        ProgramVariable* v = find_variable(p->uniforms, p->num_uniforms, name);
+        if ( v ) {
+            loc = v->location;
+            if ( size <= MAX_SHADOWED_UNIFORM_SIZE ) {
+                if ( v->has_value && memcmp(v->value, value, size) == 0 ) {
+                    *upload = false;
+                }
+                else {
+                    memcpy(v->value, value, size);
+                    v->has_value = true;
+                }
+            }
+        }
+    }
+    else {
+        loc = glGetUniformLocation(program, (GLchar*)name);
+    }
+    return loc;
+}
+
 #if defined(__MACH__)
 #undef glShaderSourceARB
 #undef glCompileShaderARB
@@ -272,6 +512,8 @@ link_program (GLuint obj, GLuint shaders[], int64_t num_shaders)
         mlt_assert(!"program linking error");
     }
     glValidateProgram(obj);
+
+    resolve_locations(obj);
 }
 #if defined(__MACH__)
 #undef glGetObjectParameterivARB
@@ -286,7 +528,7 @@ bool
 set_attribute_vec2(GLuint program, char* name, GLfloat* data, size_t data_sz)
 {
     bool ok = true;
-    GLint loc = glGetAttribLocation(program, (GLchar*)name);
+    GLint loc = attrib_location(program, name);
     ok = loc >= 0;
     if ( ok ) {
         glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)data_sz, data, GL_STATIC_DRAW);
@@ -298,164 +540,174 @@ set_attribute_vec2(GLuint program, char* name, GLfloat* data, size_t data_sz)
 void
 use_program(GLuint program)
 {
-    static GLuint cached_program = 0;
-    if (program != cached_program) {
+    if (program != g_current_program) {
         glUseProgram(program);
-        cached_program = program;
+        g_current_program = program;
+    }
+}
+
+void
+bind_buffer(GLenum target, GLuint buffer)
+{
+    if ( target != GL_ARRAY_BUFFER ) {
+        glBindBuffer(target, buffer);
+    }
+    else if ( buffer != g_array_buffer ) {
+        glBindBuffer(target, buffer);
+        g_array_buffer = buffer;
     }
 }
 
+void
+delete_buffers(GLsizei n, GLuint* buffers)
+{
+    // GL unbinds deleted buffers, and may hand out their names again.
+    for ( GLsizei i = 0; i < n; ++i ) {
+        if ( buffers[i] == g_array_buffer ) {
+            g_array_buffer = 0;
+        }
+    }
+    glDeleteBuffers(n, buffers);
+}
+
 bool
-set_uniform_vec4(GLuint program, char* name, size_t count, float* vals)
+bind_uniform_block(GLuint program, char* name, GLuint binding)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
+    bool ok = false;
+    if ( glGetUniformBlockIndex && glUniformBlockBinding ) {
+        GLuint index = glGetUniformBlockIndex(program, (GLchar*)name);
+        ok = index != GL_INVALID_INDEX;
+        if ( ok ) {
+            glUniformBlockBinding(program, index, binding);
+        }
+    }
+    return ok;
+}
 
-    if ( ok ) {
+bool
+set_uniform_vec4(GLuint program, char* name, size_t count, float* vals)
+{
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, count*4*sizeof(float), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform4fv(loc, (GLsizei)count, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_vec3i(GLuint program, char* name, size_t count, i32* vals)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, count*3*sizeof(i32), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform3iv(loc, (GLsizei)count, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_vec3(GLuint program, char* name, size_t count, float* vals)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, count*3*sizeof(float), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform3fv(loc, (GLsizei)count, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_vec2(GLuint program, char* name, size_t count, float* vals)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, count*2*sizeof(float), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform2fv(loc, (GLsizei)count, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_vec2(GLuint program, char* name, float x, float y)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
-        glUniform2f(loc, x, y);
-    }
-    use_program(last_program);
-    return ok;
+    float vals[] = { x, y };
+    return set_uniform_vec2(program, name, 1, vals);
 }
 
 bool
 set_uniform_vec2i(GLuint program, char* name, size_t count, i32* vals)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, count*2*sizeof(i32), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform2iv(loc, (GLsizei)count, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_f(GLuint program, char* name, float val)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, &val, sizeof(val), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform1f(loc, val);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_i(GLuint program, char* name, i32 val)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, &val, sizeof(val), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniform1i(loc, val);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 bool
 set_uniform_vec2i(GLuint program, char* name, i32 x, i32 y)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
-        glUniform2i(loc, x, y);
-    }
-    use_program(last_program);
-    return ok;
+    i32 vals[] = { x, y };
+    return set_uniform_vec2i(program, name, 1, vals);
 }
 
 bool
 set_uniform_mat2 (GLuint program, char* name, f32* vals)
 {
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    use_program(program);
-    bool ok = true;
-    GLint loc = glGetUniformLocation(program, (GLchar*)name);
-    ok = loc >= 0;
-    if ( ok ) {
+    bool upload;
+    GLint loc = prepare_uniform(program, name, vals, 4*sizeof(f32), &upload);
+    if ( loc >= 0 && upload ) {
+        GLuint last_program = g_current_program;
+        use_program(program);
         glUniformMatrix2fv(loc, 1, /*transpose*/false, vals);
+        use_program(last_program);
     }
-    use_program(last_program);
-    return ok;
+    return loc >= 0;
 }
 
 
@@ -613,9 +865,9 @@ resize_depth_stencil_texture(GLuint t, int w, int h)
 void
 vertex_attrib_v3f(GLuint program, char* name, GLuint vbo)
 {
-    GLint loc = glGetAttribLocation(program, name);
+    GLint loc = attrib_location(program, name);
     if (loc >= 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        bind_buffer(GL_ARRAY_BUFFER, vbo);
         glEnableVertexAttribArray((GLuint)loc);
         glVertexAttribPointer(/*attrib location*/ (GLuint)loc,
                               /*size*/ 3, GL_FLOAT, /*normalize*/ GL_FALSE,
@@ -623,12 +875,37 @@ vertex_attrib_v3f(GLuint program, char* name, GLuint vbo)
     }
 }
 
+void
+vertex_attrib(GLuint program, char* name, GLuint vbo, GLint size, GLenum type, GLsizei stride, i64 offset, GLuint divisor)
+{
+    GLint loc = attrib_location(program, name);
+    if (loc >= 0) {
+        bind_buffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray((GLuint)loc);
+        glVertexAttribPointer(/*attrib location*/ (GLuint)loc,
+                              size, type, /*normalize*/ GL_FALSE,
+                              stride, /*ptr*/ (GLvoid*)offset);
+        if ( check_flags(GLHelperFlags_INSTANCING) ) {
+            glVertexAttribDivisor((GLuint)loc, divisor);
+        }
+    }
+}
+
+void
+vertex_attrib_divisor(GLuint program, char* name, GLuint divisor)
+{
+    GLint loc = attrib_location(program, name);
+    if ( loc >= 0 && check_flags(GLHelperFlags_INSTANCING) ) {
+        glVertexAttribDivisor((GLuint)loc, divisor);
+    }
+}
+
 void
 vertex_attrib_v2f(GLuint program, char* name, GLuint vbo)
 {
-    GLint loc = glGetAttribLocation(program, name);
+    GLint loc = attrib_location(program, name);
     if (loc >= 0) {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        bind_buffer(GL_ARRAY_BUFFER, vbo);
         glEnableVertexAttribArray((GLuint)loc);
         glVertexAttribPointer(/*attrib location*/ (GLuint)loc,
                               /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
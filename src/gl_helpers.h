@@ -24,6 +24,10 @@ enum GLHelperFlags
 {
     GLHelperFlags_SAMPLE_SHADING        = 1<<0,
     GLHelperFlags_TEXTURE_MULTISAMPLE   = 1<<1,
+    GLHelperFlags_INSTANCING            = 1<<2,  // glDrawArraysInstanced and glVertexAttribDivisor, core or ARB.
+    GLHelperFlags_TEXTURE_BUFFER        = 1<<3,  // glTexBuffer and glMultiDrawArrays. Core in GL 3.1.
+    GLHelperFlags_GLSL_330              = 1<<4,  // #version 330 shaders compile, even in a GL 2.1 context.
+    GLHelperFlags_TIMER_QUERY           = 1<<5,  // GL_TIME_ELAPSED queries. Core in GL 3.3.
 };
 
 namespace gl {
@@ -33,8 +37,25 @@ bool    check_flags (int flags);
 bool    load ();
 void    log (char* str);
 GLuint  compile_shader (const char* src, GLuint type, char* config = "", char* variation_config = "");
+// Compiles as #version 330 regardless of USE_GL_3_2. Requires GLHelperFlags_GLSL_330.
+GLuint  compile_shader_glsl_330 (const char* src, GLuint type, char* config = "", char* variation_config = "");
+// Also resolves the locations of the program's active uniforms and
+// attributes, so that the functions below do not query them by name.
 void    link_program (GLuint obj, GLuint shaders[], int64_t num_shaders);
+GLint   uniform_location (GLuint program, char* name);
+GLint   attrib_location (GLuint program, char* name);
+
+// Skip the GL call when the state is already set. Code that calls
+// glUseProgram or binds GL_ARRAY_BUFFER directly must restore the binding.
 void    use_program(GLuint program);
+void    bind_buffer (GLenum target, GLuint buffer);
+void    delete_buffers (GLsizei n, GLuint* buffers);
+
+// Points the program's uniform block `name` at a GL_UNIFORM_BUFFER binding.
+bool    bind_uniform_block (GLuint program, char* name, GLuint binding);
+
+// Uniform values are remembered per program. Setting a value that the
+// uniform already holds does nothing.
 
 
 bool    set_attribute_vec2 (GLuint program, char* name, GLfloat* data, size_t data_sz);
@@ -50,7 +71,13 @@ bool    set_uniform_i (GLuint program, char* name, i32 val);
 bool    set_uniform_vec2i (GLuint program, char* name, i32 x, i32 y);
 bool    set_uniform_mat2 (GLuint program, char* name, f32* vals);
 
-void    vertex_attrib_v3f(GLuint program, char* name);
+void    vertex_attrib_v3f(GLuint program, char* name, GLuint vbo);
+// Integer types are converted to float, not normalized. `offset` is in bytes.
+// A non-zero divisor requires GLHelperFlags_INSTANCING. Attributes with a
+// divisor should be set back to 0 after drawing: other programs may use
+// the same location.
+void    vertex_attrib(GLuint program, char* name, GLuint vbo, GLint size, GLenum type, GLsizei stride, i64 offset, GLuint divisor = 0);
+void    vertex_attrib_divisor(GLuint program, char* name, GLuint divisor);
 
 GLuint  new_color_texture (int w, int h);
 GLuint  new_depth_stencil_texture (int w, int h);
@@ -5,6 +5,7 @@
 #include "gui.h"
 
 #include "localization.h"
+#include "buffer_pool.h"
 #include "color.h"
 #include "renderer.h"
 #include "milton.h"
@@ -55,7 +56,7 @@ gui_layer_window(MiltonInput* input, PlatformState* platform, Milton* milton, f3
         if (ImGui::SliderInt(loc(TXT_rotation), &angle, 0.0f, 360)) {
             milton->view->angle = (f32)angle / 180.0f * PI;
             input->flags |= (i32)MiltonInputFlags_PANNING;
-            gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+            gpu_update_canvas(milton->renderer, milton->view);
         }
 
         CanvasView* view = milton->view;
@@ -621,7 +622,7 @@ gui_menu(MiltonInput* input, PlatformState* platform, Milton* milton, b32& show_
                         &milton->view->pan_center,
                         &milton->view->scale,
                         &milton->view->angle);
-                    gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+                    gpu_update_canvas(milton->renderer, milton->view);
                 }
 
                 if ( ImGui::MenuItem(loc(TXT_reset_GUI)) ) {
@@ -815,6 +816,11 @@ milton_imgui_tick(MiltonInput* input, PlatformState* platform,  Milton* milton,
                     milton->settings->peek_out_increment = (peek_out_percent / 100.0f) * peek_range;
                 }
 
+                bool dynamic_resolution = milton->settings->dynamic_resolution != 0;
+                if ( ImGui::Checkbox(loc(TXT_dynamic_resolution), &dynamic_resolution) ) {
+                    milton->settings->dynamic_resolution = dynamic_resolution;
+                }
+
                 ImGui::Separator();
 
                 MiltonBindings* bs = &milton->settings->bindings;
@@ -1002,6 +1008,69 @@ milton_imgui_tick(MiltonInput* input, PlatformState* platform,  Milton* milton,
                      gpu_get_num_clipped_strokes(milton->canvas->root_layer));
             ImGui::Text(msg);
 
+            snprintf(msg, array_count(msg),
+                     "Stroke draw calls: %d\n",
+                     gpu_get_num_stroke_draw_calls(milton->renderer));
+            ImGui::Text(msg);
+
+            snprintf(msg, array_count(msg),
+                     "Frames for the last progressive redraw: %d\n",
+                     gpu_get_progressive_redraw_frames(milton->renderer));
+            ImGui::Text(msg);
+
+            // Results go to the log.
+            if ( ImGui::Button("Pan benchmark") ) {
+                milton_start_pan_benchmark(milton);
+            }
+
+            if ( ImGui::CollapsingHeader("Layer memory") ) {
+                for ( Layer* l = milton->canvas->root_layer; l != NULL; l = l->next ) {
+                    snprintf(msg, array_count(msg),
+                             "%s: %.1f KB, %d strokes\n",
+                             l->name,
+                             layer::layer_memory_bytes(l) / 1024.0,
+                             (int)l->strokes.count);
+                    ImGui::Text(msg);
+                }
+            }
+
+            if ( ImGui::CollapsingHeader("GPU stroke pool") ) {
+                BufferPoolStats stats = {};
+                gpu_get_buffer_pool_stats(milton->renderer, &stats);
+                snprintf(msg, array_count(msg),
+                         "%d pages, %d allocations\n"
+                         "Occupancy: %.1f%% (%.1f / %.1f MB)\n"
+                         "Fragmentation: %.1f%% (%d free ranges, largest %.1f KB)\n"
+                         "Compactions: %d (%.1f MB moved)\n",
+                         (int)stats.num_pages, (int)stats.num_allocations,
+                         100.0f * stats.occupancy,
+                         stats.used_bytes / (1024.0 * 1024.0),
+                         stats.capacity_bytes / (1024.0 * 1024.0),
+                         100.0f * stats.fragmentation,
+                         (int)stats.num_free_ranges,
+                         stats.largest_free_range / 1024.0,
+                         (int)stats.num_compactions,
+                         stats.bytes_moved / (1024.0 * 1024.0));
+                ImGui::Text(msg);
+
+                StrokeMemoryStats mem = {};
+                gpu_get_stroke_memory_stats(milton->renderer, &mem);
+                snprintf(msg, array_count(msg),
+                         "Resident: %.1f / %.1f MB\n"
+                         "Evictions: %d this frame, %d total\n"
+                         "Re-cooks: %d this frame, %d total\n",
+                         mem.resident_bytes / (1024.0 * 1024.0),
+                         mem.budget_bytes / (1024.0 * 1024.0),
+                         (int)mem.evictions_last_clip, (int)mem.evictions,
+                         (int)mem.recooks_last_clip, (int)mem.recooks);
+                ImGui::Text(msg);
+
+                int budget_mb = (int)(mem.budget_bytes / (1024 * 1024));
+                if ( ImGui::SliderInt("Budget (MB)", &budget_mb, 16, 2048) ) {
+                    gpu_set_stroke_budget(milton->renderer, (i64)budget_mb * 1024 * 1024);
+                }
+            }
+
             float hist[] = { poll, update, raster, GL, system };
             ImGui::PlotHistogram("Graph",
                             (const float*)hist, array_count(hist));
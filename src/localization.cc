@@ -117,6 +117,7 @@ init_localization()
         EN(TXT_size_relative_to_canvas, "Size relative to canvas");
         EN(TXT_grid_columns, "Grid Columns");
         EN(TXT_grid_rows, "Grid Rows");
+        EN(TXT_dynamic_resolution, "Lower resolution while zooming and rotating");
 
         EN(TXT_Action_DECREASE_BRUSH_SIZE, "Decrease brush size");
         EN(TXT_Action_INCREASE_BRUSH_SIZE, "Increase brush size");
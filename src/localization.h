@@ -100,6 +100,7 @@ enum Texts
     TXT_size_relative_to_canvas,
     TXT_grid_columns,
     TXT_grid_rows,
+    TXT_dynamic_resolution,
 
     // Actions
     TXT_Action_FIRST,
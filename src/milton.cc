@@ -11,6 +11,7 @@
 #include "localization.h"
 #include "persist.h"
 #include "platform.h"
+#include "render_common.h"
 #include "vector.h"
 #include "bindings.h"
 
@@ -210,6 +211,7 @@ clear_stroke_redo(Milton* milton)
 {
     while ( milton->canvas->stroke_graveyard.count > 0 ) {
         Stroke s = pop(&milton->canvas->stroke_graveyard);
+        gpu_free_strokes(&s.render_handle, 1, milton->renderer);
     }
     for ( i64 i = 0; i < milton->canvas->redo_stack.count; ++i ) {
         HistoryElement h = milton->canvas->redo_stack.data[i];
@@ -241,6 +243,8 @@ milton_primitive_line_input(Milton* milton, MiltonInput const* input, b32 end_st
         }
         else if ( milton->primitive_fsm == Primitive_DRAWING ) {
             milton->working_stroke.points[1] = point;
+            // Points moved rather than being appended. Upload the whole stroke again.
+            gpu_reset_stroke(milton->renderer, ws->render_handle);
         }
     }
 }
@@ -273,6 +277,8 @@ milton_primitive_rectangle_input(Milton* milton, MiltonInput const* input, b32 e
             ws->points[2] = point;
             ws->points[3] = raster_to_canvas(milton->view, { p0.x, p2.y });
             ws->points[4] = ws->points[0];
+            // Points moved rather than being appended. Upload the whole stroke again.
+            gpu_reset_stroke(milton->renderer, ws->render_handle);
         }
     }
 }
@@ -337,6 +343,8 @@ milton_primitive_grid_input(Milton* milton, MiltonInput const* input, b32 end_st
                 current_point.y = y_sign == 1 ? p2.y - (rh * (i+1)) : p0.y + (rh * (i+1));
                 ws->points[index++] = raster_to_canvas(milton->view, current_point);
             }
+            // Points moved rather than being appended. Upload the whole stroke again.
+            gpu_reset_stroke(milton->renderer, ws->render_handle);
         }
     }
 }
@@ -474,7 +482,7 @@ milton_set_zoom_at_point_with_scale(Milton* milton, v2i new_zoom_center, i64 sca
 {
     milton->view->pan_center = raster_to_canvas_with_scale(milton->view, v2i_to_v2l(new_zoom_center), scale);
     milton->view->zoom_center = new_zoom_center;
-    gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+    gpu_update_canvas(milton->renderer, milton->view);
 }
 
 void
@@ -613,6 +621,7 @@ settings_init(MiltonSettings* s)
 {
     s->background_color = v3f{1,1,1};
     s->peek_out_increment = DEFAULT_PEEK_OUT_INCREMENT_LOG;
+    s->dynamic_resolution = true;
 }
 
 int milton_save_thread(void* state_);  // forward
@@ -658,6 +667,7 @@ milton_init(Milton* milton, i32 width, i32 height, f32 ui_scale, PATH_CHAR* file
     milton->transform = arena_alloc_elem(&milton->root_arena, TransformMode);
 
     milton->persist->target_MB_per_sec = 0.2f;
+    milton->dynamic_resolution.divisor = 1;
 
     gui_init(&milton->root_arena, milton->gui, ui_scale);
     settings_init(milton->settings);
@@ -765,7 +775,7 @@ upload_gui(Milton* milton)
 {
     if (milton->gl)
     {
-        gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+        gpu_update_canvas(milton->renderer, milton->view);
         gpu_resize(milton->renderer, milton->view);
         gpu_update_picker(milton->renderer, &milton->gui->picker);
     }
@@ -812,6 +822,11 @@ milton_reset_canvas(Milton* milton)
     milton->persist->mlt_binary_version = MILTON_MINOR_VERSION;
     milton->persist->last_save_time = {};
 
+    // Release layer data that does not live in the canvas arena.
+    for ( Layer* l = canvas->root_layer; l != NULL; l = l->next ) {
+        stroke_index_release(&l->stroke_index);
+    }
+
     // Clear history
     release(&canvas->history);
     release(&canvas->redo_stack);
@@ -1027,7 +1042,6 @@ milton_new_layer_with_id(Milton* milton, i32 new_id)
         layer->flags = LayerFlags_VISIBLE;
         layer->strokes.arena = &canvas->arena;
         layer->alpha = 1.0f;
-        strokelist_init_bucket(&layer->strokes.root);
     }
     snprintf(layer->name, MAX_LAYER_NAME_LEN, "Layer %d", layer->id);
 
@@ -1061,6 +1075,9 @@ milton_delete_working_layer(Milton* milton)
         if (layer->next) wl = layer->next;
         else wl = layer->prev;
         milton_set_working_layer(milton, wl);
+
+        gpu_free_strokes(milton->renderer, layer);
+        stroke_index_release(&layer->stroke_index);
     }
     if ( layer == milton->canvas->root_layer ) {
         milton->canvas->root_layer = milton->canvas->working_layer;
@@ -1181,6 +1198,10 @@ peek_out_trigger_start(Milton* milton, int peek_out_flags)
     milton->peek_out->begin_anim_time = platform_get_walltime();
     milton->peek_out->flags = peek_out_flags;
 
+    // The animation is drawn from the current frame and, once it is
+    // rendered over the next frames, from the zoomed-out view.
+    gpu_snapshot_begin(milton, milton->peek_out->high_scale);
+
     if (milton->current_mode != MiltonMode::PEEK_OUT) {
         milton_enter_mode(milton, MiltonMode::PEEK_OUT);
     }
@@ -1223,7 +1244,7 @@ peek_out_tick(Milton* milton, MiltonInput const* input)
 
             milton->view->pan_center = pan;
             milton->view->zoom_center = milton->view->screen_size / 2;
-            gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+            gpu_update_canvas(milton->renderer, milton->view);
 
             if ( difference_in_ms(peek->begin_anim_time, platform_get_walltime()) > peek_out_duration_ms(milton) ) {
                 milton_leave_mode(milton);
@@ -1251,6 +1272,94 @@ peek_out_tick(Milton* milton, MiltonInput const* input)
     }
 }
 
+#if MILTON_ENABLE_PROFILING
+void
+milton_start_pan_benchmark(Milton* milton)
+{
+    PanBenchmark* bench = &milton->pan_benchmark;
+    *bench = {};
+    bench->frames_left = PAN_BENCHMARK_CROSSINGS * PAN_BENCHMARK_FRAMES_PER_CROSSING;
+    bench->start_pan = milton->view->pan_center;
+}
+
+static void
+pan_benchmark_times_add(PanBenchmarkTimes* times, f32 ms)
+{
+    times->num_frames += 1;
+    times->sum_ms += ms;
+    times->max_ms = max(times->max_ms, ms);
+}
+
+// First coordinate above x where x / chunk_size changes, the way the render
+// center is computed.
+static i64
+pan_benchmark_next_boundary(i64 x, i64 chunk_size)
+{
+    i64 chunk = x / chunk_size;
+    i64 boundary = (chunk + 1) * chunk_size;
+    if ( chunk < 0 ) {
+        // Division truncates towards zero, so chunk -1 ends at -chunk_size + 1.
+        boundary = chunk * chunk_size + 1;
+    }
+    return boundary;
+}
+
+static void
+pan_benchmark_tick(Milton* milton)
+{
+    PanBenchmark* bench = &milton->pan_benchmark;
+    if ( bench->frames_left == 0 ) {
+        return;
+    }
+
+    // A frame is timed from one tick to the next, so it includes rendering
+    // and the buffer swap.
+    u64 now = perf_counter();
+    if ( bench->last_tick != 0 && !bench->jumped ) {
+        f32 ms = perf_count_to_sec(now - bench->last_tick) * 1000.0f;
+        pan_benchmark_times_add(bench->crossed_chunk ? &bench->crossing : &bench->steady, ms);
+    }
+    bench->last_tick = now;
+    bench->frames_left -= 1;
+
+    if ( bench->frames_left > 0 ) {
+        i64 chunk_size = (i64)1 << RENDER_CHUNK_SIZE_LOG2;
+        // Whole pixels, so that the canvas can be moved instead of redrawn.
+        i64 step = PAN_BENCHMARK_STEP_PIXELS * milton->view->scale;
+
+        i64 old_x = milton->view->pan_center.x;
+        bench->jumped = bench->frames_left % PAN_BENCHMARK_FRAMES_PER_CROSSING == PAN_BENCHMARK_FRAMES_PER_CROSSING - 1;
+        if ( bench->jumped ) {
+            // The render center changes on step PAN_BENCHMARK_FRAMES_PER_CROSSING / 2
+            i64 boundary = pan_benchmark_next_boundary(old_x, chunk_size);
+            milton->view->pan_center.x = boundary - (PAN_BENCHMARK_FRAMES_PER_CROSSING / 2) * step;
+            bench->crossed_chunk = false;
+        }
+        else {
+            milton->view->pan_center.x += step;
+            bench->crossed_chunk = old_x / chunk_size != milton->view->pan_center.x / chunk_size;
+        }
+
+        milton->render_settings.flags |= MiltonRenderFlags_PAN_COPY;
+        if ( milton->platform ) {
+            milton->platform->force_next_frame = true;
+        }
+    }
+    else {
+        milton->view->pan_center = bench->start_pan;
+        milton->render_settings.do_full_redraw = true;
+
+        PanBenchmarkTimes* c = &bench->crossing;
+        PanBenchmarkTimes* s = &bench->steady;
+        milton_log("Pan benchmark. Crossing a chunk: %d frames, %f ms avg, %f ms worst. "
+                   "Other frames: %d frames, %f ms avg, %f ms worst.\n",
+                   c->num_frames, c->num_frames ? c->sum_ms / c->num_frames : 0.0f, c->max_ms,
+                   s->num_frames, s->num_frames ? s->sum_ms / s->num_frames : 0.0f, s->max_ms);
+    }
+    gpu_update_canvas(milton->renderer, milton->view);
+}
+#endif
+
 void
 drag_brush_size_start(Milton* milton, v2i pointer)
 {
@@ -1330,7 +1439,7 @@ transform_tick(Milton* milton, MiltonInput const* input)
                 const f32 sign = orientation(center, t->last_point, point) > 0 ? -1.0f : 1.0f;
                 milton->view->angle += sign * acosf(cos_angle);
                 t->last_point = point;
-                gpu_update_canvas(milton->renderer, milton->canvas, milton->view);
+                gpu_update_canvas(milton->renderer, milton->view);
             }
         }
     }
@@ -1341,6 +1450,45 @@ transform_tick(Milton* milton, MiltonInput const* input)
     }
 }
 
+// Resolution divisor for this frame. Frames that zoom, rotate or peek out
+// change the render scale or the angle. See DynamicResolution
+static i32
+dynamic_resolution_divisor(Milton* milton)
+{
+    DynamicResolution* dr = &milton->dynamic_resolution;
+
+    i64 scale = milton_render_scale(milton);
+    f32 angle = milton->view->angle;
+    dr->view_changed = scale != dr->last_scale || angle != dr->last_angle;
+    dr->last_scale = scale;
+    dr->last_angle = angle;
+
+    if ( !dr->view_changed || !milton->settings->dynamic_resolution ) {
+        dr->last_frame = 0;
+        return 1;
+    }
+
+    // The interval between two frames includes rendering and the buffer swap
+    // of the first one. Anything over one and a half targets missed a vsync.
+    u64 now = perf_counter();
+    if ( dr->last_frame != 0 ) {
+        f32 ms = perf_count_to_sec(now - dr->last_frame) * 1000.0f;
+        if ( ms <= DYNAMIC_RESOLUTION_MAX_INTERVAL_MS ) {
+            if ( ms > 1.5f * DYNAMIC_RESOLUTION_TARGET_MS ) {
+                dr->divisor = min(dr->divisor + 1, DYNAMIC_RESOLUTION_MAX_DIVISOR);
+                dr->fast_frames = 0;
+            }
+            else if ( ++dr->fast_frames >= DYNAMIC_RESOLUTION_FAST_FRAMES ) {
+                dr->divisor = max(dr->divisor - 1, 1);
+                dr->fast_frames = 0;
+            }
+        }
+    }
+    dr->last_frame = now;
+
+    return dr->divisor;
+}
+
 void
 milton_update_and_render(Milton* milton, MiltonInput const* input)
 {
@@ -1353,6 +1501,7 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
     milton->flags &= ~MiltonStateFlags_FINISH_CURRENT_STROKE;
 
     milton->render_settings.do_full_redraw = false;
+    milton->render_settings.flags = MiltonRenderFlags_NONE;
 
     b32 brush_outline_should_draw = false;
     int render_flags = RenderBackendFlags_NONE;
@@ -1420,10 +1569,14 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
         // If we are *not* zooming and we are panning, we can copy most of the
         // framebuffer
         if ( !(input->pan_delta == v2l{}) ) {
-            milton->render_settings.do_full_redraw = true;
+            milton->render_settings.flags |= MiltonRenderFlags_PAN_COPY;
         }
     }
 
+#if MILTON_ENABLE_PROFILING
+    pan_benchmark_tick(milton);
+#endif
+
     if ( input->mode_to_set != milton->current_mode
          && mode_is_for_drawing(input->mode_to_set)) {
         end_stroke = true;
@@ -1439,7 +1592,7 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
                 if ( l ) {
                     if ( l->strokes.count > 0 ) {
                         Stroke* stroke_ptr = peek(&l->strokes);
-                        Stroke stroke = pop(&l->strokes);
+                        Stroke stroke = layer::layer_pop_stroke(l);
                         push(&milton->canvas->stroke_graveyard, stroke);
                         push(&milton->canvas->redo_stack, h);
 
@@ -1458,7 +1611,7 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
                     if ( l && count(&milton->canvas->stroke_graveyard) > 0 ) {
                         Stroke stroke = pop(&milton->canvas->stroke_graveyard);
                         if ( stroke.layer_id == h.layer_id ) {
-                            push(&l->strokes, stroke);
+                            layer::layer_push_stroke(l, stroke);
                             push(&milton->canvas->history, h);
 
                             milton->render_settings.do_full_redraw = true;
@@ -1466,7 +1619,9 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
                             break;
                         }
 
+                        gpu_free_strokes(&stroke.render_handle, 1, milton->renderer);
                         stroke = pop(&milton->canvas->stroke_graveyard);  // Keep popping in case the graveyard has info from deleted layers
+                        gpu_free_strokes(&stroke.render_handle, 1, milton->renderer);
                     }
 
                 } break;
@@ -1818,9 +1973,8 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
 
     b32 has_working_stroke = milton->working_stroke.num_points > 0;
 
-    if (has_working_stroke) {
-        b32 has_blur = false;
-
+    b32 has_blur = false;
+    {
         Layer* layer = milton->canvas->root_layer;
         while (layer) {
             if (layer->flags & LayerFlags_VISIBLE) {
@@ -1836,21 +1990,78 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
             if (has_blur) { break; }
             layer = layer->next;
         }
+    }
 
-        if (has_blur) {
-            milton->render_settings.do_full_redraw = true;
-        }
+    if ( has_working_stroke && has_blur
+         && !gpu_effects_are_cached(milton->renderer, milton->canvas->root_layer,
+                                    milton->working_stroke.layer_id) ) {
+        milton->render_settings.do_full_redraw = true;
     }
 
     static u64 scale_of_last_full_redraw = 0;
     static f32 angle_of_last_full_redraw = 0.0f;
 
+    static v2l pan_center_of_last_frame = {};
+    b32 panned = !(milton->view->pan_center == pan_center_of_last_frame);
+    pan_center_of_last_frame = milton->view->pan_center;
+
     if (scale_of_last_full_redraw != milton_render_scale(milton) ||
         angle_of_last_full_redraw != milton->view->angle ) {
         // We want to draw everything when we're scaling up and down.
         milton->render_settings.do_full_redraw = true;
     }
 
+    // Some strokes were left out of the last frame.
+    if ( gpu_has_pending_strokes(milton->renderer) ) {
+        milton->render_settings.do_full_redraw = true;
+    }
+
+    // The last full redraw did not fit in one frame.
+    if ( gpu_has_pending_redraw(milton->renderer) ) {
+        milton->render_settings.do_full_redraw = true;
+    }
+
+    // The peek-out animation is drawn from snapshots, which is cheap enough
+    // to do in full every frame. Strokes are drawn again once it is over.
+    if ( gpu_snapshot_active(milton->renderer) ) {
+        milton->render_settings.do_full_redraw = true;
+        if ( milton->current_mode != MiltonMode::PEEK_OUT ) {
+            gpu_snapshot_end(milton->renderer);
+        }
+    }
+    b32 use_snapshot = gpu_snapshot_active(milton->renderer);
+
+    {
+        i32 divisor = dynamic_resolution_divisor(milton);
+        if ( use_snapshot ) {
+            divisor = 1;
+        }
+        if ( divisor > 1 || divisor != gpu_get_resolution_divisor(milton->renderer) ) {
+            // Reduced frames are redrawn in full, and so is the first frame
+            // back at full resolution.
+            milton->render_settings.do_full_redraw = true;
+        }
+        if ( divisor > 1 && milton->platform ) {
+            // Refine once the view settles, even if no input comes.
+            milton->platform->force_next_frame = true;
+        }
+        gpu_set_resolution_divisor(milton->renderer, divisor);
+    }
+
+    // Move what is already on the canvas and draw only the strips that came
+    // into view. Blur spreads pixels across the edges of the strips, so
+    // blurred canvases are redrawn in full.
+    Rect pan_strips[2];
+    i32 num_pan_strips = 0;
+    if ( (milton->render_settings.flags & MiltonRenderFlags_PAN_COPY)
+         && !milton->render_settings.do_full_redraw ) {
+        if (    has_working_stroke
+             || has_blur
+             || !gpu_pan_copy(milton->renderer, pan_strips, &num_pan_strips) ) {
+            milton->render_settings.do_full_redraw = true;
+        }
+    }
+
     // Note: We flip the rectangles. GL is bottom-left by default.
     if ( milton->render_settings.do_full_redraw ) {
         view_width = milton->view->screen_size.w;
@@ -1859,6 +2070,12 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
         // that the size of the screen will be used to determine if each stroke
         // should be freed from GPU memory.
         clip_flags = ClipFlags_UPDATE_GPU_DATA;
+        // Frames that move the view or draw have to show it right away. A
+        // pan that gpu_pan_copy could not handle lands here too, and a
+        // progressive redraw would restart on every one of its frames.
+        if ( !has_working_stroke && !panned && !milton->dynamic_resolution.view_changed ) {
+            clip_flags = (ClipFlags)(clip_flags | ClipFlags_PROGRESSIVE);
+        }
         scale_of_last_full_redraw = milton_render_scale(milton);
         angle_of_last_full_redraw = milton->view->angle;
     }
@@ -1871,17 +2088,53 @@ milton_update_and_render(Milton* milton, MiltonInput const* input)
         view_width  = bounds.right - bounds.left;
         view_height = bounds.bottom - bounds.top;
     }
+    else if ( num_pan_strips > 0 ) {
+        Rect strip = pan_strips[num_pan_strips - 1];
+
+        view_x      = (i32)strip.left;
+        view_y      = (i32)strip.top;
+        view_width  = (i32)(strip.right - strip.left);
+        view_height = (i32)(strip.bottom - strip.top);
+    }
 
     PROFILE_GRAPH_BEGIN(clipping);
 
     i64 render_scale = milton_render_scale(milton);
 
-    gpu_clip_strokes_and_update(&milton->root_arena, milton->renderer, milton->view, render_scale,
-                                milton->canvas->root_layer, &milton->working_stroke,
-                                view_x, view_y, view_width, view_height, clip_flags);
+    // Diagonal pans expose two strips. The first one is drawn here. It cooks
+    // everything it needs, because only the last clip of a frame can leave
+    // strokes for later.
+    for ( i32 si = 0; si < num_pan_strips - 1; ++si ) {
+        Rect strip = pan_strips[si];
+        i32 sx = (i32)strip.left;
+        i32 sy = (i32)strip.top;
+        i32 sw = (i32)(strip.right - strip.left);
+        i32 sh = (i32)(strip.bottom - strip.top);
+        gpu_clip_strokes_and_update(&milton->root_arena, milton->renderer, milton->view, render_scale,
+                                    milton->canvas->root_layer, &milton->working_stroke,
+                                    sx, sy, sw, sh, ClipFlags_COOK_ALL);
+        gpu_render_canvas(milton->renderer, sx, sy, sw, sh);
+    }
+
+    if ( use_snapshot ) {
+        gpu_snapshot_update(milton);
+    }
+    else {
+        gpu_clip_strokes_and_update(&milton->root_arena, milton->renderer, milton->view, render_scale,
+                                    milton->canvas->root_layer, &milton->working_stroke,
+                                    view_x, view_y, view_width, view_height, clip_flags);
+    }
     PROFILE_GRAPH_END(clipping);
 
+    if ( gpu_has_pending_strokes(milton->renderer) && milton->platform ) {
+        milton->platform->force_next_frame = true;
+    }
+
     gpu_render(milton->renderer, view_x, view_y, view_width, view_height);
 
+    if ( gpu_has_pending_redraw(milton->renderer) && milton->platform ) {
+        milton->platform->force_next_frame = true;
+    }
+
     ARENA_VALIDATE(&milton->root_arena);
 }
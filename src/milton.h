@@ -104,6 +104,9 @@ struct MiltonSettings
     float peek_out_increment;
 
     MiltonBindings bindings;
+
+    // Fields are only appended, so that older settings files still load.
+    b32 dynamic_resolution;     // Zoom, rotate and peek out at reduced resolution when frames are slow.
 };
 #pragma pack(pop)
 
@@ -141,6 +144,55 @@ struct PeekOut
 struct RenderSettings
 {
     b32 do_full_redraw;
+    int flags /*MiltonRenderFlags*/;
+};
+
+#if MILTON_ENABLE_PROFILING
+// Pans across a few render chunk boundaries in small steps and logs the
+// frame times. Each crossing starts with a jump to half its frames before
+// the next boundary. Started from the debug window.
+#define PAN_BENCHMARK_CROSSINGS             4
+#define PAN_BENCHMARK_FRAMES_PER_CROSSING   16
+#define PAN_BENCHMARK_STEP_PIXELS           8
+
+struct PanBenchmarkTimes
+{
+    i32 num_frames;
+    f32 sum_ms;
+    f32 max_ms;
+};
+
+struct PanBenchmark
+{
+    i32 frames_left;    // 0 when not running.
+    v2l start_pan;
+    u64 last_tick;
+    b32 crossed_chunk;  // The last step moved the render center.
+    b32 jumped;         // The last step went to a new boundary. Its frame is a full redraw and is not timed.
+
+    PanBenchmarkTimes crossing;
+    PanBenchmarkTimes steady;
+};
+#endif
+
+// While the view zooms or rotates, the canvas is drawn at 1/divisor of the
+// screen resolution. The divisor goes up when frames take longer than the
+// target and comes back down after a run of fast frames. Once the view stops
+// changing, there is one more frame at full resolution.
+#define DYNAMIC_RESOLUTION_TARGET_MS        16.7f
+#define DYNAMIC_RESOLUTION_MAX_DIVISOR      4
+#define DYNAMIC_RESOLUTION_FAST_FRAMES      30
+// Longer gaps between frames are waits for input, not slow frames.
+#define DYNAMIC_RESOLUTION_MAX_INTERVAL_MS  250.0f
+
+struct DynamicResolution
+{
+    i32 divisor;            // For the next frame that changes the view.
+    i32 fast_frames;
+    u64 last_frame;         // perf_counter at the last frame that changed the view. 0 if the frame before did not.
+    i64 last_scale;
+    f32 last_angle;
+    b32 view_changed;       // The current frame zooms, rotates or peeks out.
 };
 
 struct MiltonDragBrush
@@ -210,6 +262,7 @@ struct Milton
 
     RenderSettings render_settings;
     RenderBackend* renderer;
+    DynamicResolution dynamic_resolution;
 
     // Heap
     Arena       root_arena;     // Lives forever
@@ -231,6 +284,7 @@ struct Milton
 #if MILTON_ENABLE_PROFILING
     b32 viz_window_visible;
     GraphData graph_frame;
+    PanBenchmark pan_benchmark;
 #endif
 };
 
@@ -360,3 +414,7 @@ void transform_stop(Milton* milton);
 
 void drag_brush_size_start(Milton* milton, v2i pointer);
 void drag_brush_size_stop(Milton* milton);
+
+#if MILTON_ENABLE_PROFILING
+void milton_start_pan_benchmark(Milton* milton);
+#endif
@@ -70,6 +70,10 @@
     #endif
 
 
+// Cooked strokes that are off screen are freed, least recently visible first,
+// when the GPU holds more than this much stroke geometry.
+#define STROKE_GPU_BUDGET_MB 256
+
 // Spawn threads to save the canvas.
 #define MILTON_SAVE_ASYNC 1
 
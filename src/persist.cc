@@ -926,8 +926,10 @@ milton_settings_load(MiltonSettings* settings)
     if ( fd ) {
         u16 struct_size = 0;
         if ( fread(&struct_size, sizeof(u16), 1, fd) ) {
+            // Files from older versions are shorter. Their missing fields
+            // keep the values from settings_init.
             if (struct_size <= sizeof(*settings)) {
-                if ( fread(settings, sizeof(*settings), 1, fd) ) {
+                if ( fread(settings, struct_size, 1, fd) ) {
                     ok = true;
                 }
             }
@@ -6,33 +6,9 @@
 
 #include "common.h"
 
-#define RENDER_STACK_SIZE       (1 << 20)
-
-// Render Workers:
-//    We have a bunch of workers running on threads, who wait on a lockless
-//    queue to take BlockgroupRenderBackend structures.
-//    When there is work available, they call blockgroup_render_thread with the
-//    appropriate parameters.
-struct BlockgroupRenderBackend
-{
-    i32     block_start;
-};
-
-struct RenderStack
-{
-    Rect*   blocks;  // Screen areas to render.
-    i32     num_blocks;
-    u32*    canvas_buffer;
-
-    // LIFO work queue
-    SDL_mutex*              mutex;
-    BlockgroupRenderBackend    blockgroup_render_data[RENDER_STACK_SIZE];
-    i32                     index;
-
-    SDL_sem*   work_available;
-    SDL_sem*   completed_semaphore;
-};
-
+// The GPU works with 32 bit coordinates, relative to the nearest multiple of
+// this many canvas units.
+#define RENDER_CHUNK_SIZE_LOG2 28
 
 enum MiltonRenderFlags
 {
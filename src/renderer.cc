@@ -3,11 +3,14 @@
 
 #include "shaders.gen.h"
 
+#include "buffer_pool.h"
 #include "color.h"
 #include "gl_helpers.h"
 #include "gui.h"
 #include "milton.h"
+#include "render_common.h"
 #include "vector.h"
+#include "workers.h"
 
 #define MAX_DEPTH_VALUE (1<<20)     // Strokes have MAX_DEPTH_VALUE different z values. 1/i for each i in [1, MAX_DEPTH_VALUE)
                                     // Also defined in stroke_raster.v.glsl
@@ -17,7 +20,28 @@
                                     //  stroke with the same z value.
 
 
-#define RENDER_CHUNK_SIZE_LOG2 28
+// Margin around the damaged area for the FXAA pass. Larger than the
+// distance its edge search can reach.
+#define POSTPROC_DAMAGE_MARGIN  32
+
+// Soft strokes take a single pass when the segments that cover a pixel are at
+// most this many segments apart. See stroke_soft_window.
+#define STROKE_SOFT_MAX_WINDOW  32
+
+// Blur kernels wider than this, in taps, are computed at half resolution, as
+// many times over as it takes. See blur_layer.
+#define BLUR_MAX_KERNEL_SIZE    24
+#define BLUR_MAX_LEVELS         6
+
+// Full redraws that allow it draw this much per frame and go on in the next
+// frame. The budget is turned into segments with the drawing speed of past
+// slices, timed on the GPU when possible.
+// After PROGRESSIVE_REDRAW_MAX_FRAMES frames without a complete image, the
+// redraw is finished in one go. See gpu_render_canvas
+#define PROGRESSIVE_REDRAW_BUDGET_MS            8.0f
+#define PROGRESSIVE_REDRAW_MIN_SEGMENTS         4096
+#define PROGRESSIVE_REDRAW_SEGMENTS_PER_MS      20000.0f    // Until the first measurement.
+#define PROGRESSIVE_REDRAW_MAX_FRAMES           30
 
 
 enum ImmediateFlag
@@ -37,15 +61,25 @@ enum RenderElementFlags
 
 struct RenderElement
 {
-    GLuint  vbo_stroke;
-    GLuint  vbo_pointa;
-    GLuint  vbo_pointb;
-    GLuint  indices;
+    // Stroke geometry, sub-allocated from RenderBackend::stroke_pool. It holds
+    // `count` StrokeSegment, or 4 copies of each one without instancing.
+    PoolAllocation  alloc;
+    v2l             origin;     // Canvas point that segment points are relative to.
+    i32             z;          // See MAX_DEPTH_VALUE
 #if STROKE_DEBUG_VIZ
     GLuint vbo_debug;
 #endif
 
     i64     count;
+    i64     appendable_count;   // Working stroke: segments on the GPU that later updates can keep.
+
+    i32             slot;       // Entry in RenderBackend::stroke_table. 0 when it has none.
+    i32             soft_window;  // See stroke_soft_window. -1 when soft strokes take three passes.
+
+    // Links in RenderBackend's LRU list, while `alloc` holds data.
+    RenderElement*  lru_prev;
+    RenderElement*  lru_next;
+    i64             last_visible_clip;  // See RenderBackend::clip_count
 
     union {
         struct {  // For when element is a stroke.
@@ -63,6 +97,199 @@ struct RenderElement
     int     flags;  // RenderElementFlags enum;
 };
 
+// One segment of a cooked stroke. Segments are drawn as instances of the
+// quad in RenderBackend::vbo_stroke_corners, and stroke_raster.v.glsl places
+// each corner around the segment.
+struct StrokeSegment
+{
+    i32 pointa[2];      // Relative to RenderElement::origin
+    i32 pointb[2];
+    u16 pressures[2];   // 0 to 65535
+    u32 slot;           // RenderElement::slot, for batched draws.
+};
+static_assert(sizeof(StrokeSegment) == BUFFER_POOL_ALIGNMENT,
+              "Batched draws find segments by their index in a pool page.");
+
+// What batched draws need to know about a stroke that is not in its segments.
+// Read by stroke_raster.v.glsl as four RGBA32I texels.
+struct StrokeTableEntry
+{
+    i32 origin[2];  // RenderElement::origin, relative to the render center.
+    i32 radius;
+    i32 z;
+    f32 color[4];
+
+    // Soft strokes only. See stroke_soft.f.glsl
+    i32 first_segment;  // Index of the first segment in its pool page.
+    i32 num_segments;
+    i32 soft_window;
+    i32 padding;
+    f32 min_opacity;    // 1 without pressure to opacity.
+    f32 hardness;       // 0 without distance to opacity.
+    f32 padding2[2];
+};
+static_assert(sizeof(StrokeTableEntry) == 4*4*sizeof(i32), "Four RGBA32I texels per entry");
+
+// View state shared by every stroke program, as laid out by std140 in the
+// ViewBlock of common.glsl. Only used with uniform blocks (GL 3.2).
+struct ViewUniforms
+{
+    f32 rotation[8];            // mat2. Each column takes a vec4.
+    f32 rotation_inverse[8];
+    i32 pan_center[2];
+    f32 zoom_center[2];         // Not a whole pixel at reduced resolutions.
+    f32 screen_size[2];
+    i32 scale;
+    i32 padding;
+};
+static_assert(sizeof(ViewUniforms) == 96, "ViewUniforms has to match the std140 layout of ViewBlock");
+
+#define VIEW_BLOCK_BINDING 0
+
+static u16
+quantize_pressure(f32 pressure)
+{
+    f32 p = min(max(pressure, 0.0f), 1.0f);
+    u16 q = (u16)(p * 65535.0f + 0.5f);
+    return q;
+}
+
+// Visibility test for a run of strokes in a single bucket. Runs on a worker
+// thread, so it only reads the bucket's hot arrays.
+struct ClipJob
+{
+    Layer*          layer;
+    StrokeBucket*   bucket;
+    i64             offset;         // Position in the bucket of the first stroke.
+    i64             count;
+    i64             first_index;    // Position in the layer of the first stroke.
+    Rect            rect;
+
+    // Output: positions relative to `offset` of the strokes to draw.
+    i32*            visible;
+    i64             num_visible;
+};
+
+// Below this many strokes, waking up the workers costs more than it saves.
+#define CLIP_MIN_STROKES_FOR_WORKERS (2 * STROKELIST_BUCKET_COUNT)
+
+// A stroke whose pool space is allocated, waiting for its segments.
+struct CookItem
+{
+    Stroke*         stroke;
+    RenderElement*  re;
+    StrokeSegment*  segments;   // Output: copies * re->count segments.
+};
+
+// Segment generation for a run of CookItems. Runs on a worker thread. The
+// GL thread uploads the results.
+struct CookJob
+{
+    CookItem*   items;
+    i64         count;
+    i64         copies;
+};
+
+#define COOK_SEGMENTS_PER_JOB           4096
+#define COOK_MIN_SEGMENTS_FOR_WORKERS   (4 * COOK_SEGMENTS_PER_JOB)
+
+// Strokes that need cooking beyond this many segments in a single clip pass
+// are left for the next frames, so that zooming out does not stall.
+#define COOK_MAX_SEGMENTS_PER_CLIP      (256 * 1024)
+
+// Clip result for one visible layer, kept from frame to frame. While the clip
+// rect stays the same, only the strokes above the layer's clip_valid_count
+// need to be clipped again.
+struct ClipCacheLayer
+{
+    Layer*                  layer;
+    i32                     layer_id;
+    i64                     stroke_count;   // Strokes in the layer when the entry was last updated.
+
+    DArray<RenderElement*>  elements;       // Visible strokes, in paint order.
+    DArray<i64>             stroke_indices; // Position in the layer of each element.
+};
+
+// Two layers with equal keys look the same.
+struct LayerKey
+{
+    i32 id;
+    u64 generation;     // Layer::generation
+    f32 alpha;
+    u64 effects;        // Hash of the enabled effects and their settings.
+};
+
+// A visible layer in the last clip pass.
+struct ClipLayer
+{
+    LayerKey    key;
+    i64         first_element;  // Index in clip_array of its first stroke. Its layer element comes last.
+};
+
+// Everything outside of the layers that changes how they composite.
+struct CompositeView
+{
+    v2l pan_center;
+    v2i zoom_center;
+    i64 scale;
+    f32 angle;
+    i32 width;
+    i32 height;
+    v3f background_color;
+    f32 background_alpha;
+};
+
+// Composite of a run of consecutive visible layers, to skip drawing layers
+// that do not change while the user draws on another one. The texture is
+// screen-sized, so caches are only filled by full redraws.
+struct CompositeCache
+{
+    GLuint              texture;
+    b32                 valid;
+    CompositeView       view;
+    DArray<LayerKey>    keys;   // Bottom to top.
+};
+
+// A full redraw that is drawn in slices across frames. canvas_texture, the
+// layer texture and the depth buffer keep the partial result in between. It
+// goes on while the view and the layers stay the same.
+struct ProgressiveRedraw
+{
+    b32              active;
+    CompositeView    view;
+    DArray<LayerKey> keys;
+    i64              pivot;
+    i64              num_elements;
+
+    // Where the next slice starts.
+    i64              next_element;
+    i64              layer_i;
+    GLuint           composite_texture;
+    b32              fill_below;
+    b32              fill_above;
+    b32              use_above;
+
+    i32              num_frames;        // Since the last complete image, including abandoned redraws.
+    i32              last_num_frames;   // Frames that the last progressive redraw took. 1 if it fit in one.
+    f32              segments_per_ms;   // Measured from past slices. 0 until then.
+
+    // GPU time of a slice, read back in a later frame so that measuring
+    // does not wait for the GPU. 0 without GLHelperFlags_TIMER_QUERY.
+    GLuint           timer_query;
+    b32              timer_pending;     // The query has ended and its result was not read yet.
+    i64              timed_segments;    // Segments drawn while it ran.
+};
+
+// A render of the canvas that is drawn with a transform while the view
+// animates. See gpu_snapshot_begin
+struct CanvasSnapshot
+{
+    GLuint     texture;     // Screen-sized, like canvas_texture.
+    b32        valid;
+    CanvasView view;        // Pan, zoom center and angle it was rendered with.
+    i64        scale;
+};
+
 struct RenderBackend
 {
     f32 viewport_limits[2];  // OpenGL limits to the framebuffer size.
@@ -97,6 +324,13 @@ struct RenderBackend
     // VBO for the screen-covering quad.
     GLuint vbo_screen_quad;
 
+    // Corners of the quad around a stroke segment, as (along, across) pairs.
+    // With instancing it is a single triangle fan. Without it, the quad is
+    // repeated for the longest possible stroke, and ibo_stroke_corners has
+    // the triangles.
+    GLuint vbo_stroke_corners;
+    GLuint ibo_stroke_corners;
+
     // Handles for color picker.
     GLuint vbo_picker;
     GLuint vbo_picker_norm;
@@ -114,23 +348,112 @@ struct RenderBackend
 
     // Objects used in rendering.
     GLuint canvas_texture;
-    GLuint eraser_texture;
+    GLuint eraser_texture;  // Scratch space for layer effects and gpu_pan_copy.
+    GLuint blur_textures[2];  // Half the screen size. Large blurs are computed on downsampled copies here.
+    GLuint present_texture;   // Post-processed canvas and picker. Copied to the screen every frame.
     GLuint helper_texture;  // Used for various effects..
     GLuint stencil_texture;
     GLuint stroke_info_texture;
 
     GLuint fbo;
 
+    // The working layer is drawn every frame. Layers below it are read from
+    // composite_below, which includes the background. Layers above it are
+    // read from composite_above, which is transparent where they are empty.
+    DArray<ClipLayer> clip_layers;
+    i64               composite_pivot;      // Index in clip_layers of the working layer. clip_layers.count if none. -1 disables the caches.
+    CompositeView     composite_view;       // Set by gpu_update_canvas. Scale and background are filled in when rendering.
+    CompositeView     last_composite_view;  // Caches are filled only when the view did not change since the last frame.
+    CompositeCache    composite_below;
+    CompositeCache    composite_above;
+
+    ProgressiveRedraw progressive;
+    b32               progressive_allowed;  // Set by the clip pass. See ClipFlags_PROGRESSIVE
+
+    // Drawn by gpu_render instead of the strokes while snapshot_active.
+    b32               snapshot_active;
+    CanvasSnapshot    snapshot_far;     // Zoomed out to the end of the animation.
+    CanvasSnapshot    snapshot_near;    // The frame on the screen when it started.
+    CanvasSnapshot    snapshot_pending; // Next snapshot_far, while its strokes are cooked. No texture.
+    GLuint            vbo_snapshot;
+
     i32 flags;  // RenderBackendFlags enum
 
     DArray<RenderElement> clip_array;
+    DArray<StrokeRange>   clip_ranges;  // Scratch space for stroke index queries.
+    DArray<ClipJob>       clip_jobs;
+    DArray<i32>           clip_visible; // Output of the clip jobs.
+    WorkerPool            clip_workers; // Also used for cooking.
+    DArray<CookItem>      cook_items;
+    DArray<CookJob>       cook_jobs;
+    b32                   strokes_pending;  // Some visible strokes were not cooked in the last clip pass.
+
+    // Vertex and index data for every cooked stroke.
+    BufferPool            stroke_pool;
+
+    // Cooked strokes, most recently visible first. When the pool holds more
+    // than stroke_budget_bytes, strokes are evicted from the tail.
+    RenderElement*        lru_head;
+    RenderElement*        lru_tail;
+    i64                   stroke_budget_bytes;
+    i64                   clip_count;   // Incremented on every clip pass.
+
+    // Batched drawing of fast-path and soft strokes. See stroke_raster.v.glsl
+    b32                   stroke_batching;      // Supported by the GL implementation.
+    GLuint                stroke_batch_program;
+    GLuint                stroke_soft_program;  // Pressure and distance to opacity. See stroke_soft.f.glsl
+    GLuint                vao_stroke_batch;     // Has no attributes.
+    GLuint                vao;
+    GLuint                segments_texture;     // Buffer texture over one pool page at a time.
+    DArray<StrokeTableEntry> stroke_table;      // Indexed by RenderElement::slot. Slot 0 is never used.
+    DArray<i32>           stroke_table_free_slots;
+    i64                   stroke_table_max_slots;
+    GLuint                stroke_table_buffer;  // Holds stroke_table.capacity entries.
+    i64                   stroke_table_gpu_capacity;
+    GLuint                stroke_table_texture;
+    DArray<GLint>         batch_firsts;
+    DArray<GLsizei>       batch_counts;
+
+    // ViewBlock for the stroke programs. Written by gpu_update_canvas.
+    GLuint                view_ubo;
+    ViewUniforms          view_uniforms;
+    ViewUniforms          view_uniforms_gpu;    // Contents of view_ubo.
+
+    // For the debug window.
+    i64                   num_evictions;
+    i64                   num_recooks;
+    i64                   num_evictions_last_clip;
+    i64                   num_recooks_last_clip;
+
+    // One entry per visible layer, bottom to top. Only valid for clip_cache_rect.
+    DArray<ClipCacheLayer> clip_cache;
+    Rect                   clip_cache_rect;
+    b32                    clip_cache_valid;
 
     // Screen size.
     i32 width;
     i32 height;
 
+    // Size of the screen textures. They keep their contents across calls to
+    // gpu_resize that do not change it.
+    i32 texture_width;
+    i32 texture_height;
+
+    // Part of the screen, in raster coordinates, that changed since the last
+    // gpu_render. Only that part of helper_texture and present_texture is
+    // brought up to date.
+    Rect damage;
+    Rect picker_rect;
+
     v3f background_color;
-    i32 scale;  // zoom
+    i32 scale;  // zoom. view_scale times resolution_divisor.
+
+    // While the view changes, the canvas is drawn at 1/resolution_divisor of
+    // the screen size, into the bottom-left of the textures, and stretched to
+    // the screen in gpu_render. See gpu_set_resolution_divisor
+    i32        resolution_divisor;
+    CanvasView view;        // Last view passed to gpu_update_canvas.
+    i32        view_scale;  // Last scale passed to gpu_update_scale.
 
     // See MAX_DEPTH_VALUE
     i32 stroke_z;
@@ -142,6 +465,7 @@ struct RenderBackend
 
 #if MILTON_ENABLE_PROFILING
     u64 clipped_count;
+    i64 stroke_draw_calls;
 #endif
 };
 
@@ -176,6 +500,17 @@ DEBUG_gl_validate_buffer(GLuint buffer)
     mlt_assert(DEBUG_g_buffers[buffer]);
 }
 
+// All stroke programs share stroke_raster.v.glsl. a_corner is the only
+// attribute that is never per-instance, and some compatibility profiles
+// require attribute 0 to be per-vertex.
+static GLuint
+new_stroke_program()
+{
+    GLuint program = glCreateProgram();
+    glBindAttribLocation(program, 0, "a_corner");
+    return program;
+}
+
 static void
 print_framebuffer_status()
 {
@@ -230,10 +565,31 @@ get_render_element(RenderHandle handle)
     return e;
 }
 
+static Rect
+screen_rect(i64 left, i64 top, i64 right, i64 bottom)
+{
+    Rect rect;
+    rect.left = left;
+    rect.top = top;
+    rect.right = right;
+    rect.bottom = bottom;
+    return rect;
+}
+
+// Marks part of the screen, in raster coordinates, as changed.
+static void
+add_damage(RenderBackend* r, Rect rect)
+{
+    if ( rect.left < rect.right && rect.top < rect.bottom ) {
+        r->damage = rect_union(r->damage, rect);
+    }
+}
+
 RenderBackend*
 gpu_allocate_render_backend(Arena* arena)
 {
     RenderBackend* p = arena_alloc_elem(arena, RenderBackend);
+    p->resolution_divisor = 1;
     return p;
 }
 
@@ -282,6 +638,9 @@ gpu_update_picker(RenderBackend* r, ColorPicker* picker)
     // Update VBO for picker
     {
         Rect rect = get_bounds_for_picker_and_colors(picker);
+        add_damage(r, r->picker_rect);
+        add_damage(r, rect);
+        r->picker_rect = rect;
         // convert to clip space
         v2i screen_size = {r->width, r->height};
         float top = (float)rect.top / screen_size.h;
@@ -315,11 +674,11 @@ gpu_update_picker(RenderBackend* r, ColorPicker* picker)
         };
 
         // Create buffers and upload
-        glBindBuffer(GL_ARRAY_BUFFER, r->vbo_picker);
+        gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_picker);
         DEBUG_gl_mark_buffer(r->vbo_picker);
         glBufferData(GL_ARRAY_BUFFER, array_count(data)*sizeof(*data), data, GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ARRAY_BUFFER, r->vbo_picker_norm);
+        gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_picker_norm);
         DEBUG_gl_mark_buffer(r->vbo_picker_norm);
         glBufferData(GL_ARRAY_BUFFER, array_count(norm)*sizeof(*norm), norm, GL_STATIC_DRAW);
     }
@@ -356,11 +715,11 @@ gpu_update_brush_outline(RenderBackend* r, i32 cx, i32 cy, i32 radius,
          radius_plus_girth, -radius_plus_girth,
     };
 
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo_outline_sizes);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_outline_sizes);
     DEBUG_gl_mark_buffer(r->vbo_outline_sizes);
     glBufferData(GL_ARRAY_BUFFER, array_count(sizes)*sizeof(*sizes), sizes, GL_DYNAMIC_DRAW);
 
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo_outline);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_outline);
     DEBUG_gl_mark_buffer(r->vbo_outline);
     glBufferData(GL_ARRAY_BUFFER, array_count(data)*sizeof(*data), data, GL_DYNAMIC_DRAW);
 
@@ -396,6 +755,10 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
     #endif
 
     r->stroke_z = MAX_DEPTH_VALUE - 20;
+    r->stroke_budget_bytes = (i64)STROKE_GPU_BUDGET_MB * 1024 * 1024;
+
+    workers_init(&r->clip_workers, workers_default_thread_count());
+    milton_log("Clipping with %d worker threads.\n", r->clip_workers.num_threads);
 
     if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
         glEnable(GL_MULTISAMPLE);
@@ -423,9 +786,8 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
 
     // Create a single VAO and bind it.
     #if USE_GL_3_2
-        GLuint proxy_vao = 0;
-        glGenVertexArrays(1, &proxy_vao);
-        glBindVertexArray(proxy_vao);
+        glGenVertexArrays(1, &r->vao);
+        glBindVertexArray(r->vao);
     #endif
 
     GLVendor vendor = GLVendor_UNKNOWN;
@@ -461,7 +823,7 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         // Create buffers and upload
         GLuint vbo = 0;
         glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        gl::bind_buffer(GL_ARRAY_BUFFER, vbo);
         DEBUG_gl_mark_buffer(vbo);
         glBufferData(GL_ARRAY_BUFFER, array_count(quad_data)*sizeof(*quad_data), quad_data, GL_STATIC_DRAW);
 
@@ -474,7 +836,7 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         };
         GLuint vbo_uv = 0;
         glGenBuffers(1, &vbo_uv);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo_uv);
+        gl::bind_buffer(GL_ARRAY_BUFFER, vbo_uv);
         DEBUG_gl_mark_buffer(vbo_uv);
         glBufferData(GL_ARRAY_BUFFER, array_count(uv_data)*sizeof(*uv_data), uv_data, GL_STATIC_DRAW);
 
@@ -487,6 +849,49 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         gl::link_program(r->quad_program, objs, array_count(objs));
     }
 
+    // Stroke segment quads.
+    {
+        // Corner 0 is on a's end, 2 on b's end, on the other side.
+        GLfloat corners[] = {
+            0, 0,
+            0, 1,
+            1, 1,
+            1, 0,
+        };
+        glGenBuffers(1, &r->vbo_stroke_corners);
+        gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_stroke_corners);
+        DEBUG_gl_mark_buffer(r->vbo_stroke_corners);
+        if ( gl::check_flags(GLHelperFlags_INSTANCING) ) {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        }
+        else {
+            const i64 max_segments = STROKE_MAX_POINTS - 1;
+            GLfloat* repeated = (GLfloat*)mlt_calloc((size_t)max_segments, sizeof(corners), "GPU");
+            u32* indices = (u32*)mlt_calloc((size_t)max_segments*6, sizeof(u32), "GPU");
+            for ( i64 si = 0; si < max_segments; ++si ) {
+                memcpy(repeated + si*array_count(corners), corners, sizeof(corners));
+
+                u32 idx = (u32)(si*4);
+                u32* tri = indices + si*6;
+                tri[0] = idx + 0;
+                tri[1] = idx + 1;
+                tri[2] = idx + 2;
+                tri[3] = idx + 2;
+                tri[4] = idx + 0;
+                tri[5] = idx + 3;
+            }
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(max_segments*sizeof(corners)), repeated, GL_STATIC_DRAW);
+
+            glGenBuffers(1, &r->ibo_stroke_corners);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ibo_stroke_corners);
+            DEBUG_gl_mark_buffer(r->ibo_stroke_corners);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)(max_segments*6*sizeof(u32)), indices, GL_STATIC_DRAW);
+
+            mlt_free(repeated, "GPU");
+            mlt_free(indices, "GPU");
+        }
+    }
+
     GLuint stroke_vs = gl::compile_shader(g_stroke_raster_v, GL_VERTEX_SHADER);
 
     {  // Stroke raster program
@@ -513,20 +918,77 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         objs[0] = stroke_vs;
         objs[1] = gl::compile_shader(g_stroke_raster_f, GL_FRAGMENT_SHADER, config_string);
 
-        r->stroke_program = glCreateProgram();
+        r->stroke_program = new_stroke_program();
 
         gl::link_program(r->stroke_program, objs, array_count(objs));
+
+        // Same fragment shader, but color and radius come from the stroke
+        // table instead of uniforms. The batch shaders are always GLSL 3.30,
+        // which most drivers also compile in the GL 2.1 context of release
+        // builds. Without it, every stroke is its own draw call.
+        if ( gl::check_flags(GLHelperFlags_GLSL_330) ) {
+            objs[0] = gl::compile_shader_glsl_330(g_stroke_raster_v, GL_VERTEX_SHADER, "", "#define STROKE_BATCH 1\n");
+            objs[1] = gl::compile_shader_glsl_330(g_stroke_raster_f, GL_FRAGMENT_SHADER, config_string, "#define STROKE_BATCH 1\n");
+
+            r->stroke_batch_program = glCreateProgram();
+            gl::link_program(r->stroke_batch_program, objs, array_count(objs));
+
+            // Soft strokes look at the neighbors of each segment instead of
+            // going through stroke_info_texture.
+            char* soft_variation = "#define STROKE_BATCH 1\n#define STROKE_SOFT 1\n";
+            objs[0] = gl::compile_shader_glsl_330(g_stroke_raster_v, GL_VERTEX_SHADER, "", soft_variation);
+            objs[1] = gl::compile_shader_glsl_330(g_stroke_soft_f, GL_FRAGMENT_SHADER, config_string, soft_variation);
+
+            r->stroke_soft_program = glCreateProgram();
+            gl::link_program(r->stroke_soft_program, objs, array_count(objs));
+        }
+    }
+    // Batched strokes read their segments straight from the pool, so they
+    // need one copy of each (instancing) and buffer textures as large as a
+    // page.
+    #if !STROKE_DEBUG_VIZ
+    if (    r->stroke_batch_program != 0
+         && gl::check_flags(GLHelperFlags_INSTANCING)
+         && gl::check_flags(GLHelperFlags_TEXTURE_BUFFER) ) {
+        GLint max_texels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+        if ( max_texels >= BUFFER_POOL_PAGE_SIZE / (i64)sizeof(i32) ) {
+            r->stroke_batching = true;
+            r->stroke_table_max_slots = max_texels / 4;
+
+            glGenVertexArrays(1, &r->vao_stroke_batch);
+
+            glGenBuffers(1, &r->stroke_table_buffer);
+
+            glActiveTexture(GL_TEXTURE1);
+            glGenTextures(1, &r->segments_texture);
+            glBindTexture(GL_TEXTURE_BUFFER, r->segments_texture);
+
+            glActiveTexture(GL_TEXTURE2);
+            glGenTextures(1, &r->stroke_table_texture);
+            glBindTexture(GL_TEXTURE_BUFFER, r->stroke_table_texture);
+
+            glActiveTexture(GL_TEXTURE0);
+
+            GLuint ps[] = { r->stroke_batch_program, r->stroke_soft_program };
+            for ( auto p : ps ) {
+                gl::set_uniform_i(p, "u_segments", 1);
+                gl::set_uniform_i(p, "u_stroke_table", 2);
+            }
+        }
+        else {
+            milton_log("Texture buffers are too small for batched strokes (%d texels).\n", max_texels);
+        }
     }
+    #endif
     // Stroke eraser
     {
         GLuint objs[2];
         objs[0] = stroke_vs;
         objs[1] = gl::compile_shader(g_stroke_eraser_f, GL_FRAGMENT_SHADER);
 
-        r->stroke_eraser_program = glCreateProgram();
+        r->stroke_eraser_program = new_stroke_program();
         gl::link_program(r->stroke_eraser_program, objs, array_count(objs));
-
-        gl::set_uniform_i(r->stroke_eraser_program, "u_canvas", 0);
     }
     // Stroke info program
     {
@@ -534,7 +996,7 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         objs[0] = stroke_vs;
         objs[1] = gl::compile_shader(g_stroke_info_f, GL_FRAGMENT_SHADER);
 
-        r->stroke_info_program = glCreateProgram();
+        r->stroke_info_program = new_stroke_program();
         gl::link_program(r->stroke_info_program, objs, array_count(objs));
 
     }
@@ -543,9 +1005,9 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         GLuint objs[2];
         objs[0] = stroke_vs;
 
-        r->stroke_fill_program_distance = glCreateProgram();
-        r->stroke_fill_program_pressure = glCreateProgram();
-        r->stroke_fill_program_pressure_distance = glCreateProgram();
+        r->stroke_fill_program_distance = new_stroke_program();
+        r->stroke_fill_program_pressure = new_stroke_program();
+        r->stroke_fill_program_pressure_distance = new_stroke_program();
 
         objs[1] = gl::compile_shader(g_stroke_fill_f, GL_FRAGMENT_SHADER);
         gl::link_program(r->stroke_fill_program_pressure, objs, array_count(objs));
@@ -571,9 +1033,35 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         objs[0] = stroke_vs;
         objs[1] = gl::compile_shader(g_stroke_clear_f, GL_FRAGMENT_SHADER);
 
-        r->stroke_clear_program = glCreateProgram();
+        r->stroke_clear_program = new_stroke_program();
         gl::link_program(r->stroke_clear_program, objs, array_count(objs));
     }
+    // View uniforms, shared by the stroke programs.
+    #if USE_GL_3_2
+    {
+        glGenBuffers(1, &r->view_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, r->view_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), &r->view_uniforms_gpu, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, VIEW_BLOCK_BINDING, r->view_ubo);
+
+        GLuint ps[] = {
+            r->stroke_program,
+            r->stroke_eraser_program,
+            r->stroke_info_program,
+            r->stroke_fill_program_pressure,
+            r->stroke_fill_program_pressure_distance,
+            r->stroke_fill_program_distance,
+            r->stroke_clear_program,
+            r->stroke_batch_program,
+            r->stroke_soft_program,
+        };
+        for ( auto p : ps ) {
+            if ( p && !gl::bind_uniform_block(p, "ViewBlock", VIEW_BLOCK_BINDING) ) {
+                milton_log("WARNING: Stroke program without a ViewBlock.\n");
+            }
+        }
+    }
+    #endif
     {  // Color picker program
         r->picker_program = glCreateProgram();
         GLuint objs[2] = {};
@@ -663,6 +1151,22 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
             r->eraser_texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
         }
 
+        if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+            r->composite_below.texture = gl::new_color_texture_multisample(view->screen_size.w, view->screen_size.h);
+            r->composite_above.texture = gl::new_color_texture_multisample(view->screen_size.w, view->screen_size.h);
+        } else {
+            r->composite_below.texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
+            r->composite_above.texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
+        }
+
+        // Not used with multisampling.
+        for ( int bi = 0; bi < 2; ++bi ) {
+            r->blur_textures[bi] = gl::new_color_texture((view->screen_size.w + 1) / 2, (view->screen_size.h + 1) / 2);
+        }
+        r->present_texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
+        r->snapshot_far.texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
+        r->snapshot_near.texture = gl::new_color_texture(view->screen_size.w, view->screen_size.h);
+
         glGenTextures(1, &r->helper_texture);
 
         if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
@@ -699,11 +1203,20 @@ gpu_init(RenderBackend* r, CanvasView* view, ColorPicker* picker)
         glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
         print_framebuffer_status();
         glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
+
+        r->texture_width = view->screen_size.w;
+        r->texture_height = view->screen_size.h;
+        r->damage = screen_rect(0, 0, view->screen_size.w, view->screen_size.h);
+        r->picker_rect = rect_without_size();
     }
     // VBO for picker
     glGenBuffers(1, &r->vbo_picker);
     glGenBuffers(1, &r->vbo_picker_norm);
 
+    if ( gl::check_flags(GLHelperFlags_TIMER_QUERY) ) {
+        glGenQueries(1, &r->progressive.timer_query);
+    }
+
     // Call gpu_update_picker() to initialize the color picker
     gpu_update_picker(r, picker);
     return result;
@@ -715,31 +1228,76 @@ gpu_resize(RenderBackend* r, CanvasView* view)
     r->width = view->screen_size.w;
     r->height = view->screen_size.h;
 
+    // Called on every pan. Keep the canvas around for gpu_pan_copy.
+    if ( r->texture_width == r->width && r->texture_height == r->height ) {
+        return;
+    }
+    r->texture_width = r->width;
+    r->texture_height = r->height;
+
     if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
         gl::resize_color_texture_multisample(r->eraser_texture, r->width, r->height);
         gl::resize_color_texture_multisample(r->canvas_texture, r->width, r->height);
         gl::resize_color_texture_multisample(r->helper_texture, r->width, r->height);
+        gl::resize_color_texture_multisample(r->composite_below.texture, r->width, r->height);
+        gl::resize_color_texture_multisample(r->composite_above.texture, r->width, r->height);
         gl::resize_depth_stencil_texture_multisample(r->stencil_texture, r->width, r->height);
     }
     else {
         gl::resize_color_texture(r->eraser_texture, r->width, r->height);
         gl::resize_color_texture(r->canvas_texture, r->width, r->height);
         gl::resize_color_texture(r->helper_texture, r->width, r->height);
+        gl::resize_color_texture(r->composite_below.texture, r->width, r->height);
+        gl::resize_color_texture(r->composite_above.texture, r->width, r->height);
         gl::resize_color_texture(r->stroke_info_texture, r->width, r->height);
+        for ( int bi = 0; bi < 2; ++bi ) {
+            gl::resize_color_texture(r->blur_textures[bi], (r->width + 1) / 2, (r->height + 1) / 2);
+        }
+        gl::resize_color_texture(r->present_texture, r->width, r->height);
+        gl::resize_color_texture(r->snapshot_far.texture, r->width, r->height);
+        gl::resize_color_texture(r->snapshot_near.texture, r->width, r->height);
         gl::resize_depth_stencil_texture(r->stencil_texture, r->width, r->height);
     }
+    r->composite_below.valid = false;
+    r->composite_above.valid = false;
+    r->progressive.active = false;
+    r->snapshot_far.valid = false;
+    r->snapshot_near.valid = false;
+    r->snapshot_pending.valid = false;
+    r->damage = screen_rect(0, 0, r->width, r->height);
 }
 
 void
 gpu_reset_render_flags(RenderBackend* r, int flags)
 {
+    if ( (r->flags ^ flags) & RenderBackendFlags_GUI_VISIBLE ) {
+        add_damage(r, r->picker_rect);
+    }
     r->flags = flags;
 }
 
+#if USE_GL_3_2
+// One upload for every stroke program, and none if nothing changed.
+static void
+upload_view_uniforms(RenderBackend* r)
+{
+    if ( memcmp(&r->view_uniforms, &r->view_uniforms_gpu, sizeof(ViewUniforms)) != 0 ) {
+        r->view_uniforms_gpu = r->view_uniforms;
+        glBindBuffer(GL_UNIFORM_BUFFER, r->view_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ViewUniforms), &r->view_uniforms);
+    }
+}
+#endif
+
 void
 gpu_update_scale(RenderBackend* r, i32 scale)
 {
-    r->scale = scale;
+    r->view_scale = scale;
+    r->scale = scale * r->resolution_divisor;
+#if USE_GL_3_2
+    r->view_uniforms.scale = r->scale;
+    upload_view_uniforms(r);
+#else
     GLuint ps[] = {
         r->stroke_program,
         r->stroke_eraser_program,
@@ -748,10 +1306,15 @@ gpu_update_scale(RenderBackend* r, i32 scale)
         r->stroke_fill_program_pressure_distance,
         r->stroke_fill_program_distance,
         r->stroke_clear_program,
+        r->stroke_batch_program,    // 0 without GLSL 3.30
+        r->stroke_soft_program,
     };
     for (sz i = 0; i < array_count(ps); ++i) {
-        gl::set_uniform_i(ps[i], "u_scale", scale);
+        if ( ps[i] ) {
+            gl::set_uniform_i(ps[i], "u_scale", r->scale);
+        }
     }
+#endif
 }
 
 void
@@ -809,7 +1372,7 @@ gpu_update_export_rect(RenderBackend* r, Exporter* exporter)
         right+line_width/2, bottom,
         right+line_width/2, top,
     };
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo_exporter);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_exporter);
     DEBUG_gl_mark_buffer(r->vbo_exporter);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)array_count(toparr)*sizeof(*toparr), toparr, GL_DYNAMIC_DRAW);
 
@@ -830,7 +1393,7 @@ gpu_update_export_rect(RenderBackend* r, Exporter* exporter)
         12,13,14,
         14,15,12,
     };
-    glBindBuffer(GL_ARRAY_BUFFER, r->exporter_indices);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->exporter_indices);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)array_count(indices)*sizeof(*indices), indices, GL_STATIC_DRAW);
 
     r->exporter_indices_count = array_count(indices);
@@ -851,17 +1414,28 @@ gpu_get_viewport_limits(RenderBackend* r, float* out_viewport_limits)
     }
 }
 
+i32
+gpu_get_num_stroke_draw_calls(RenderBackend* r)
+{
+    i32 count = 0;
+    #if MILTON_ENABLE_PROFILING
+        count = (i32)r->stroke_draw_calls;
+    #endif
+    return count;
+}
+
 i32
 gpu_get_num_clipped_strokes(Layer* root_layer)
 {
     i32 count = 0;
     #if MILTON_ENABLE_PROFILING
     for ( Layer* l = root_layer; l != NULL; l = l->next ) {
-        StrokeList strokes = l->strokes;
-        for ( i64 si = 0; si < strokes.count; ++si ) {
-            Stroke* s = strokes[si];
-            RenderElement* re = get_render_element(s->render_handle);
-            if ( re && re->vbo_stroke != 0 ) {
+        StrokeList* strokes = &l->strokes;
+        for ( i64 si = 0; si < strokes->count; ++si ) {
+            i64 offset = 0;
+            StrokeBucket* bucket = strokelist_bucket_at(strokes, si, &offset);
+            RenderElement* re = get_render_element(bucket->render_handles[offset]);
+            if ( re && re->alloc.buffer != 0 ) {
                 ++count;
             }
         }
@@ -870,10 +1444,17 @@ gpu_get_num_clipped_strokes(Layer* root_layer)
     return count;
 }
 
+// Stroke programs get the new size from the next upload_view_uniforms. They
+// draw into the bottom-left `fstroke_screen` pixels, which is smaller than
+// the screen at reduced resolutions.
 static void
-set_screen_size(RenderBackend* r, float* fscreen)
+set_screen_size(RenderBackend* r, float* fscreen, float* fstroke_screen)
 {
-    GLuint programs[] = {
+#if USE_GL_3_2
+    r->view_uniforms.screen_size[0] = fstroke_screen[0];
+    r->view_uniforms.screen_size[1] = fstroke_screen[1];
+#else
+    GLuint stroke_programs[] = {
         r->stroke_program,
         r->stroke_eraser_program,
         r->stroke_info_program,
@@ -881,16 +1462,45 @@ set_screen_size(RenderBackend* r, float* fscreen)
         r->stroke_fill_program_pressure_distance,
         r->stroke_fill_program_distance,
         r->stroke_clear_program,
+        r->stroke_batch_program,
+        r->stroke_soft_program,
+    };
+    for ( u64 pi = 0; pi < array_count(stroke_programs); ++pi ) {
+        if ( stroke_programs[pi] ) {
+            gl::set_uniform_vec2(stroke_programs[pi], "u_screen_size", 1, fstroke_screen);
+        }
+    }
+#endif
+    GLuint programs[] = {
         r->layer_blend_program,
         r->texture_fill_program,
         r->exporter_program,
         r->picker_program,
         r->postproc_program,
-        r->blur_program,
     };
     for ( u64 pi = 0; pi < array_count(programs); ++pi ) {
         gl::set_uniform_vec2(programs[pi], "u_screen_size", 1, fscreen);
     }
+    // stroke_info_texture keeps the size of the screen.
+    float finfo[] = { (float)r->width, (float)r->height };
+    GLuint fill_programs[] = {
+        r->stroke_fill_program_pressure,
+        r->stroke_fill_program_pressure_distance,
+        r->stroke_fill_program_distance,
+    };
+    for ( u64 pi = 0; pi < array_count(fill_programs); ++pi ) {
+        gl::set_uniform_vec2(fill_programs[pi], "u_info_size", 1, finfo);
+    }
+}
+
+// Pixels that gpu_render_canvas draws into, at the bottom-left of the
+// textures.
+static v2i
+render_target_size(RenderBackend* r)
+{
+    i32 d = r->resolution_divisor;
+    v2i size = { (r->width + d - 1) / d, (r->height + d - 1) / d };
+    return size;
 }
 
 static
@@ -901,19 +1511,95 @@ relative_to_render_center(RenderBackend* r, v2l point)
     return result;
 }
 
+static void
+stroke_table_fill_entry(RenderBackend* r, RenderElement* re)
+{
+    StrokeTableEntry* e = &r->stroke_table.data[re->slot];
+    v2i origin = relative_to_render_center(r, re->origin);
+    e->origin[0] = origin.x;
+    e->origin[1] = origin.y;
+    e->radius = re->radius;
+    e->z = re->z;
+    for ( int ci = 0; ci < 4; ++ci ) {
+        e->color[ci] = re->color.d[ci];
+    }
+
+    e->first_segment = (i32)(re->alloc.offset / (i64)sizeof(StrokeSegment));
+    e->num_segments = (i32)re->count;
+    e->soft_window = re->soft_window;
+    e->min_opacity = (re->flags & RenderElementFlags_PRESSURE_TO_OPACITY) ? re->min_opacity : 1.0f;
+    e->hardness = (re->flags & RenderElementFlags_DISTANCE_TO_OPACITY) ? re->hardness : 0.0f;
+}
+
+// Segments are relative to the origin of their stroke, so a new render center
+// only moves the stroke origins in the table. Compacting the pool moves the
+// first segments.
+static void
+stroke_table_refresh(RenderBackend* r)
+{
+    if ( r->stroke_table.count == 0 ) {
+        return;
+    }
+    for ( RenderElement* re = r->lru_head; re != NULL; re = re->lru_next ) {
+        if ( re->slot != 0 ) {
+            stroke_table_fill_entry(r, re);
+        }
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, r->stroke_table_buffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)(r->stroke_table.count*sizeof(StrokeTableEntry)),
+                    r->stroke_table.data);
+}
+
 void
-gpu_update_canvas(RenderBackend* r, CanvasState* canvas, CanvasView* view)
+gpu_update_canvas(RenderBackend* r, CanvasView* view)
 {
+    r->view = *view;
+
     v2i center = view->zoom_center;
     v2l pan = view->pan_center;
 
+    // At reduced resolutions, everything on the screen is 1/d of its size and
+    // the stroke programs draw into the bottom-left corner of the textures.
+    // The zoom center moves up by the fraction of a pixel that the target
+    // is taller than that, so that the corner is the screen scaled down by d
+    // exactly.
+    i32 d = r->resolution_divisor;
+    v2i target_size = { (view->screen_size.w + d - 1) / d, (view->screen_size.h + d - 1) / d };
+    f32 zoom_center[] = {
+        (f32)center.x / d,
+        (f32)center.y / d + ((f32)target_size.h - (f32)view->screen_size.h / d),
+    };
+
     v2i new_render_center = VEC2I(pan / (i64)(1<<RENDER_CHUNK_SIZE_LOG2));
     if ( new_render_center != r->render_center ) {
-        milton_log("Moving to new render center. %d, %d Clearing render data.\n", new_render_center.x, new_render_center.y);
+        milton_log("Moving to new render center. %d, %d\n", new_render_center.x, new_render_center.y);
         r->render_center = new_render_center;
-        gpu_free_strokes(r, canvas);
+        stroke_table_refresh(r);
     }
 
+    f32 cos_angle = cosf(view->angle);
+    f32 sin_angle = sinf(view->angle);
+
+    // GLSL is column-major
+    f32 matrix[] = { cos_angle, sin_angle, -sin_angle, cos_angle };
+
+    f32 matrix_inverse[] = { cos_angle, -sin_angle, sin_angle, cos_angle };
+
+    v2i relative_pan = relative_to_render_center(r, pan);
+
+#if USE_GL_3_2
+    ViewUniforms* u = &r->view_uniforms;
+    for ( int ci = 0; ci < 2; ++ci ) {
+        for ( int ri = 0; ri < 2; ++ri ) {
+            u->rotation[4*ci + ri] = matrix[2*ci + ri];
+            u->rotation_inverse[4*ci + ri] = matrix_inverse[2*ci + ri];
+        }
+    }
+    u->pan_center[0] = relative_pan.x;
+    u->pan_center[1] = relative_pan.y;
+    u->zoom_center[0] = zoom_center[0];
+    u->zoom_center[1] = zoom_center[1];
+#else
     GLuint ps[] = {
         r->stroke_program,
         r->stroke_eraser_program,
@@ -922,343 +1608,628 @@ gpu_update_canvas(RenderBackend* r, CanvasState* canvas, CanvasView* view)
         r->stroke_fill_program_pressure_distance,
         r->stroke_fill_program_distance,
         r->stroke_clear_program,
+        r->stroke_batch_program,
+        r->stroke_soft_program,
     };
-
-    f32 cos_angle = cosf(view->angle);
-    f32 sin_angle = sinf(view->angle);
-
-    // GLSL is column-major
-    f32 matrix[] = { cos_angle, sin_angle, -sin_angle, cos_angle };
-
-    f32 matrix_inverse[] = { cos_angle, -sin_angle, sin_angle, cos_angle };
-
     for (sz i = 0; i < array_count(ps); ++i) {
-        gl::set_uniform_mat2(ps[i], "u_rotation", matrix);
-        gl::set_uniform_mat2(ps[i], "u_rotation_inverse", matrix_inverse);
-        gl::set_uniform_vec2i(ps[i], "u_pan_center", 1, relative_to_render_center(r, pan).d);
-        gl::set_uniform_vec2i(ps[i], "u_zoom_center", 1, center.d);
+        if ( ps[i] ) {
+            gl::set_uniform_mat2(ps[i], "u_rotation", matrix);
+            gl::set_uniform_mat2(ps[i], "u_rotation_inverse", matrix_inverse);
+            gl::set_uniform_vec2i(ps[i], "u_pan_center", 1, relative_pan.d);
+            gl::set_uniform_vec2(ps[i], "u_zoom_center", 1, zoom_center);
+        }
     }
+#endif
 
-    gpu_update_scale(r, view->scale);
     float fscreen[] = { (float)view->screen_size.x, (float)view->screen_size.y };
-    set_screen_size(r, fscreen);
+    float fstroke_screen[] = { (float)target_size.w, (float)target_size.h };
+    set_screen_size(r, fscreen, fstroke_screen);
+    // Uploads the view uniforms.
+    gpu_update_scale(r, view->scale);
+
+    // Reduced resolutions differ in size, so their composites are cached apart.
+    CompositeView* cv = &r->composite_view;
+    cv->pan_center = pan;
+    cv->zoom_center = center;
+    cv->angle = view->angle;
+    cv->width = target_size.w;
+    cv->height = target_size.h;
 }
 
 void
-gpu_cook_stroke(Arena* arena, RenderBackend* r, Stroke* stroke, CookStrokeOpt cook_option)
+gpu_set_resolution_divisor(RenderBackend* r, i32 divisor)
 {
-
-    RenderElement** p_render_element = reinterpret_cast<RenderElement**>(&stroke->render_handle);
-    RenderElement* render_element = *p_render_element;
-    if (render_element == NULL) {
-        render_element = arena_alloc_elem(arena, RenderElement);
-        *p_render_element = render_element;
+    if ( divisor != r->resolution_divisor ) {
+        r->resolution_divisor = divisor;
+        i32 scale = r->view_scale;
+        gpu_update_canvas(r, &r->view);
+        gpu_update_scale(r, scale);
     }
+}
 
-    r->stroke_z = (r->stroke_z + 1) % (MAX_DEPTH_VALUE-1);
-    const i32 stroke_z = r->stroke_z + 1;
-
-    if ( cook_option == CookStroke_NEW && render_element->vbo_stroke != 0 ) {
-        // We already have our data cooked
-        mlt_assert(render_element->vbo_pointa != 0);
-        mlt_assert(render_element->vbo_pointb != 0);
-    } else {
-        auto npoints = stroke->num_points;
-        if ( npoints == 1 ) {
-            // Create a 2-point stroke and recurse
-            Stroke duplicate = *stroke;
-            duplicate.num_points = 2;
-            Arena scratch_arena = arena_push(arena);
-            duplicate.points = arena_alloc_array(&scratch_arena, 2, v2l);
-            duplicate.pressures = arena_alloc_array(&scratch_arena, 2, f32);
-            duplicate.points[0] = stroke->points[0];  // It will be set relative to the center in the recursed call.
-            duplicate.points[1] = stroke->points[0];
-            duplicate.pressures[0] = stroke->pressures[0];
-            duplicate.pressures[1] = stroke->pressures[0];
-
-            gpu_cook_stroke(&scratch_arena, r, &duplicate, cook_option);
-
-            // Copy render element to stroke
-            stroke->render_handle = duplicate.render_handle;
-
-            arena_pop(&scratch_arena);
-        }
-        else if ( npoints > 1 ) {
-            // 3 (triangle) *
-            // 2 (two per segment) *
-            // N-1 (segments per stroke)
-            // Reduced to 4 by using indices
-            const size_t count_attribs = 4*((size_t)npoints-1);
-
-            // 6 (3 * 2 from count_attribs)
-            // N-1 (num segments)
-            const size_t count_indices = 6*((size_t)npoints-1);
-
-            size_t count_debug = 0;
-            v3f* bounds;
-            v3f* apoints;
-            v3f* bpoints;
-            v3f* debug = NULL;
-            u16* indices;
-            Arena scratch_arena = arena_push(arena,
-                                             count_attribs*sizeof(decltype(*bounds))  // Bounds
-                                             + 2*count_attribs*sizeof(decltype(*apoints)) // Attributes a,b
-                                             + count_debug*sizeof(decltype(*debug))    // Visualization
-                                             + count_indices*sizeof(decltype(*indices)));  // Interpolation points
-
-            bounds  = arena_alloc_array(&scratch_arena, count_attribs, v3f);
-            apoints = arena_alloc_array(&scratch_arena, count_attribs, v3f);
-            bpoints = arena_alloc_array(&scratch_arena, count_attribs, v3f);
-            indices = arena_alloc_array(&scratch_arena, count_indices, u16);
-#if STROKE_DEBUG_VIZ
-            debug = arena_alloc_array(&scratch_arena, count_debug, v3f);
-#endif
-
-            mlt_assert(r->scale > 0);
-
-            size_t bounds_i = 0;
-            size_t apoints_i = 0;
-            size_t bpoints_i = 0;
-            size_t indices_i = 0;
-            size_t debug_i = 0;
-            for ( i64 i=0; i < npoints-1; ++i ) {
-                v2i point_i = relative_to_render_center(r, stroke->points[i]);
-                v2i point_j = relative_to_render_center(r, stroke->points[i+1]);
-
-                Brush brush = stroke->brush;
-                float radius_i = stroke->pressures[i]*brush.radius;
-                float radius_j = stroke->pressures[i+1]*brush.radius;
-
-                u16 idx = (u16)bounds_i;
-                if ( point_i == point_j ) {
-                    i32 min_x = min(point_i.x - radius_i, point_j.x - radius_j);
-                    i32 min_y = min(point_i.y - radius_i, point_j.y - radius_j);
-                    i32 max_x = max(point_i.x + radius_i, point_j.x + radius_j);
-                    i32 max_y = max(point_i.y + radius_i, point_j.y + radius_j);
-
-                    // Bounding geometry and attributes
-
-                    mlt_assert (bounds_i < ((1<<16)-4));
-
-                    bounds[bounds_i++] = { (float)min_x, (float)min_y, (float)stroke_z };
-                    bounds[bounds_i++] = { (float)min_x, (float)max_y, (float)stroke_z };
-                    bounds[bounds_i++] = { (float)max_x, (float)max_y, (float)stroke_z };
-                    bounds[bounds_i++] = { (float)max_x, (float)min_y, (float)stroke_z };
-                } else {
-                    // Points are different. Do a coordinate change for a tighter box.
-                    v2f d = normalized(v2i_to_v2f(point_j - point_i));
-                    auto basis_change = [&d](v2f v) {
-                        v2f res = {
-                            v.x * d.x + v.y * d.y,
-                            v.x * d.y - v.y * d.x,
-                        };
-
-                        return res;
-                    };
-                    v2f a = basis_change(v2i_to_v2f(point_i));
-                    v2f b = basis_change(v2i_to_v2f(point_j));
-
-                    f32 rad = max(radius_i, radius_j);
-
-                    f32 min_x = min(a.x, b.x) - rad;
-                    f32 min_y = min(a.y, b.y) - rad;
-                    f32 max_x = max(a.x, b.x) + rad;
-                    f32 max_y = max(a.y, b.y) + rad;
-
-                    v2f A = basis_change(v2f{ min_x, min_y });
-                    v2f B = basis_change(v2f{ min_x, max_y });
-                    v2f C = basis_change(v2f{ max_x, max_y });
-                    v2f D = basis_change(v2f{ max_x, min_y });
-
-                    mlt_assert (bounds_i < ((1<<16)-4));
-
-                    bounds[bounds_i++] = { A.x, A.y, (float)stroke_z };
-                    bounds[bounds_i++] = { B.x, B.y, (float)stroke_z };
-                    bounds[bounds_i++] = { C.x, C.y, (float)stroke_z };
-                    bounds[bounds_i++] = { D.x, D.y, (float)stroke_z };
-                }
-
-                indices[indices_i++] = (u16)(idx + 0);
-                indices[indices_i++] = (u16)(idx + 1);
-                indices[indices_i++] = (u16)(idx + 2);
-
-                indices[indices_i++] = (u16)(idx + 2);
-                indices[indices_i++] = (u16)(idx + 0);
-                indices[indices_i++] = (u16)(idx + 3);
-
-                float pressure_a = stroke->pressures[i];
-                float pressure_b = stroke->pressures[i+1];
-
-                // Add attributes for each new vertex.
-                for ( int repeat = 0; repeat < 4; ++repeat ) {
-                    apoints[apoints_i++] = { (float)point_i.x, (float)point_i.y, pressure_a };
-                    bpoints[bpoints_i++] = { (float)point_j.x, (float)point_j.y, pressure_b };
-                    #if STROKE_DEBUG_VIZ
-                        v3f debug_color;
-
-                        if ( stroke->debug_flags[i] & Stroke::INTERPOLATED ) {
-                            debug_color = { 1.0f, 0.0f, 0.0f };
-                        }
-                        else {
-                            debug_color = { 0.0f, 1.0f, 0.0f };
-                        }
-                        debug[debug_i++] = debug_color;
-                    #endif
-                }
-            }
-
-            mlt_assert(bounds_i == count_attribs);
-            mlt_assert(apoints_i == bpoints_i);
-            mlt_assert(apoints_i == bounds_i);
-
-            // TODO: check for GL_OUT_OF_MEMORY
-
-            GLuint vbo_stroke = 0;
-            GLuint vbo_pointa = 0;
-            GLuint vbo_pointb = 0;
-            GLuint indices_buffer = 0;
-            GLuint vbo_debug = 0;
-
-
-            GLenum hint = GL_STATIC_DRAW;
-            if ( cook_option == CookStroke_UPDATE_WORKING_STROKE ) {
-                hint = GL_DYNAMIC_DRAW;
-            }
-            if ( render_element->vbo_stroke != 0 ) {
-                vbo_stroke = render_element->vbo_stroke;
-                vbo_pointa = render_element->vbo_pointa;
-                vbo_pointb = render_element->vbo_pointb;
-                indices_buffer = render_element->indices;
-                #if STROKE_DEBUG_VIZ
-                    vbo_debug = render_element->vbo_debug;
-                #endif
-
-                auto clear_array_buffer = [hint](GLint vbo, size_t size) {
-                    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-                    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(size), NULL, hint);
-                };
-                clear_array_buffer(vbo_stroke, bounds_i*sizeof(decltype(*bounds)));
-                clear_array_buffer(vbo_pointa, bounds_i*sizeof(decltype(*apoints)));
-                clear_array_buffer(vbo_pointb, bounds_i*sizeof(decltype(*bpoints)));
-                clear_array_buffer(indices_buffer, indices_i*sizeof(decltype(*indices)));
-                #if STROKE_DEBUG_VIZ
-                    clear_array_buffer(vbo_debug, debug_i*sizeof(decltype(*debug)));
-                #endif
-            }
-            else {
-                glGenBuffers(1, &vbo_stroke);
-                glGenBuffers(1, &vbo_pointa);
-                glGenBuffers(1, &vbo_pointb);
-                glGenBuffers(1, &indices_buffer);
-                #if STROKE_DEBUG_VIZ
-                    glGenBuffers(1, &vbo_debug);
-                #endif
-
-                DEBUG_gl_mark_buffer(vbo_stroke);
-                DEBUG_gl_mark_buffer(vbo_pointa);
-                DEBUG_gl_mark_buffer(vbo_pointb);
-                DEBUG_gl_mark_buffer(indices_buffer);
-            }
+i32
+gpu_get_resolution_divisor(RenderBackend* r)
+{
+    return r->resolution_divisor;
+}
 
-            /*Send data to GPU*/ {
-                auto send_buffer_data = [hint](GLint vbo, size_t size, void* data) {
-                    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-                    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(size), data, hint);
-                };
-
-                send_buffer_data(vbo_stroke, bounds_i*sizeof(decltype(*bounds)), bounds);
-                send_buffer_data(vbo_pointa, bounds_i*sizeof(decltype(*apoints)), apoints);
-                send_buffer_data(vbo_pointb, bounds_i*sizeof(decltype(*bpoints)), bpoints);
-                send_buffer_data(indices_buffer, indices_i*sizeof(decltype(*indices)), indices);
-                #if STROKE_DEBUG_VIZ
-                    send_buffer_data(vbo_debug, debug_i*sizeof(decltype(*debug)), debug);
-                #endif
-            }
+// The LRU list holds exactly the render elements that have data in the pool.
 
-            RenderElement* re = get_render_element(stroke->render_handle);
-            re->vbo_stroke = vbo_stroke;
-            re->vbo_pointa = vbo_pointa;
-            re->vbo_pointb = vbo_pointb;
-            re->indices = indices_buffer;
-            #if STROKE_DEBUG_VIZ
-                re->vbo_debug = vbo_debug;
-            #endif
-            re->count = (i64)(indices_i);
-            re->color = { stroke->brush.color.r, stroke->brush.color.g, stroke->brush.color.b, stroke->brush.color.a };
-            re->radius = stroke->brush.radius;
-            re->min_opacity = stroke->brush.pressure_opacity_min;
-            re->hardness = stroke->brush.hardness;
-
-            re->flags = 0;
-            if (stroke->flags & StrokeFlag_ERASER) {
-                re->flags |= RenderElementFlags_ERASER;
-            }
-            if (stroke->flags & StrokeFlag_PRESSURE_TO_OPACITY) {
-                re->flags |= RenderElementFlags_PRESSURE_TO_OPACITY;
-            }
-            if (stroke->flags & StrokeFlag_DISTANCE_TO_OPACITY) {
-                re->flags |= RenderElementFlags_DISTANCE_TO_OPACITY;
-            }
+static void
+lru_unlink(RenderBackend* r, RenderElement* re)
+{
+    if ( re->lru_prev ) { re->lru_prev->lru_next = re->lru_next; }
+    else                { r->lru_head = re->lru_next; }
+    if ( re->lru_next ) { re->lru_next->lru_prev = re->lru_prev; }
+    else                { r->lru_tail = re->lru_prev; }
+    re->lru_prev = re->lru_next = NULL;
+}
 
-            mlt_assert(re->count > 1);
+static void
+lru_push_front(RenderBackend* r, RenderElement* re)
+{
+    re->lru_prev = NULL;
+    re->lru_next = r->lru_head;
+    if ( r->lru_head ) { r->lru_head->lru_prev = re; }
+    else               { r->lru_tail = re; }
+    r->lru_head = re;
+}
 
-            arena_pop(&scratch_arena);
+// Marks a stroke as visible in the current clip pass.
+static void
+lru_touch(RenderBackend* r, RenderElement* re)
+{
+    if ( re->alloc.buffer != 0 && re->last_visible_clip != r->clip_count ) {
+        re->last_visible_clip = r->clip_count;
+        if ( r->lru_head != re ) {
+            lru_unlink(r, re);
+            lru_push_front(r, re);
         }
     }
 }
 
-void
-gpu_free_strokes(Stroke* strokes, i64 count, RenderBackend* r)
+// Returns 0 when the table is full. The stroke is then drawn on its own.
+static i32
+stroke_table_alloc_slot(RenderBackend* r)
 {
-    for ( i64 i = 0; i < count; ++i ) {
-        Stroke* s = &strokes[i];
-        RenderElement* re = get_render_element(s->render_handle);
-        if ( re && re->vbo_stroke != 0 ) {
-            mlt_assert(re->vbo_pointa != 0);
-            mlt_assert(re->vbo_pointb != 0);
-            mlt_assert(re->indices != 0);
-
-            DEBUG_gl_validate_buffer(re->vbo_stroke);
-            DEBUG_gl_validate_buffer(re->vbo_pointa);
-            DEBUG_gl_validate_buffer(re->vbo_pointb);
-            DEBUG_gl_validate_buffer(re->indices);
-
-            glDeleteBuffers(1, &re->vbo_stroke);
-            glDeleteBuffers(1, &re->vbo_pointa);
-            glDeleteBuffers(1, &re->vbo_pointb);
-            glDeleteBuffers(1, &re->indices);
-
-            DEBUG_gl_unmark_buffer(re->vbo_stroke);
-            DEBUG_gl_unmark_buffer(re->vbo_pointa);
-            DEBUG_gl_unmark_buffer(re->vbo_pointb);
-            DEBUG_gl_unmark_buffer(re->indices);
-
-            *re = {};
+    i32 slot = 0;
+    if ( r->stroke_table_free_slots.count > 0 ) {
+        slot = pop(&r->stroke_table_free_slots);
+    }
+    else if ( r->stroke_table.count + 1 < r->stroke_table_max_slots ) {
+        if ( r->stroke_table.count == 0 ) {
+            push(&r->stroke_table, StrokeTableEntry{});  // Slot 0
         }
+        slot = (i32)r->stroke_table.count;
+        push(&r->stroke_table, StrokeTableEntry{});
     }
+    return slot;
 }
 
-void
-gpu_free_strokes(RenderBackend* r, CanvasState* canvas)
+static void
+stroke_table_update(RenderBackend* r, RenderElement* re)
 {
-    if ( canvas->root_layer != NULL ) {
-        for ( Layer* l = canvas->root_layer;
+    stroke_table_fill_entry(r, re);
+    StrokeTableEntry* e = &r->stroke_table.data[re->slot];
+
+    glBindBuffer(GL_TEXTURE_BUFFER, r->stroke_table_buffer);
+    if ( r->stroke_table_gpu_capacity < r->stroke_table.capacity ) {
+        r->stroke_table_gpu_capacity = r->stroke_table.capacity;
+        glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)(r->stroke_table_gpu_capacity*sizeof(StrokeTableEntry)),
+                     r->stroke_table.data, GL_DYNAMIC_DRAW);
+
+        glActiveTexture(GL_TEXTURE2);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, r->stroke_table_buffer);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else {
+        glBufferSubData(GL_TEXTURE_BUFFER, (GLintptr)(re->slot*sizeof(StrokeTableEntry)),
+                        sizeof(StrokeTableEntry), e);
+    }
+}
+
+static void
+free_render_element(RenderBackend* r, RenderElement* re)
+{
+    lru_unlink(r, re);
+    if ( re->slot != 0 ) {
+        push(&r->stroke_table_free_slots, re->slot);
+    }
+    buffer_pool_free(&r->stroke_pool, &re->alloc);
+    #if STROKE_DEBUG_VIZ
+        gl::delete_buffers(1, &re->vbo_debug);
+    #endif
+
+    *re = {};
+}
+
+// Frees the least recently visible strokes until the pool fits in the
+// budget. Strokes visible in the current clip pass are never evicted, so a
+// screen that needs more than the budget goes over it.
+static void
+evict_strokes(RenderBackend* r)
+{
+    while (    r->stroke_pool.used_bytes > r->stroke_budget_bytes
+            && r->lru_tail != NULL
+            && r->lru_tail->last_visible_clip != r->clip_count ) {
+        free_render_element(r, r->lru_tail);
+        r->num_evictions_last_clip += 1;
+    }
+    r->num_evictions += r->num_evictions_last_clip;
+}
+
+// Without instancing, every corner of the quad needs its own copy of the segment.
+static i64
+segment_copies()
+{
+    i64 copies = gl::check_flags(GLHelperFlags_INSTANCING) ? 1 : 4;
+    return copies;
+}
+
+// A single point is drawn as one degenerate segment.
+static i64
+stroke_num_segments(Stroke* stroke)
+{
+    i64 num_segments = max(stroke->num_points - 1, (i64)1);
+    return num_segments;
+}
+
+static i32
+next_stroke_z(RenderBackend* r)
+{
+    r->stroke_z = (r->stroke_z + 1) % (MAX_DEPTH_VALUE-1);
+    return r->stroke_z + 1;
+}
+
+// Everything that segment `i` of the stroke covers.
+static Rect
+segment_bounds(Stroke* stroke, i64 i)
+{
+    i64 j = min(i + 1, stroke->num_points - 1);
+    v2l a = stroke->points[i];
+    v2l b = stroke->points[j];
+    i64 radius = (i64)ceilf(stroke->brush.radius * max(stroke->pressures[i], stroke->pressures[j])) + 1;
+
+    Rect bounds;
+    bounds.left = min(a.x, b.x) - radius;
+    bounds.top = min(a.y, b.y) - radius;
+    bounds.right = max(a.x, b.x) + radius;
+    bounds.bottom = max(a.y, b.y) + radius;
+    return bounds;
+}
+
+// Soft strokes are drawn in one pass when the segments that cover any one
+// pixel are at most a few segments apart. Returns how far apart they can be,
+// or -1 when it is more than STROKE_SOFT_MAX_WINDOW. Segments are compared
+// by their bounds, so the window may be larger than it needs to be, but
+// never smaller.
+static i32
+stroke_soft_window(Stroke* stroke)
+{
+    const i64 num_segments = stroke_num_segments(stroke);
+    const i64 block_size = STROKE_SOFT_MAX_WINDOW / 2;
+    if ( num_segments > STROKE_MAX_POINTS ) {
+        return -1;
+    }
+
+    // Pairs up to STROKE_SOFT_MAX_WINDOW segments apart.
+    i32 window = 0;
+    for ( i64 i = 0; i < num_segments; ++i ) {
+        Rect bounds = segment_bounds(stroke, i);
+        for ( i64 j = min(i + STROKE_SOFT_MAX_WINDOW, num_segments - 1); j > i + window; --j ) {
+            if ( rect_intersects_rect(bounds, segment_bounds(stroke, j)) ) {
+                window = (i32)(j - i);
+                break;
+            }
+        }
+    }
+
+    // Segments further apart than that are in blocks that are not next to
+    // each other.
+    Rect blocks[STROKE_MAX_POINTS / (STROKE_SOFT_MAX_WINDOW / 2) + 1];
+    i64 num_blocks = 0;
+    for ( i64 i = 0; i < num_segments; ++i ) {
+        Rect bounds = segment_bounds(stroke, i);
+        if ( i % block_size == 0 ) {
+            blocks[num_blocks++] = bounds;
+        }
+        else {
+            blocks[num_blocks - 1] = rect_union(blocks[num_blocks - 1], bounds);
+        }
+    }
+    for ( i64 bi = 0; bi < num_blocks; ++bi ) {
+        for ( i64 bj = bi + 2; bj < num_blocks; ++bj ) {
+            if ( rect_intersects_rect(blocks[bi], blocks[bj]) ) {
+                return -1;
+            }
+        }
+    }
+
+    return window;
+}
+
+// Soft strokes in the stroke table get a window. Others take three passes.
+static void
+cook_soft_window(RenderElement* re, Stroke* stroke)
+{
+    re->soft_window = -1;
+    if ( re->slot != 0
+         && (re->flags & (RenderElementFlags_PRESSURE_TO_OPACITY | RenderElementFlags_DISTANCE_TO_OPACITY))
+         && !(re->flags & RenderElementFlags_ERASER) ) {
+        re->soft_window = stroke_soft_window(stroke);
+    }
+}
+
+// Writes `copies` copies of segments [first, first + count) of the stroke.
+// Only reads the stroke and `re`, so it can run on a worker thread.
+static void
+fill_stroke_segments(Stroke* stroke, RenderElement* re, i64 first, i64 count, i64 copies, StrokeSegment* out)
+{
+    i64 last_point = stroke->num_points - 1;
+    i64 out_i = 0;
+    for ( i64 i = first; i < first + count; ++i ) {
+        i64 j = min(i + 1, last_point);
+        v2l point_i = stroke->points[i] - re->origin;
+        v2l point_j = stroke->points[j] - re->origin;
+
+        StrokeSegment segment = {};
+        segment.pointa[0] = (i32)point_i.x;
+        segment.pointa[1] = (i32)point_i.y;
+        segment.pointb[0] = (i32)point_j.x;
+        segment.pointb[1] = (i32)point_j.y;
+        segment.pressures[0] = quantize_pressure(stroke->pressures[i]);
+        segment.pressures[1] = quantize_pressure(stroke->pressures[j]);
+        segment.slot = (u32)re->slot;
+
+        for ( i64 copy = 0; copy < copies; ++copy ) {
+            out[out_i++] = segment;
+        }
+    }
+}
+
+static void
+upload_stroke_segments(RenderElement* re, i64 first, i64 count, i64 copies, StrokeSegment* segments)
+{
+    if ( count > 0 ) {
+        gl::bind_buffer(GL_ARRAY_BUFFER, re->alloc.buffer);
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        (GLintptr)(re->alloc.offset + copies*first*(i64)sizeof(StrokeSegment)),
+                        (GLsizeiptr)(copies*count*(i64)sizeof(StrokeSegment)),
+                        segments);
+    }
+}
+
+// Everything that cooking does except generating and uploading segments:
+// pool space, stroke table slot and the RenderElement fields. Returns the
+// first segment that needs to be uploaded. The stroke table entry is written
+// after cook_soft_window.
+static i64
+prepare_render_element(RenderBackend* r, RenderElement* re, Stroke* stroke, i32 stroke_z, CookStrokeOpt cook_option)
+{
+    mlt_assert(stroke->num_points > 0);
+
+    const i64 num_segments = stroke_num_segments(stroke);
+    const i64 data_size = segment_copies()*num_segments*(i64)sizeof(StrokeSegment);
+
+    // Points are only appended to the working stroke until it is reset,
+    // so the segments we uploaded on previous frames are still good.
+    // Generate and upload the new ones only.
+    i64 first_segment = 0;
+    if ( cook_option == CookStroke_UPDATE_WORKING_STROKE && re->alloc.buffer != 0 ) {
+        first_segment = min(re->appendable_count, num_segments);
+    }
+    #if STROKE_DEBUG_VIZ
+        first_segment = 0;  // The debug buffer is re-created from scratch.
+    #endif
+
+    // TODO: check for GL_OUT_OF_MEMORY
+
+    if ( re->alloc.size < data_size ) {
+        // The working stroke grows every frame. Leave it room to grow into.
+        i64 size = data_size;
+        if ( cook_option == CookStroke_UPDATE_WORKING_STROKE ) {
+            size = min(2*size, (i64)BUFFER_POOL_MAX_ALLOCATION);
+        }
+        if ( re->alloc.buffer == 0 ) {
+            lru_push_front(r, re);
+            if ( r->stroke_batching ) {
+                re->slot = stroke_table_alloc_slot(r);
+            }
+        }
+        buffer_pool_alloc(&r->stroke_pool, &re->alloc, size);
+        first_segment = 0;
+    }
+
+    mlt_assert(r->scale > 0);
+
+    // Points are stored relative to the first one, so they fit in 32 bits
+    // wherever the stroke is.
+    if ( first_segment == 0 ) {
+        re->origin = stroke->points[0];
+    }
+    // The second point replaces the degenerate segment of a single point.
+    re->appendable_count = stroke->num_points > 1 ? num_segments : 0;
+    re->z = stroke_z;
+    re->count = num_segments;
+    re->color = { stroke->brush.color.r, stroke->brush.color.g, stroke->brush.color.b, stroke->brush.color.a };
+    re->radius = stroke->brush.radius;
+    re->min_opacity = stroke->brush.pressure_opacity_min;
+    re->hardness = stroke->brush.hardness;
+
+    re->flags = 0;
+    if (stroke->flags & StrokeFlag_ERASER) {
+        re->flags |= RenderElementFlags_ERASER;
+    }
+    if (stroke->flags & StrokeFlag_PRESSURE_TO_OPACITY) {
+        re->flags |= RenderElementFlags_PRESSURE_TO_OPACITY;
+    }
+    if (stroke->flags & StrokeFlag_DISTANCE_TO_OPACITY) {
+        re->flags |= RenderElementFlags_DISTANCE_TO_OPACITY;
+    }
+
+    return first_segment;
+}
+
+void
+gpu_cook_stroke(Arena* arena, RenderBackend* r, Stroke* stroke, CookStrokeOpt cook_option)
+{
+
+    RenderElement** p_render_element = reinterpret_cast<RenderElement**>(&stroke->render_handle);
+    RenderElement* render_element = *p_render_element;
+    if (render_element == NULL) {
+        render_element = arena_alloc_elem(arena, RenderElement);
+        *p_render_element = render_element;
+    }
+
+    const i32 stroke_z = next_stroke_z(r);
+
+    if ( cook_option == CookStroke_NEW && render_element->alloc.buffer != 0 ) {
+        // We already have our data cooked
+    }
+    else if ( stroke->num_points > 0 ) {
+        RenderElement* re = render_element;
+        const i64 copies = segment_copies();
+        const i64 first_segment = prepare_render_element(r, re, stroke, stroke_z, cook_option);
+        const i64 num_new_segments = re->count - first_segment;
+
+        cook_soft_window(re, stroke);
+        if ( re->slot != 0 ) {
+            stroke_table_update(r, re);
+        }
+
+        StrokeSegment* segments;
+
+        size_t scratch_size = copies*num_new_segments*sizeof(StrokeSegment);
+        #if STROKE_DEBUG_VIZ
+            scratch_size += num_new_segments*sizeof(v3f);
+        #endif
+        Arena scratch_arena = arena_push(arena, scratch_size);
+
+        segments = arena_alloc_array(&scratch_arena, copies*num_new_segments, StrokeSegment);
+        fill_stroke_segments(stroke, re, first_segment, num_new_segments, copies, segments);
+        upload_stroke_segments(re, first_segment, num_new_segments, copies, segments);
+
+        #if STROKE_DEBUG_VIZ
+            v3f* debug = arena_alloc_array(&scratch_arena, num_new_segments, v3f);
+            for ( i64 i = 0; i < num_new_segments; ++i ) {
+                if ( stroke->debug_flags[first_segment + i] & Stroke::INTERPOLATED ) {
+                    debug[i] = { 1.0f, 0.0f, 0.0f };
+                }
+                else {
+                    debug[i] = { 0.0f, 1.0f, 0.0f };
+                }
+            }
+            if ( re->vbo_debug == 0 ) {
+                glGenBuffers(1, &re->vbo_debug);
+            }
+            gl::bind_buffer(GL_ARRAY_BUFFER, re->vbo_debug);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(num_new_segments*sizeof(decltype(*debug))), debug, GL_DYNAMIC_DRAW);
+        #endif
+
+        arena_pop(&scratch_arena);
+    }
+}
+
+static void
+cook_job(void* data)
+{
+    CookJob* job = (CookJob*)data;
+    for ( i64 i = 0; i < job->count; ++i ) {
+        CookItem* item = &job->items[i];
+        fill_stroke_segments(item->stroke, item->re, 0, item->re->count, job->copies, item->segments);
+        cook_soft_window(item->re, item->stroke);
+    }
+}
+
+// Generates the segments of every stroke in r->cook_items, on the workers
+// if there is enough work, and uploads them.
+static void
+cook_queued_strokes(Arena* arena, RenderBackend* r)
+{
+    DArray<CookItem>* items = &r->cook_items;
+    DArray<CookJob>* jobs = &r->cook_jobs;
+    if ( items->count == 0 ) {
+        return;
+    }
+
+    const i64 copies = segment_copies();
+    i64 num_segments = 0;
+    for ( i64 i = 0; i < items->count; ++i ) {
+        num_segments += items->data[i].re->count;
+    }
+
+    // A single scratch block, split between the jobs.
+    Arena scratch_arena = arena_push(arena, copies*num_segments*sizeof(StrokeSegment));
+    reset(jobs);
+    CookJob* job = NULL;
+    i64 job_segments = 0;
+    for ( i64 i = 0; i < items->count; ++i ) {
+        CookItem* item = &items->data[i];
+        item->segments = arena_alloc_array(&scratch_arena, copies*item->re->count, StrokeSegment);
+        if ( job == NULL || job_segments >= COOK_SEGMENTS_PER_JOB ) {
+            job = push(jobs, CookJob{ item, 0, copies });
+            job_segments = 0;
+        }
+        job->count += 1;
+        job_segments += item->re->count;
+    }
+
+    if ( num_segments >= COOK_MIN_SEGMENTS_FOR_WORKERS ) {
+        workers_run(&r->clip_workers, cook_job, jobs->data, sizeof(CookJob), jobs->count);
+    }
+    else {
+        for ( i64 job_i = 0; job_i < jobs->count; ++job_i ) {
+            cook_job(&jobs->data[job_i]);
+        }
+    }
+
+    for ( i64 i = 0; i < items->count; ++i ) {
+        CookItem* item = &items->data[i];
+        upload_stroke_segments(item->re, 0, item->re->count, copies, item->segments);
+        if ( item->re->slot != 0 ) {
+            stroke_table_update(r, item->re);
+        }
+    }
+
+    arena_pop(&scratch_arena);
+    reset(items);
+}
+
+void
+gpu_free_strokes(RenderHandle* handles, i64 count, RenderBackend* r)
+{
+    for ( i64 i = 0; i < count; ++i ) {
+        RenderElement* re = get_render_element(handles[i]);
+        if ( re && re->alloc.buffer != 0 ) {
+            free_render_element(r, re);
+        }
+    }
+}
+
+void
+gpu_free_strokes(RenderBackend* r, Layer* layer)
+{
+    r->clip_cache_valid = false;
+    StrokeList* sl = &layer->strokes;
+    i64 count = sl->count;
+    for ( i64 bi = 0; bi < sl->num_buckets && count > 0; ++bi ) {
+        i64 n = min(count, sl->buckets[bi]->capacity);
+        gpu_free_strokes(sl->buckets[bi]->render_handles, n, r);
+        count -= n;
+    }
+}
+
+void
+gpu_free_strokes(RenderBackend* r, CanvasState* canvas)
+{
+    // Cached clip results point to the GPU data we are about to free.
+    r->clip_cache_valid = false;
+    if ( canvas->root_layer != NULL ) {
+        for ( Layer* l = canvas->root_layer;
               l != NULL;
               l = l->next ) {
-            StrokeList* sl = &l->strokes;
-            StrokeBucket* bucket = &sl->root;
-            i64 count = sl->count;
-            while ( bucket ) {
-                if ( count >= STROKELIST_BUCKET_COUNT ) {
-                    count -= STROKELIST_BUCKET_COUNT;
-                    gpu_free_strokes(bucket->data, STROKELIST_BUCKET_COUNT, r);
-                } else {
-                    gpu_free_strokes(bucket->data, count, r);
-                }
-                bucket = bucket->next;
+            gpu_free_strokes(r, l);
+        }
+    }
+    // Undone strokes keep their data in case they are redone.
+    for ( i64 i = 0; i < canvas->stroke_graveyard.count; ++i ) {
+        gpu_free_strokes(&canvas->stroke_graveyard.data[i].render_handle, 1, r);
+    }
+}
+
+void
+gpu_get_buffer_pool_stats(RenderBackend* r, BufferPoolStats* out_stats)
+{
+    *out_stats = buffer_pool_stats(&r->stroke_pool);
+}
+
+void
+gpu_get_stroke_memory_stats(RenderBackend* r, StrokeMemoryStats* out_stats)
+{
+    StrokeMemoryStats stats = {};
+    stats.resident_bytes = r->stroke_pool.used_bytes;
+    stats.budget_bytes = r->stroke_budget_bytes;
+    stats.evictions_last_clip = r->num_evictions_last_clip;
+    stats.recooks_last_clip = r->num_recooks_last_clip;
+    stats.evictions = r->num_evictions;
+    stats.recooks = r->num_recooks;
+    *out_stats = stats;
+}
+
+void
+gpu_set_stroke_budget(RenderBackend* r, i64 budget_bytes)
+{
+    r->stroke_budget_bytes = budget_bytes;
+}
+
+static void
+clip_cache_reset_layer(ClipCacheLayer* entry, Layer* l)
+{
+    entry->layer = l;
+    entry->layer_id = l ? l->id : 0;
+    entry->stroke_count = 0;
+    reset(&entry->elements);
+    reset(&entry->stroke_indices);
+}
+
+static u64
+effects_key(LayerEffect* effects)
+{
+    u64 key = 0;
+    for ( LayerEffect* e = effects; e != NULL; e = e->next ) {
+        if ( e->enabled ) {
+            i32 values[] = { e->type, e->blur.original_scale, e->blur.kernel_size };
+            for ( sz vi = 0; vi < array_count(values); ++vi ) {
+                key = (key ^ (u64)(u32)values[vi]) * 1099511628211ULL;  // FNV-1a
             }
         }
     }
+    return key;
+}
+
+static LayerKey
+layer_key(Layer* l)
+{
+    LayerKey key = {};
+    key.id = l->id;
+    key.generation = l->generation;
+    key.alpha = l->alpha;
+    key.effects = effects_key(l->effects);
+    return key;
+}
+
+static b32
+layer_key_equal(LayerKey* a, LayerKey* b)
+{
+    b32 equal =    a->id == b->id
+                && a->generation == b->generation
+                && a->alpha == b->alpha
+                && a->effects == b->effects;
+    return equal;
+}
+
+static void
+clip_job(void* data)
+{
+    ClipJob* job = (ClipJob*)data;
+    StrokeBucket* bucket = job->bucket;
+    i64 offset = job->offset;
+
+    i64 num_visible = cull_rects(bucket->left + offset, bucket->top + offset,
+                                 bucket->right + offset, bucket->bottom + offset,
+                                 job->count, job->rect, CullFlags_NONE, job->visible);
+
+    // Area might be 0 if the stroke is smaller than a pixel. We don't draw it
+    // in that case.
+    i64 num_drawn = 0;
+    for ( i64 vi = 0; vi < num_visible; ++vi ) {
+        i64 bi = offset + job->visible[vi];
+        i32 area = (bucket->right[bi]-bucket->left[bi]) * (bucket->bottom[bi]-bucket->top[bi]);
+        if ( area != 0 ) {
+            job->visible[num_drawn++] = job->visible[vi];
+        }
+    }
+    job->num_visible = num_drawn;
 }
 
 void
@@ -1270,6 +2241,8 @@ gpu_clip_strokes_and_update(Arena* arena,
                             i32 x, i32 y, i32 w, i32 h, ClipFlags flags)
 {
     DArray<RenderElement>* clip_array = &r->clip_array;
+    DArray<StrokeRange>* ranges = &r->clip_ranges;
+    DArray<ClipJob>* jobs = &r->clip_jobs;
 
     RenderElement layer_element = {};
     layer_element.flags |= RenderElementFlags_LAYER;
@@ -1277,6 +2250,17 @@ gpu_clip_strokes_and_update(Arena* arena,
     Rect screen_bounds = raster_to_canvas_bounding_rect(view, x, y, w, h, scale);
 
     reset(clip_array);
+    reset(&r->clip_layers);
+
+    if ( buffer_pool_compact(&r->stroke_pool) ) {
+        stroke_table_refresh(r);
+    }
+
+    r->clip_count += 1;
+    r->num_evictions_last_clip = 0;
+    r->num_recooks_last_clip = 0;
+    r->strokes_pending = false;
+    r->progressive_allowed = (flags & ClipFlags_PROGRESSIVE) != 0;
 
     if (screen_bounds.left != screen_bounds.right &&
         screen_bounds.top != screen_bounds.bottom) {
@@ -1285,94 +2269,168 @@ gpu_clip_strokes_and_update(Arena* arena,
             r->clipped_count = 0;
         }
         #endif
+
+        DArray<ClipCacheLayer>* cache = &r->clip_cache;
+        if ( !r->clip_cache_valid
+             || memcmp(&r->clip_cache_rect, &screen_bounds, sizeof(Rect)) != 0 ) {
+            for ( i64 ci = 0; ci < cache->count; ++ci ) {
+                clip_cache_reset_layer(&cache->data[ci], NULL);
+            }
+            r->clip_cache_rect = screen_bounds;
+            r->clip_cache_valid = true;
+        }
+
+        // Visibility pass. One job per bucket-sized run of strokes that the
+        // index could not rule out, in paint order. Strokes that the cache
+        // already covers are skipped.
+        reset(jobs);
+        i64 num_candidates = 0;
+        i64 num_visible_layers = 0;
         for ( Layer* l = root_layer;
               l != NULL;
               l = l->next ) {
             if ( !(l->flags & LayerFlags_VISIBLE) ) {
-                // Skip invisible layers.
                 continue;
             }
 
-            StrokeBucket* bucket = &l->strokes.root;
-            i64 bucket_i = 0;
+            if ( num_visible_layers == cache->count ) {
+                push(cache, ClipCacheLayer{});
+            }
+            ClipCacheLayer* entry = &cache->data[num_visible_layers++];
+            if ( entry->layer != l || entry->layer_id != l->id ) {
+                clip_cache_reset_layer(entry, l);
+            }
 
-            while ( bucket ) {
-                i64 count = 0;
-                if ( l->strokes.count < bucket_i * STROKELIST_BUCKET_COUNT ) {
-                    // There is an allocated bucket but we have already iterated
-                    // through all the actual strokes.
-                    break;
-                }
-                if ( l->strokes.count - bucket_i*STROKELIST_BUCKET_COUNT >= STROKELIST_BUCKET_COUNT ) {
-                    count = STROKELIST_BUCKET_COUNT;
-                } else {
-                    count = l->strokes.count % STROKELIST_BUCKET_COUNT;
+            // Drop elements for strokes that were popped since the last
+            // clip. Everything below `valid` is still correct.
+            i64 valid = min(min(entry->stroke_count, l->clip_valid_count), l->strokes.count);
+            while ( entry->stroke_indices.count > 0 && *peek(&entry->stroke_indices) >= valid ) {
+                pop(&entry->stroke_indices);
+                pop(&entry->elements);
+            }
+
+            if ( valid == l->strokes.count ) {
+                continue;
+            }
+
+            reset(ranges);
+            stroke_index_query(&l->stroke_index, screen_bounds, ranges);
+
+            for ( i64 range_i = 0; range_i < ranges->count; ++range_i ) {
+                StrokeRange range = ranges->data[range_i];
+                range.begin = max(range.begin, valid);
+                for ( i64 i = range.begin; i < range.end; ) {
+                    ClipJob job = {};
+                    job.layer = l;
+                    job.bucket = strokelist_bucket_at(&l->strokes, i, &job.offset);
+                    job.count = min(job.bucket->capacity - job.offset, range.end - i);
+                    job.first_index = i;
+                    job.rect = screen_bounds;
+                    push(jobs, job);
+
+                    num_candidates += job.count;
+                    i += job.count;
                 }
+            }
+        }
+
+        // Entries past the visible layers are stale. Clear them so that no
+        // two entries ever refer to the same layer.
+        for ( i64 ci = num_visible_layers; ci < cache->count; ++ci ) {
+            clip_cache_reset_layer(&cache->data[ci], NULL);
+        }
+
+        reserve(&r->clip_visible, num_candidates);
+        {
+            i32* visible = r->clip_visible.data;
+            for ( i64 job_i = 0; job_i < jobs->count; ++job_i ) {
+                jobs->data[job_i].visible = visible;
+                visible += jobs->data[job_i].count;
+            }
+        }
+
+        if ( num_candidates >= CLIP_MIN_STROKES_FOR_WORKERS ) {
+            workers_run(&r->clip_workers, clip_job, jobs->data, sizeof(ClipJob), jobs->count);
+        }
+        else {
+            for ( i64 job_i = 0; job_i < jobs->count; ++job_i ) {
+                clip_job(&jobs->data[job_i]);
+            }
+        }
+
+        // Pool space is allocated here, in paint order. Segments are generated
+        // by cook_queued_strokes, once every layer has been visited.
+        reset(&r->cook_items);
+        i64 cook_segments = 0;
+        i64 job_i = 0;
+        i64 cache_i = 0;
+        for ( Layer* l = root_layer;
+              l != NULL;
+              l = l->next ) {
+            if ( !(l->flags & LayerFlags_VISIBLE) ) {
+                // Skip invisible layers.
+                continue;
+            }
 
-                Rect bbox = bucket->bounding_rect;
-
-                b32 bucket_outside =   screen_bounds.left   > bbox.right
-                                    || screen_bounds.top    > bbox.bottom
-                                    || screen_bounds.right  < bbox.left
-                                    || screen_bounds.bottom < bbox.top;
-
-                if ( !bucket_outside ) {
-                    for ( i64 i = 0; i < count; ++i ) {
-                        Stroke* s = &bucket->data[i];
-
-                        if ( s != NULL ) {
-                            Rect bounds = s->bounding_rect;
-
-                            b32 stroke_outside =   screen_bounds.left   > bounds.right
-                                                || screen_bounds.top    > bounds.bottom
-                                                || screen_bounds.right  < bounds.left
-                                                || screen_bounds.bottom < bounds.top;
-
-                            i32 area = (bounds.right-bounds.left) * (bounds.bottom-bounds.top);
-                            // Area might be 0 if the stroke is smaller than
-                            // a pixel. We don't draw it in that case.
-                            if ( !stroke_outside && area!=0 ) {
-                                gpu_cook_stroke(arena, r, s);
-                                push(clip_array, *get_render_element(s->render_handle));
-                            }
-                            else if ( stroke_outside && ( flags & ClipFlags_UPDATE_GPU_DATA ) ) {
-                                // If it is far away, delete.
-                                i32 distance = MLT_ABS(bounds.left - x + bounds.top - y);
-                                const i32 min_number_of_screens = 4;
-                                if (    bounds.top    < y - min_number_of_screens*h
-                                     || bounds.bottom > y+h + min_number_of_screens*h
-                                     || bounds.left   > x+w + min_number_of_screens*w
-                                     || bounds.right  < x - min_number_of_screens*w ) {
-                                    gpu_free_strokes(s, 1, r);
-                                }
-                            }
+            ClipCacheLayer* entry = &cache->data[cache_i++];
+            for ( ; job_i < jobs->count && jobs->data[job_i].layer == l; ++job_i ) {
+                ClipJob* job = &jobs->data[job_i];
+                StrokeBucket* bucket = job->bucket;
+                for ( i64 vi = 0; vi < job->num_visible; ++vi ) {
+                    i64 bi = job->offset + job->visible[vi];
+                    Stroke* s = &bucket->data[bi];
+                    RenderElement* re = get_render_element(bucket->render_handles[bi]);
+                    if ( re == NULL || re->alloc.buffer == 0 ) {
+                        if ( !(flags & ClipFlags_COOK_ALL) && cook_segments >= COOK_MAX_SEGMENTS_PER_CLIP ) {
+                            // Drawn on a later frame.
+                            r->strokes_pending = true;
+                            continue;
                         }
-                    }
-                }
-                else if ( flags & ClipFlags_UPDATE_GPU_DATA ) {
-                    gpu_free_strokes(bucket->data, count, r);
-                }
-                #if MILTON_ENABLE_PROFILING
-                {
-                    for ( i64 i = 0; i < count; ++i ) {
-                        Stroke* s = &bucket->data[i];
-                        RenderElement* re = get_render_element(s->render_handle);
-                        if ( re && re->vbo_stroke != 0 ) {
-                            r->clipped_count++;
+                        if ( re == NULL ) {
+                            re = arena_alloc_elem(arena, RenderElement);
+                            strokelist_set_render_handle(bucket, bi, reinterpret_cast<RenderHandle>(re));
                         }
+                        else {
+                            r->num_recooks_last_clip += 1;
+                        }
+                        #if STROKE_DEBUG_VIZ
+                            gpu_cook_stroke(arena, r, s);
+                        #else
+                            prepare_render_element(r, re, s, next_stroke_z(r), CookStroke_NEW);
+                            push(&r->cook_items, CookItem{ s, re, NULL });
+                        #endif
+                        cook_segments += re->count;
                     }
+                    push(&entry->elements, re);
+                    push(&entry->stroke_indices, job->first_index + job->visible[vi]);
                 }
-                #endif
-                bucket = bucket->next;
-                bucket_i += 1;
             }
+            entry->stroke_count = l->strokes.count;
+            l->clip_valid_count = l->strokes.count;
+
+            ClipLayer* clip_layer = push(&r->clip_layers, ClipLayer{});
+            clip_layer->key = layer_key(l);
+            clip_layer->first_element = clip_array->count;
+
+            for ( i64 ei = 0; ei < entry->elements.count; ++ei ) {
+                RenderElement* re = entry->elements.data[ei];
+                lru_touch(r, re);
+                push(clip_array, *re);
+            }
+            #if MILTON_ENABLE_PROFILING
+            {
+                r->clipped_count += entry->elements.count;
+            }
+            #endif
 
             // Add the working stroke on the current layer.
             if ( working_stroke->layer_id == l->id ) {
                 if ( working_stroke->num_points > 0 ) {
                     gpu_cook_stroke(arena, r, working_stroke, CookStroke_UPDATE_WORKING_STROKE);
 
-                    push(clip_array, *get_render_element(working_stroke->render_handle));
+                    RenderElement* re = get_render_element(working_stroke->render_handle);
+                    lru_touch(r, re);
+                    push(clip_array, *re);
                 }
             }
 
@@ -1380,7 +2438,88 @@ gpu_clip_strokes_and_update(Arena* arena,
             p->layer_alpha = l->alpha;
             p->effects = l->effects;
         }
+
+        cook_queued_strokes(arena, r);
     }
+
+    // The layer of the working stroke is the one that changes while drawing.
+    r->composite_pivot = r->clip_layers.count;
+    for ( i64 ci = 0; ci < r->clip_layers.count; ++ci ) {
+        if ( r->clip_layers.data[ci].key.id == working_stroke->layer_id ) {
+            r->composite_pivot = ci;
+        }
+    }
+    if ( flags & ClipFlags_COOK_ALL ) {
+        r->composite_pivot = -1;
+    }
+
+    r->num_recooks += r->num_recooks_last_clip;
+    if ( flags & ClipFlags_UPDATE_GPU_DATA ) {
+        evict_strokes(r);
+    }
+
+    // The cache must not remember the strokes that were left out.
+    if ( r->strokes_pending ) {
+        r->clip_cache_valid = false;
+    }
+}
+
+b32
+gpu_has_pending_strokes(RenderBackend* r)
+{
+    return r->strokes_pending;
+}
+
+b32
+gpu_has_pending_redraw(RenderBackend* r)
+{
+    return r->progressive.active;
+}
+
+i32
+gpu_get_progressive_redraw_frames(RenderBackend* r)
+{
+    return r->progressive.last_num_frames;
+}
+
+// Program that draws the stroke in a batch: stroke_batch_program for the fast
+// path and stroke_soft_program for soft strokes. 0 when it is drawn on its own.
+static GLuint
+batch_program(RenderBackend* r, RenderElement* re)
+{
+    GLuint program = 0;
+    if (    r->stroke_batching
+         && re->slot != 0
+         && re->count > 0
+         && !(re->flags & (RenderElementFlags_LAYER | RenderElementFlags_ERASER)) ) {
+        if ( !(re->flags & (RenderElementFlags_PRESSURE_TO_OPACITY | RenderElementFlags_DISTANCE_TO_OPACITY)) ) {
+            program = r->stroke_batch_program;
+        }
+        else if ( re->soft_window >= 0 ) {
+            program = r->stroke_soft_program;
+        }
+    }
+    return program;
+}
+
+// Draws the strokes in batch_firsts and batch_counts, which all live in `page`.
+static void
+stroke_batch_pass(RenderBackend* r, GLuint program, GLuint page)
+{
+    gl::use_program(program);
+    glBindVertexArray(r->vao_stroke_batch);
+
+    glActiveTexture(GL_TEXTURE1);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, page);
+    glActiveTexture(GL_TEXTURE0);
+
+    glMultiDrawArrays(GL_TRIANGLES, r->batch_firsts.data, r->batch_counts.data,
+                      (GLsizei)r->batch_counts.count);
+
+    glBindVertexArray(r->vao);
+    #if MILTON_ENABLE_PROFILING
+        r->stroke_draw_calls += 1;
+    #endif
 }
 
 static void
@@ -1390,9 +2529,9 @@ gpu_fill_with_texture(RenderBackend* r, float alpha = 1.0f)
     gl::use_program(r->texture_fill_program);
     gl::set_uniform_f(r->texture_fill_program, "u_alpha", alpha);
     {
-        GLint t_loc = glGetAttribLocation(r->texture_fill_program, "a_position");
+        GLint t_loc = gl::attrib_location(r->texture_fill_program, "a_position");
         if ( t_loc >= 0 ) {
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
+            gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
             glEnableVertexAttribArray((GLuint)t_loc);
             glVertexAttribPointer(/*attrib location*/ (GLuint)t_loc,
                                   /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
@@ -1402,41 +2541,288 @@ gpu_fill_with_texture(RenderBackend* r, float alpha = 1.0f)
     }
 }
 
-enum BoxFilterPass
+enum BoxFilterPass
+{
+    BoxFilterPass_VERTICAL = 0,
+    BoxFilterPass_HORIZONTAL = 1,
+    BoxFilterPass_RESAMPLE = 2,
+};
+// `texture_size` is the size of the bound texture. The image is in its
+// bottom-left `source_size` pixels.
+static void
+box_filter_pass(RenderBackend* r, int kernel_size, int direction,
+                v2i texture_size, v2i source_size, f32 step = 1.0f)
+{
+    gl::use_program(r->blur_program);
+    gl::set_uniform_i(r->blur_program, "u_kernel_size", kernel_size);
+    GLint t_loc = gl::attrib_location(r->blur_program, "a_position");
+    if ( t_loc >= 0 ) {
+        gl::set_uniform_i(r->blur_program, "u_direction", direction);
+        gl::set_uniform_vec2(r->blur_program, "u_texture_size", (f32)texture_size.w, (f32)texture_size.h);
+        gl::set_uniform_vec2(r->blur_program, "u_source_size", (f32)source_size.w, (f32)source_size.h);
+        gl::set_uniform_f(r->blur_program, "u_step", step);
+        {
+            gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
+            glEnableVertexAttribArray((GLuint)t_loc);
+            glVertexAttribPointer(/*attrib location*/ (GLuint)t_loc,
+                                  /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
+                                  /*stride*/ 0, /*ptr*/ 0);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        }
+    }
+}
+
+// Blurs layer_texture in place. (x, y, w, h) is the scissor rect of the
+// frame, inside render_target_size. Kernels wider than BLUR_MAX_KERNEL_SIZE
+// run on a copy of the layer that is halved until they fit, so the cost per
+// pixel does not grow with the zoom level. Expects blending and depth
+// testing to be off.
+static void
+blur_layer(RenderBackend* r, GLenum texture_target, GLuint layer_texture, int kernel_size,
+           i32 x, i32 y, i32 w, i32 h)
+{
+    v2i texture_size = { r->width, r->height };
+    v2i target_size = render_target_size(r);
+
+    int level = 0;
+    if ( texture_target == GL_TEXTURE_2D ) {
+        while ( (kernel_size >> level) > BLUR_MAX_KERNEL_SIZE && level < BLUR_MAX_LEVELS ) {
+            level += 1;
+        }
+    }
+
+    if ( level == 0 ) {
+        // Three box filter iterations approximate a Gaussian blur. Six passes
+        // between the two textures leave the result in layer_texture.
+        GLuint in_texture  = layer_texture;
+        GLuint out_texture = r->eraser_texture;
+        for ( int blur_iter = 0; blur_iter < 3; ++blur_iter ) {
+            // Box filter implementation uses the separable property.
+            // Apply vertical pass and then horizontal pass.
+            for ( int direction = BoxFilterPass_VERTICAL; direction <= BoxFilterPass_HORIZONTAL; ++direction ) {
+                glBindTexture(texture_target, in_texture);
+                glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          texture_target, out_texture, 0);
+                box_filter_pass(r, kernel_size, direction, texture_size, target_size);
+                swap(out_texture, in_texture);
+            }
+        }
+    }
+    else {
+        v2i half_size = { (r->width + 1) / 2, (r->height + 1) / 2 };
+
+        GLuint src = layer_texture;
+        v2i src_texture_size = texture_size;
+        v2i src_size = target_size;
+        int next = 0;
+
+        auto pass = [&](int pass_kernel_size, int direction, v2i size, f32 step) {
+            GLuint dst = r->blur_textures[next];
+            next = 1 - next;
+            glViewport(0, 0, size.w, size.h);
+            glScissor(0, 0, size.w, size.h);
+            glBindTexture(GL_TEXTURE_2D, src);
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst, 0);
+            box_filter_pass(r, pass_kernel_size, direction, src_texture_size, src_size, step);
+            src = dst;
+            src_texture_size = half_size;
+            src_size = size;
+        };
+
+        for ( int li = 1; li <= level; ++li ) {
+            v2i size = { (target_size.w + (1 << li) - 1) >> li, (target_size.h + (1 << li) - 1) >> li };
+            pass(0, BoxFilterPass_RESAMPLE, size, 2.0f);
+        }
+        int level_kernel_size = max(1, (kernel_size + (1 << (level - 1))) >> level);
+        for ( int blur_iter = 0; blur_iter < 3; ++blur_iter ) {
+            pass(level_kernel_size, BoxFilterPass_VERTICAL, src_size, 1.0f);
+            pass(level_kernel_size, BoxFilterPass_HORIZONTAL, src_size, 1.0f);
+        }
+
+        // Back to full size, with bilinear filtering.
+        glViewport(0, 0, target_size.w, target_size.h);
+        glScissor(x, y, w, h);
+        glBindTexture(GL_TEXTURE_2D, src);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer_texture, 0);
+        box_filter_pass(r, 0, BoxFilterPass_RESAMPLE, src_texture_size, src_size, 1.0f / (f32)(1 << level));
+    }
+}
+
+static CompositeView
+current_composite_view(RenderBackend* r, f32 background_alpha)
+{
+    CompositeView view = r->composite_view;
+    view.scale = r->scale;
+    view.background_color = r->background_color;
+    view.background_alpha = background_alpha;
+    return view;
+}
+
+static b32
+composite_view_equal(CompositeView* a, CompositeView* b)
+{
+    b32 equal =    a->pan_center == b->pan_center
+                && a->zoom_center == b->zoom_center
+                && a->scale == b->scale
+                && a->angle == b->angle
+                && a->width == b->width
+                && a->height == b->height
+                && a->background_color == b->background_color
+                && a->background_alpha == b->background_alpha;
+    return equal;
+}
+
+// True if `cache` holds the composite of `count` layers, seen from `view`.
+static b32
+composite_cache_matches(CompositeCache* cache, CompositeView* view, ClipLayer* layers, i64 count)
+{
+    b32 matches =    cache->valid
+                  && cache->keys.count == count
+                  && composite_view_equal(&cache->view, view);
+    for ( i64 li = 0; matches && li < count; ++li ) {
+        matches = layer_key_equal(&cache->keys.data[li], &layers[li].key);
+    }
+    return matches;
+}
+
+static void
+composite_cache_store(CompositeCache* cache, CompositeView* view, ClipLayer* layers, i64 count)
+{
+    reset(&cache->keys);
+    for ( i64 li = 0; li < count; ++li ) {
+        push(&cache->keys, layers[li].key);
+    }
+    cache->view = *view;
+    cache->valid = true;
+}
+
+static b32
+progressive_redraw_matches(ProgressiveRedraw* pr, CompositeView* view, ClipLayer* layers, i64 num_layers,
+                           i64 pivot, i64 num_elements)
+{
+    b32 matches =    pr->active
+                  && pr->pivot == pivot
+                  && pr->num_elements == num_elements
+                  && pr->keys.count == num_layers
+                  && composite_view_equal(&pr->view, view);
+    for ( i64 li = 0; matches && li < num_layers; ++li ) {
+        matches = layer_key_equal(&pr->keys.data[li], &layers[li].key);
+    }
+    return matches;
+}
+
+// Folds the speed of one slice into the estimate for the next budget.
+static void
+progressive_redraw_measure(ProgressiveRedraw* pr, i64 num_segments, f32 ms)
+{
+    if ( num_segments > 0 ) {
+        f32 speed = (f32)num_segments / max(ms, 0.1f);
+        pr->segments_per_ms = pr->segments_per_ms > 0 ? 0.5f * (pr->segments_per_ms + speed) : speed;
+    }
+}
+
+static void
+progressive_redraw_store(ProgressiveRedraw* pr, CompositeView* view, ClipLayer* layers, i64 num_layers,
+                         i64 pivot, i64 num_elements)
+{
+    reset(&pr->keys);
+    for ( i64 li = 0; li < num_layers; ++li ) {
+        push(&pr->keys, layers[li].key);
+    }
+    pr->view = *view;
+    pr->pivot = pivot;
+    pr->num_elements = num_elements;
+    pr->active = true;
+}
+
+static b32
+layer_has_blur(Layer* l)
 {
-    BoxFilterPass_VERTICAL = 0,
-    BoxFilterPass_HORIZONTAL = 1,
-};
-static void
-box_filter_pass(RenderBackend* r, int kernel_size, int direction)
+    for ( LayerEffect* e = l->effects; e != NULL; e = e->next ) {
+        if ( e->enabled && e->type == LayerEffectType_BLUR ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+b32
+gpu_effects_are_cached(RenderBackend* r, Layer* root_layer, i32 working_layer_id)
 {
-    gl::use_program(r->blur_program);
-    gl::set_uniform_i(r->blur_program, "u_kernel_size", kernel_size);
-    GLint t_loc = glGetAttribLocation(r->blur_program, "a_position");
-    if ( t_loc >= 0 ) {
-        gl::set_uniform_i(r->blur_program, "u_direction", direction);
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
-            glEnableVertexAttribArray((GLuint)t_loc);
-            glVertexAttribPointer(/*attrib location*/ (GLuint)t_loc,
-                                  /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
-                                  /*stride*/ 0, /*ptr*/ 0);
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    CompositeView view = current_composite_view(r, 1.0f);
+
+    // Compare with the caches the same split that the clip pass makes
+    // around the working layer.
+    CompositeCache* cache = &r->composite_below;
+    i64 num_keys = 0;
+    b32 matches = true;
+    b32 has_blur = false;
+    b32 cached = true;
+    for ( Layer* l = root_layer; l != NULL; l = l->next ) {
+        if ( !(l->flags & LayerFlags_VISIBLE) ) {
+            continue;
         }
+        if ( l->id == working_layer_id ) {
+            if ( layer_has_blur(l) ) {
+                return false;
+            }
+            cached = !has_blur || (matches && num_keys == cache->keys.count);
+            cache = &r->composite_above;
+            num_keys = 0;
+            matches = true;
+            has_blur = false;
+            continue;
+        }
+        LayerKey key = layer_key(l);
+        matches =    matches
+                  && cache->valid
+                  && composite_view_equal(&cache->view, &view)
+                  && num_keys < cache->keys.count
+                  && layer_key_equal(&cache->keys.data[num_keys], &key);
+        num_keys += 1;
+        has_blur = has_blur || layer_has_blur(l);
     }
+    cached = cached && (!has_blur || (matches && num_keys == cache->keys.count));
+    return cached;
 }
 
+// Draws `src` into `dst`, over what is there or replacing it. The caller
+// restores the color attachment, blending and depth testing.
 static void
+draw_texture_into(RenderBackend* r, GLenum texture_target, GLuint src, GLuint dst, b32 blend)
+{
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target, dst, 0);
+    glBindTexture(texture_target, src);
+    glDisable(GL_DEPTH_TEST);
+    if ( blend ) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    else {
+        glDisable(GL_BLEND);
+    }
+    gpu_fill_with_texture(r);
+}
+
+void
 gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
-                  i32 view_width, i32 view_height, float background_alpha=1.0f)
+                  i32 view_width, i32 view_height, float background_alpha)
 {
     PUSH_GRAPHICS_GROUP("render_canvas");
 
-    // FLip it. GL is bottom-left.
-    i32 x = view_x;
-    i32 y = r->height - (view_y+view_height);
-    i32 w = view_width;
-    i32 h = view_height;
+    add_damage(r, screen_rect(view_x, view_y, view_x + view_width, view_y + view_height));
+
+    // Flip it. GL is bottom-left. At reduced resolutions, the rect is scaled
+    // down and rounded out to whole pixels of the render target.
+    i32 d = r->resolution_divisor;
+    v2i target_size = render_target_size(r);
+    i32 gl_bottom = r->height - (view_y + view_height);
+    i32 gl_top = r->height - view_y;
+    i32 x = view_x / d;
+    i32 y = gl_bottom / d;
+    i32 w = (view_x + view_width + d - 1) / d - x;
+    i32 h = (gl_top + d - 1) / d - y;
+    glViewport(0, 0, target_size.w, target_size.h);
     glScissor(x, y, w, h);
 
     glClearDepth(0.0f);
@@ -1452,92 +2838,167 @@ gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
 
     GLuint layer_texture = r->helper_texture;
 
-    if ( background_alpha != 0.0f ) {
-        // Not sure if this works OK with background_alpha != 1.0f
-        glClearColor(r->background_color.r, r->background_color.g,
-                     r->background_color.b, background_alpha);
-    } else {
-        glClearColor(0,0,0,0);
+    DArray<RenderElement>* clip_array = &r->clip_array;
+
+    CompositeView view = current_composite_view(r, background_alpha);
+
+    ClipLayer* layers = r->clip_layers.data;
+    i64 num_layers = r->clip_layers.count;
+    i64 pivot = r->composite_pivot;
+
+    b32 full_screen = x == 0 && y == 0 && w == target_size.w && h == target_size.h;
+
+    // A progressive redraw goes on from where the last frame left it if it
+    // is still drawing the same thing. Anything else starts over.
+    ProgressiveRedraw* pr = &r->progressive;
+    b32 progressive = r->progressive_allowed && full_screen && !r->strokes_pending;
+    b32 resume =    progressive
+                 && progressive_redraw_matches(pr, &view, layers, num_layers, pivot, clip_array->count);
+    pr->active = false;
+    if ( progressive ) {
+        pr->num_frames += 1;
+    }
+    else if ( full_screen ) {
+        pr->num_frames = 0;
+    }
+    b32 budgeted = progressive && pr->num_frames < PROGRESSIVE_REDRAW_MAX_FRAMES;
+    f32 segments_per_ms = pr->segments_per_ms > 0 ? pr->segments_per_ms : PROGRESSIVE_REDRAW_SEGMENTS_PER_MS;
+    i64 budget_segments = max((i64)(segments_per_ms * PROGRESSIVE_REDRAW_BUDGET_MS),
+                              (i64)PROGRESSIVE_REDRAW_MIN_SEGMENTS);
+    i64 drawn_segments = 0;
+    u64 slice_start = perf_counter();
+
+    // The result of a query is usually there a frame after it ended. Only
+    // one query is in flight, so slices are timed while none is pending.
+    b32 timed_slice = false;
+    if ( pr->timer_query != 0 ) {
+        if ( pr->timer_pending ) {
+            GLint available = 0;
+            glGetQueryObjectiv(pr->timer_query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if ( available ) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(pr->timer_query, GL_QUERY_RESULT, &ns);
+                progressive_redraw_measure(pr, pr->timed_segments, (f32)ns / 1000000.0f);
+                pr->timer_pending = false;
+            }
+        }
+        if ( budgeted && !pr->timer_pending ) {
+            glBeginQuery(GL_TIME_ELAPSED, pr->timer_query);
+            timed_slice = true;
+        }
+    }
+
+    b32 use_above;
+    b32 fill_below;
+    b32 fill_above;
+    i64 first_element = 0;
+    i64 layer_i = 0;
+    // Layers are composited here. While filling composite_above, it is the
+    // layers above the working layer, on a transparent texture.
+    GLuint composite_texture = r->canvas_texture;
+
+    if ( resume ) {
+        first_element = pr->next_element;
+        layer_i = pr->layer_i;
+        composite_texture = pr->composite_texture;
+        use_above = pr->use_above;
+        fill_below = pr->fill_below;
+        fill_above = pr->fill_above;
+        r->last_composite_view = view;
+
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                  layer_texture, 0);
     }
+    else {
+        if ( background_alpha != 0.0f ) {
+            // Not sure if this works OK with background_alpha != 1.0f
+            glClearColor(r->background_color.r, r->background_color.g,
+                         r->background_color.b, background_alpha);
+        } else {
+            glClearColor(0,0,0,0);
+        }
 
-    glBindTexture(texture_target, r->eraser_texture);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                  r->canvas_texture, 0);
 
-    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                              r->eraser_texture, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-    glClear(GL_COLOR_BUFFER_BIT);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                  layer_texture, 0);
+        glClearColor(0,0,0,0);
 
-    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                              r->canvas_texture, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glClear(GL_COLOR_BUFFER_BIT);
+        // Decide which composite caches to read and which ones to fill.
+        // Caches are only filled from complete, full-screen redraws of a view
+        // that stayed the same since the last frame.
+        b32 can_fill =    pivot >= 0
+                       && !r->strokes_pending
+                       && full_screen
+                       && composite_view_equal(&view, &r->last_composite_view);
+        r->last_composite_view = view;
 
-    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                              layer_texture, 0);
-    glClearColor(0,0,0,0);
+        b32 use_below = pivot > 0 && composite_cache_matches(&r->composite_below, &view, layers, pivot);
+        fill_below = pivot > 0 && !use_below && can_fill;
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        b32 above_cacheable = pivot >= 0 && pivot + 1 < num_layers;
+        use_above = above_cacheable && composite_cache_matches(&r->composite_above, &view,
+                                                              layers + pivot + 1, num_layers - pivot - 1);
+        fill_above = above_cacheable && !use_above && can_fill;
+
+        if ( use_below ) {
+            first_element = pivot < num_layers ? layers[pivot].first_element : clip_array->count;
+            layer_i = pivot;
+
+            draw_texture_into(r, texture_target, r->composite_below.texture, r->canvas_texture, /*blend*/false);
+
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                      layer_texture, 0);
+        }
+    }
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     glDepthFunc(GL_NOTEQUAL);
 
-    DArray<RenderElement>* clip_array = &r->clip_array;
+    #if MILTON_ENABLE_PROFILING
+        r->stroke_draw_calls = 0;
+    #endif
 
     PUSH_GRAPHICS_GROUP("render elements");
-    for ( i64 i = 0; i < (i64)clip_array->count; i++ ) {
+    for ( i64 i = first_element; i < (i64)clip_array->count; i++ ) {
         RenderElement* re = &clip_array->data[i];
 
+        if ( budgeted && drawn_segments >= budget_segments && !(re->flags & RenderElementFlags_LAYER) ) {
+            // Out of time. The next frame goes on from this element.
+            progressive_redraw_store(pr, &view, layers, num_layers, pivot, clip_array->count);
+            pr->next_element = i;
+            pr->layer_i = layer_i;
+            pr->composite_texture = composite_texture;
+            pr->use_above = use_above;
+            pr->fill_below = fill_below;
+            pr->fill_above = fill_above;
+            break;
+        }
+
         if ( re->flags & RenderElementFlags_LAYER ) {
 
             // Layer render element.
             // The current framebuffer's color attachment is layer_texture.
 
             // Before we fill canvas_texture with the contents of
-            // layer_texture, we apply all layer effects.
-
-            GLuint layer_post_effects = layer_texture;
+            // layer_texture, we apply all layer effects. They leave their
+            // output in layer_texture.
             {
-                // eraser_texture will be rewritten below with the
-                // contents of canvas_texture. We use it here for
-                // the layer effects.
-                GLuint out_texture = r->eraser_texture;
-                GLuint in_texture  = layer_texture;
                 glDisable(GL_BLEND);
                 glDisable(GL_DEPTH_TEST);
                 for ( LayerEffect* e = re->effects; e != NULL; e = e->next ) {
                     if ( e->enabled == false ) { continue; }
 
                     if ( e->type == LayerEffectType_BLUR ) {
-                        glBindTexture(texture_target, in_texture);
-                        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                                  texture_target, out_texture, 0);
-
-                        // Three box filter iterations approximate a Gaussian blur
-                        for (int blur_iter = 0; blur_iter < 3; ++blur_iter) {
-                            // Box filter implementation uses the separable property.
-                            // Apply horizontal pass and then vertical pass.
-                            int kernel_size = e->blur.kernel_size * e->blur.original_scale / r->scale;
-                            box_filter_pass(r, kernel_size, BoxFilterPass_VERTICAL);
-                            swap(out_texture, in_texture);
-                            glBindTexture(texture_target, in_texture);
-                            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                                      texture_target, out_texture, 0);
-
-
-                            box_filter_pass(r, kernel_size, BoxFilterPass_HORIZONTAL);
-                            swap(out_texture, in_texture);
-                            glBindTexture(texture_target, in_texture);
-                            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                                      texture_target, out_texture, 0);
-
-                        }
-                        swap(out_texture, in_texture);
-                        glBindTexture(texture_target, in_texture);
-                        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                                  texture_target, out_texture, 0);
-                        layer_post_effects = out_texture;
+                        int kernel_size = e->blur.kernel_size * e->blur.original_scale / r->scale;
+                        blur_layer(r, texture_target, layer_texture, kernel_size, x, y, w, h);
                     }
                 }
                 glEnable(GL_BLEND);
@@ -1548,8 +3009,8 @@ gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
             // Blit layer contents to canvas_texture
             {
                 glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                          texture_target, r->canvas_texture, 0);
-                glBindTexture(texture_target, layer_post_effects);
+                                          texture_target, composite_texture, 0);
+                glBindTexture(texture_target, layer_texture);
 
                 glDisable(GL_DEPTH_TEST);
 
@@ -1558,28 +3019,60 @@ gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
                 glEnable(GL_DEPTH_TEST);
             }
 
-            // Copy canvas_texture's contents to the eraser_texture.
-            {
-                glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                                          texture_target, r->eraser_texture, 0);
-                glBindTexture(texture_target, r->canvas_texture);
-
-                glDisable(GL_BLEND);
-                glDisable(GL_DEPTH_TEST);
-
-                gpu_fill_with_texture(r);
+            if ( fill_below && layer_i == pivot - 1 ) {
+                draw_texture_into(r, texture_target, r->canvas_texture, r->composite_below.texture, /*blend*/false);
+                composite_cache_store(&r->composite_below, &view, layers, pivot);
+            }
 
-                // Clear the layer texture.
+            // Clear the layer texture.
+            {
                 glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                                           texture_target, layer_texture, 0);
                 glClearColor(0,0,0,0);
                 glClear(GL_COLOR_BUFFER_BIT);
 
-                glBindTexture(texture_target, r->eraser_texture);
-
                 glEnable(GL_DEPTH_TEST);
                 glEnable(GL_BLEND);
             }
+
+            if ( layer_i == pivot && use_above ) {
+                draw_texture_into(r, texture_target, r->composite_above.texture, r->canvas_texture, /*blend*/true);
+                break;
+            }
+            if ( layer_i == pivot && fill_above ) {
+                composite_texture = r->composite_above.texture;
+                glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          texture_target, composite_texture, 0);
+                glClear(GL_COLOR_BUFFER_BIT);
+                glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                          texture_target, layer_texture, 0);
+            }
+            layer_i += 1;
+        }
+        else if ( batch_program(r, re) != 0 ) {
+            // One draw for this stroke and the ones after it that can be
+            // batched with the same program and are in the same page. Draws
+            // happen in order, so blending is the same as drawing them one by
+            // one.
+            GLuint program = batch_program(r, re);
+            GLuint page = re->alloc.buffer;
+            reset(&r->batch_firsts);
+            reset(&r->batch_counts);
+            i64 end = i;
+            for ( ; end < clip_array->count; ++end ) {
+                RenderElement* b = &clip_array->data[end];
+                if ( batch_program(r, b) != program || b->alloc.buffer != page ) {
+                    break;
+                }
+                if ( budgeted && end > i && drawn_segments >= budget_segments ) {
+                    break;
+                }
+                push(&r->batch_firsts, (GLint)(6 * (b->alloc.offset / (i64)sizeof(StrokeSegment))));
+                push(&r->batch_counts, (GLsizei)(6 * b->count));
+                drawn_segments += b->count;
+            }
+            stroke_batch_pass(r, program, page);
+            i = end - 1;
         }
         // If this render element is not a layer, then it is a stroke.
         else {
@@ -1591,24 +3084,50 @@ gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
                 gl::set_uniform_vec4(program_for_stroke, "u_brush_color", 1, re->color.d);
                 gl::set_uniform_i(program_for_stroke, "u_radius", re->radius);
 
-                DEBUG_gl_validate_buffer(re->vbo_stroke);
-                DEBUG_gl_validate_buffer(re->vbo_pointa);
-                DEBUG_gl_validate_buffer(re->vbo_pointb);
-                DEBUG_gl_validate_buffer(re->indices);
+                v2i origin = relative_to_render_center(r, re->origin);
+                gl::set_uniform_vec2i(program_for_stroke, "u_stroke_origin", 1, origin.d);
+                gl::set_uniform_f(program_for_stroke, "u_stroke_z", (f32)re->z);
 
-                gl::vertex_attrib_v3f(program_for_stroke, "a_pointa", re->vbo_pointa);
-                gl::vertex_attrib_v3f(program_for_stroke, "a_pointb", re->vbo_pointb);
-                gl::vertex_attrib_v3f(program_for_stroke, "a_position", re->vbo_stroke);
+                b32 instancing = gl::check_flags(GLHelperFlags_INSTANCING);
+                GLuint divisor = instancing ? 1 : 0;
 
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, re->indices);
+                GLuint buffer = re->alloc.buffer;
+                i64 offset = re->alloc.offset;
+                GLsizei stride = sizeof(StrokeSegment);
+                gl::vertex_attrib(program_for_stroke, "a_corner", r->vbo_stroke_corners, 2, GL_FLOAT, 0, 0);
+                gl::vertex_attrib(program_for_stroke, "a_pointa", buffer, 2, GL_INT, stride,
+                                  offset + (i64)offsetof(StrokeSegment, pointa), divisor);
+                gl::vertex_attrib(program_for_stroke, "a_pointb", buffer, 2, GL_INT, stride,
+                                  offset + (i64)offsetof(StrokeSegment, pointb), divisor);
+                gl::vertex_attrib(program_for_stroke, "a_pressures", buffer, 2, GL_UNSIGNED_SHORT, stride,
+                                  offset + (i64)offsetof(StrokeSegment, pressures), divisor);
 
-                glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, 0);
+                #if MILTON_ENABLE_PROFILING
+                    r->stroke_draw_calls += 1;
+                #endif
+
+                if ( instancing ) {
+                    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, (GLsizei)count);
+
+                    gl::vertex_attrib_divisor(program_for_stroke, "a_pointa", 0);
+                    gl::vertex_attrib_divisor(program_for_stroke, "a_pointb", 0);
+                    gl::vertex_attrib_divisor(program_for_stroke, "a_pressures", 0);
+                }
+                else {
+                    mlt_assert(count < STROKE_MAX_POINTS);
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ibo_stroke_corners);
+                    glDrawElements(GL_TRIANGLES, (GLsizei)(6*count), GL_UNSIGNED_INT, 0);
+                }
             };
 
+            drawn_segments += re->count;
             if ( re->count > 0 ) {
                 if (re->flags & RenderElementFlags_ERASER) {
-                    glBindTexture(texture_target, r->eraser_texture);
+                    // Takes away from what the layer has under the stroke,
+                    // so that the layers below show through it.
+                    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
                     stroke_pass(re, r->stroke_eraser_program);
+                    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
                 }
                 else if ( (re->flags & (RenderElementFlags_PRESSURE_TO_OPACITY | RenderElementFlags_DISTANCE_TO_OPACITY)) ) {
                     glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
@@ -1662,12 +3181,293 @@ gpu_render_canvas(RenderBackend* r, i32 view_x, i32 view_y,
         }
     }
     POP_GRAPHICS_GROUP();  // render elements
+
+    if ( timed_slice ) {
+        glEndQuery(GL_TIME_ELAPSED);
+        pr->timer_pending = true;
+        pr->timed_segments = drawn_segments;
+    }
+    else if ( pr->active && pr->timer_query == 0 ) {
+        // Without timer queries, the time it took to submit the slice. It
+        // is less than what the GPU spends, but it does not wait for it.
+        f32 ms = perf_count_to_sec(perf_counter() - slice_start) * 1000.0f;
+        progressive_redraw_measure(pr, drawn_segments, ms);
+    }
+
+    if ( !pr->active ) {
+        if ( progressive ) {
+            pr->last_num_frames = pr->num_frames;
+            pr->num_frames = 0;
+        }
+        if ( composite_texture != r->canvas_texture ) {
+            composite_cache_store(&r->composite_above, &view, layers + pivot + 1, num_layers - pivot - 1);
+            draw_texture_into(r, texture_target, composite_texture, r->canvas_texture, /*blend*/true);
+        }
+    }
+
     glViewport(0, 0, r->width, r->height);
     glScissor(0, 0, r->width, r->height);
 
     POP_GRAPHICS_GROUP();  // render_canvas
 }
 
+b32
+gpu_pan_copy(RenderBackend* r, Rect* strips, i32* num_strips)
+{
+    *num_strips = 0;
+
+    CompositeView view = current_composite_view(r, 1.0f);
+
+    // Only the pan may differ from what the canvas texture shows.
+    CompositeView last = r->last_composite_view;
+    last.pan_center = view.pan_center;
+    if ( !composite_view_equal(&view, &last) || view.scale <= 0 ) {
+        return false;
+    }
+
+    // Same transform as canvas_to_raster. The copy is exact only when the
+    // canvas moved by a whole number of pixels, which is always the case for
+    // unrotated views.
+    f32 dx = (f32)(r->last_composite_view.pan_center.x - view.pan_center.x);
+    f32 dy = (f32)(r->last_composite_view.pan_center.y - view.pan_center.y);
+    f32 cos_angle = cosf(-view.angle);
+    f32 sin_angle = sinf(-view.angle);
+    f32 fx = (dx * cos_angle - dy * sin_angle) / (f32)view.scale;
+    f32 fy = (dy * cos_angle + dx * sin_angle) / (f32)view.scale;
+    i32 shift_x = (i32)roundf(fx);
+    i32 shift_y = (i32)roundf(fy);
+    if (    fabsf(fx - (f32)shift_x) > 0.01f
+         || fabsf(fy - (f32)shift_y) > 0.01f
+         || abs(shift_x) >= r->width
+         || abs(shift_y) >= r->height ) {
+        return false;
+    }
+    if ( shift_x == 0 && shift_y == 0 ) {
+        return true;
+    }
+
+    PUSH_GRAPHICS_GROUP("pan copy");
+
+    GLenum texture_target;
+    if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+        texture_target = GL_TEXTURE_2D_MULTISAMPLE;
+    } else {
+        texture_target = GL_TEXTURE_2D;
+    }
+
+    // Draw the moved canvas into eraser_texture and trade the two. The
+    // eraser texture only holds scratch data between passes.
+    glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
+    glViewport(0, 0, r->width, r->height);
+    glScissor(0, 0, r->width, r->height);
+
+    v2i offset = { shift_x, -shift_y };  // GL is bottom-left.
+    gl::set_uniform_vec2i(r->texture_fill_program, "u_offset", 1, offset.d);
+    draw_texture_into(r, texture_target, r->canvas_texture, r->eraser_texture, /*blend*/false);
+    offset = {};
+    gl::set_uniform_vec2i(r->texture_fill_program, "u_offset", 1, offset.d);
+
+    swap(r->canvas_texture, r->eraser_texture);
+    add_damage(r, screen_rect(0, 0, r->width, r->height));
+
+    POP_GRAPHICS_GROUP();
+
+    // Exposed strips, in raster coordinates. A full-width strip for the
+    // vertical shift and the rest of the exposed area beside it.
+    i64 w = r->width;
+    i64 h = r->height;
+    if ( shift_y > 0 ) {
+        strips[(*num_strips)++] = screen_rect(0, 0, w, shift_y);
+    }
+    else if ( shift_y < 0 ) {
+        strips[(*num_strips)++] = screen_rect(0, h + shift_y, w, h);
+    }
+    i64 top = max(shift_y, 0);
+    i64 bottom = min(h, h + shift_y);
+    if ( shift_x > 0 ) {
+        strips[(*num_strips)++] = screen_rect(0, top, shift_x, bottom);
+    }
+    else if ( shift_x < 0 ) {
+        strips[(*num_strips)++] = screen_rect(w + shift_x, top, w, bottom);
+    }
+
+    return true;
+}
+
+// Expects r->fbo to be bound.
+static void
+snapshot_copy_canvas(RenderBackend* r, CanvasSnapshot* s, i64 scale)
+{
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                              r->canvas_texture, 0);
+    glBindTexture(GL_TEXTURE_2D, s->texture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, r->width, r->height);
+    s->view = r->view;
+    s->scale = scale;
+    s->valid = true;
+}
+
+// Draws the snapshot where its pixels are in the current view. Both views
+// have the same angle, so it lands on an axis-aligned rect.
+static void
+draw_snapshot(RenderBackend* r, CanvasSnapshot* s)
+{
+    CanvasView* view = &r->view;
+    f32 k = (f32)s->scale / (f32)r->view_scale;  // Current pixels per snapshot pixel.
+
+    // Same transform as canvas_to_raster, for the snapshot's pan center.
+    f32 dx = (f32)(s->view.pan_center.x - view->pan_center.x);
+    f32 dy = (f32)(s->view.pan_center.y - view->pan_center.y);
+    f32 cos_angle = cosf(-view->angle);
+    f32 sin_angle = sinf(-view->angle);
+    f32 px = (dx * cos_angle - dy * sin_angle) / (f32)r->view_scale + (f32)view->zoom_center.x;
+    f32 py = (dy * cos_angle + dx * sin_angle) / (f32)r->view_scale + (f32)view->zoom_center.y;
+
+    f32 left   = px - (f32)s->view.zoom_center.x * k;
+    f32 top    = py - (f32)s->view.zoom_center.y * k;
+    f32 right  = left + (f32)s->view.screen_size.w * k;
+    f32 bottom = top + (f32)s->view.screen_size.h * k;
+
+    // Normalize to [-1,1]^2. The texture is bottom-left.
+    f32 l = 2 * left / r->width - 1;
+    f32 rt = 2 * right / r->width - 1;
+    f32 t = 1 - 2 * top / r->height;
+    f32 b = 1 - 2 * bottom / r->height;
+    GLfloat data[] = {
+        // a_point, a_uv
+        l,  t,  0, 1,
+        l,  b,  0, 0,
+        rt, b,  1, 0,
+        rt, t,  1, 1,
+    };
+    if ( r->vbo_snapshot == 0 ) {
+        glGenBuffers(1, &r->vbo_snapshot);
+    }
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_snapshot);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_DYNAMIC_DRAW);
+
+    gl::use_program(r->quad_program);
+    GLsizei stride = 4 * sizeof(GLfloat);
+    gl::vertex_attrib(r->quad_program, "a_point", r->vbo_snapshot, 2, GL_FLOAT, stride, 0, 0);
+    gl::vertex_attrib(r->quad_program, "a_uv", r->vbo_snapshot, 2, GL_FLOAT, stride, 2 * sizeof(GLfloat), 0);
+    glBindTexture(GL_TEXTURE_2D, s->texture);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+// Fills canvas_texture with the snapshots, in place of gpu_render_canvas.
+static void
+draw_snapshots(RenderBackend* r)
+{
+    PUSH_GRAPHICS_GROUP("snapshots");
+    add_damage(r, screen_rect(0, 0, r->width, r->height));
+
+    glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                              r->canvas_texture, 0);
+    glClearColor(r->background_color.r, r->background_color.g, r->background_color.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    if ( r->snapshot_far.valid ) {
+        draw_snapshot(r, &r->snapshot_far);
+    }
+    // The frame from before the animation has the detail that the zoomed-out
+    // snapshot lacks, as long as it is not shrunk so much that it aliases.
+    // Until then, it is all there is.
+    CanvasSnapshot* near = &r->snapshot_near;
+    if ( near->valid && (!r->snapshot_far.valid || 2 * near->scale >= r->view_scale) ) {
+        draw_snapshot(r, near);
+    }
+
+    glEnable(GL_BLEND);
+    POP_GRAPHICS_GROUP();
+}
+
+void
+gpu_snapshot_begin(Milton* milton, i64 scale)
+{
+    RenderBackend* r = milton->renderer;
+    if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+        return;  // Multisampled canvases can not be copied into the snapshots.
+    }
+    PUSH_GRAPHICS_GROUP("snapshot begin");
+
+    // canvas_texture has the frame on the screen, unless it is at reduced
+    // resolution or partly drawn. While the last animation is still on, it
+    // is a composite of its snapshots, which stay as they are.
+    if ( !r->snapshot_active ) {
+        r->snapshot_near.valid = false;
+        r->snapshot_far.valid = false;
+        if ( r->resolution_divisor == 1 && !r->progressive.active ) {
+            glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
+            snapshot_copy_canvas(r, &r->snapshot_near, r->view_scale);
+            glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
+        }
+    }
+
+    CanvasSnapshot* pending = &r->snapshot_pending;
+    pending->view = *milton->view;
+    pending->view.scale = scale;
+    pending->scale = scale;
+    pending->valid = true;
+
+    r->snapshot_active = true;
+    POP_GRAPHICS_GROUP();
+}
+
+void
+gpu_snapshot_update(Milton* milton)
+{
+    RenderBackend* r = milton->renderer;
+    CanvasSnapshot* pending = &r->snapshot_pending;
+    if ( !r->snapshot_active || !pending->valid ) {
+        return;
+    }
+    PUSH_GRAPHICS_GROUP("snapshot update");
+
+    // Clipped with the usual cap on cooking, so that a large canvas takes a
+    // few frames instead of one long one. It is rendered once nothing is
+    // left out.
+    CanvasView saved_view = r->view;
+    i32 saved_scale = r->view_scale;
+    gpu_set_resolution_divisor(r, 1);
+    gpu_update_canvas(r, &pending->view);
+    gpu_update_scale(r, (i32)pending->scale);
+
+    gpu_clip_strokes_and_update(&milton->root_arena, r, &pending->view, pending->scale,
+                                milton->canvas->root_layer, &milton->working_stroke,
+                                0, 0, r->width, r->height);
+    if ( !r->strokes_pending ) {
+        gpu_render_canvas(r, 0, 0, r->width, r->height);
+
+        glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
+        snapshot_copy_canvas(r, &r->snapshot_far, pending->scale);
+        glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
+
+        pending->valid = false;
+    }
+
+    gpu_update_canvas(r, &saved_view);
+    gpu_update_scale(r, saved_scale);
+    POP_GRAPHICS_GROUP();
+}
+
+void
+gpu_snapshot_end(RenderBackend* r)
+{
+    r->snapshot_active = false;
+    r->snapshot_far.valid = false;
+    r->snapshot_near.valid = false;
+    r->snapshot_pending.valid = false;
+}
+
+b32
+gpu_snapshot_active(RenderBackend* r)
+{
+    return r->snapshot_active;
+}
+
 void
 gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_height)
 {
@@ -1679,8 +3479,12 @@ gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_h
 
     print_framebuffer_status();
 
-    // TODO: Do less work when idling
-    gpu_render_canvas(r, view_x, view_y, view_width, view_height);
+    if ( r->snapshot_active ) {
+        draw_snapshots(r);
+    }
+    else {
+        gpu_render_canvas(r, view_x, view_y, view_width, view_height);
+    }
 
     GLenum texture_target;
     if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
@@ -1689,59 +3493,95 @@ gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_h
         texture_target = GL_TEXTURE_2D;
     }
 
-    // Use helper_texture as a place to do AA.
+    // Only the damaged part of the screen goes through the passes below.
+    // When nothing changed, the last frame is presented as it is. So is it
+    // while a progressive redraw is not done: the damage waits for it, and
+    // helper_texture holds the layer being drawn.
+    Rect damage = rect_intersect(r->damage, screen_rect(0, 0, r->width, r->height));
+    if ( gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+        damage = screen_rect(0, 0, r->width, r->height);
+    }
+    if ( r->progressive.active ) {
+        damage = rect_without_size();
+    }
+    else {
+        r->damage = rect_without_size();
+    }
+    b32 has_damage = damage.left < damage.right && damage.top < damage.bottom;
 
-    // Blit the canvas to helper_texture
+    // Flip it. GL is bottom-left.
+    i32 damage_x = (i32)damage.left;
+    i32 damage_y = r->height - (i32)damage.bottom;
+    i32 damage_w = (i32)(damage.right - damage.left);
+    i32 damage_h = (i32)(damage.bottom - damage.top);
 
     glDisable(GL_DEPTH_TEST);
 
-    PUSH_GRAPHICS_GROUP("blit to helper texture");
-    if ( !gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
-        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                                  r->canvas_texture, 0);
-        glBindTexture(texture_target, r->helper_texture);
-        glCopyTexImage2D(texture_target, 0, GL_RGBA8, 0,0, r->width, r->height, 0);
+    if ( has_damage ) {
+        glScissor(damage_x, damage_y, damage_w, damage_h);
 
-        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                                  r->helper_texture, 0);
-        glBindTexture(texture_target, r->canvas_texture);
-    } else {
-        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
-                                  r->helper_texture, 0);
-        glBindTexture(texture_target, r->canvas_texture);
+        // Use helper_texture as a place to do AA.
 
-        gpu_fill_with_texture(r);
-    }
-    POP_GRAPHICS_GROUP();
+        // Blit the canvas to helper_texture
 
-    // Render GUI on top of helper_texture
+        PUSH_GRAPHICS_GROUP("blit to helper texture");
+        if ( r->resolution_divisor > 1 && !gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+            // Stretch the reduced-resolution canvas to the screen.
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                      r->helper_texture, 0);
+            glBindTexture(texture_target, r->canvas_texture);
+            glDisable(GL_BLEND);
+            v2i texture_size = { r->width, r->height };
+            box_filter_pass(r, 0, BoxFilterPass_RESAMPLE, texture_size, render_target_size(r),
+                            1.0f / (f32)r->resolution_divisor);
+            glEnable(GL_BLEND);
+        }
+        else if ( !gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                      r->canvas_texture, 0);
+            glBindTexture(texture_target, r->helper_texture);
+            glCopyTexSubImage2D(texture_target, 0, damage_x, damage_y, damage_x, damage_y, damage_w, damage_h);
+
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                      r->helper_texture, 0);
+            glBindTexture(texture_target, r->canvas_texture);
+        } else {
+            glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture_target,
+                                      r->helper_texture, 0);
+            glBindTexture(texture_target, r->canvas_texture);
 
-    // Render color picker
-    // TODO: Only render if view rect intersects picker rect
-    if ( r->flags & RenderBackendFlags_GUI_VISIBLE ) {
-        // Render picker
-        gl::use_program(r->picker_program);
-        GLint loc = glGetAttribLocation(r->picker_program, "a_position");
+            gpu_fill_with_texture(r);
+        }
+        POP_GRAPHICS_GROUP();
 
-        if ( loc >= 0 ) {
-            DEBUG_gl_validate_buffer(r->vbo_picker);
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_picker);
-            glVertexAttribPointer(/*attrib location*/(GLuint)loc,
-                                  /*size*/2, GL_FLOAT, /*normalize*/GL_FALSE,
-                                  /*stride*/0, /*ptr*/0);
-            glEnableVertexAttribArray((GLuint)loc);
-            GLint loc_norm = glGetAttribLocation(r->picker_program, "a_norm");
+        // Render GUI on top of helper_texture
 
-            if ( loc_norm >= 0 ) {
-                DEBUG_gl_validate_buffer(r->vbo_picker_norm);
-                glBindBuffer(GL_ARRAY_BUFFER, r->vbo_picker_norm);
-                glVertexAttribPointer(/*attrib location*/(GLuint)loc_norm,
+        // Render color picker
+        if ( r->flags & RenderBackendFlags_GUI_VISIBLE ) {
+            // Render picker
+            gl::use_program(r->picker_program);
+            GLint loc = gl::attrib_location(r->picker_program, "a_position");
+
+            if ( loc >= 0 ) {
+                DEBUG_gl_validate_buffer(r->vbo_picker);
+                gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_picker);
+                glVertexAttribPointer(/*attrib location*/(GLuint)loc,
                                       /*size*/2, GL_FLOAT, /*normalize*/GL_FALSE,
                                       /*stride*/0, /*ptr*/0);
-                glEnableVertexAttribArray((GLuint)loc_norm);
+                glEnableVertexAttribArray((GLuint)loc);
+                GLint loc_norm = gl::attrib_location(r->picker_program, "a_norm");
+
+                if ( loc_norm >= 0 ) {
+                    DEBUG_gl_validate_buffer(r->vbo_picker_norm);
+                    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_picker_norm);
+                    glVertexAttribPointer(/*attrib location*/(GLuint)loc_norm,
+                                          /*size*/2, GL_FLOAT, /*normalize*/GL_FALSE,
+                                          /*stride*/0, /*ptr*/0);
+                    glEnableVertexAttribArray((GLuint)loc_norm);
 
+                }
+                glDrawArrays(GL_TRIANGLE_FAN,0,4);
             }
-            glDrawArrays(GL_TRIANGLE_FAN,0,4);
         }
     }
 
@@ -1749,29 +3589,49 @@ gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_h
 
     PUSH_GRAPHICS_GROUP("postproc");
     if ( !gl::check_flags(GLHelperFlags_TEXTURE_MULTISAMPLE) ) {
-        glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
-
-        // glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, r->helper_texture);
-
-        gl::set_uniform_i(r->postproc_program, "u_canvas", 0);
-
-        gl::use_program(r->postproc_program);
-
-        GLint loc = glGetAttribLocation(r->postproc_program, "a_position");
-        if ( loc >= 0 ) {
-            DEBUG_gl_validate_buffer(r->vbo_screen_quad);
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
-            glVertexAttribPointer((GLuint)loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
-            glEnableVertexAttribArray((GLuint)loc);
-            glVertexAttribPointer(/*attrib location*/ (GLuint)loc,
-                                  /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
-                                  /*stride*/ 0, /*ptr*/ 0);
-
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                  r->present_texture, 0);
+
+        // FXAA reads around each pixel, so pixels near the damage change too.
+        if ( has_damage ) {
+            Rect margin = rect_intersect(rect_enlarge(damage, POSTPROC_DAMAGE_MARGIN),
+                                         screen_rect(0, 0, r->width, r->height));
+            glScissor((i32)margin.left, r->height - (i32)margin.bottom,
+                      (i32)(margin.right - margin.left), (i32)(margin.bottom - margin.top));
+            glDisable(GL_BLEND);
+
+            // glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, r->helper_texture);
+
+            gl::set_uniform_i(r->postproc_program, "u_canvas", 0);
+
+            gl::use_program(r->postproc_program);
+
+            GLint loc = gl::attrib_location(r->postproc_program, "a_position");
+            if ( loc >= 0 ) {
+                DEBUG_gl_validate_buffer(r->vbo_screen_quad);
+                gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
+                glVertexAttribPointer((GLuint)loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
+                glEnableVertexAttribArray((GLuint)loc);
+                glVertexAttribPointer(/*attrib location*/ (GLuint)loc,
+                                      /*size*/ 2, GL_FLOAT, /*normalize*/ GL_FALSE,
+                                      /*stride*/ 0, /*ptr*/ 0);
+
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            }
+            glEnable(GL_BLEND);
         }
+        glScissor(0, 0, r->width, r->height);
+
+        // The back buffer does not keep its contents across frames.
+        glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER, 0);
+        glBindFramebufferEXT(GL_READ_FRAMEBUFFER, r->fbo);
+        glBlitFramebufferEXT(0, 0, r->width, r->height,
+                             0, 0, r->width, r->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebufferEXT(GL_FRAMEBUFFER, 0);
     }
     else {  // Resolve
+        glScissor(0, 0, r->width, r->height);
         glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER, 0);
         glBindFramebufferEXT(GL_READ_FRAMEBUFFER, r->fbo);
         glBlitFramebufferEXT(0, 0, r->width, r->height,
@@ -1785,19 +3645,19 @@ gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_h
     // Brush outline
     {
         gl::use_program(r->outline_program);
-        GLint loc = glGetAttribLocation(r->outline_program, "a_position");
+        GLint loc = gl::attrib_location(r->outline_program, "a_position");
         if ( loc >= 0 ) {
             DEBUG_gl_validate_buffer(r->vbo_outline);
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_outline);
+            gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_outline);
 
             glVertexAttribPointer(/*attrib location*/(GLuint)loc,
                                   /*size*/2, GL_FLOAT, /*normalize*/GL_FALSE,
                                   /*stride*/0, /*ptr*/0);
             glEnableVertexAttribArray((GLuint)loc);
-            GLint loc_s = glGetAttribLocation(r->outline_program, "a_sizes");
+            GLint loc_s = gl::attrib_location(r->outline_program, "a_sizes");
             if ( loc_s >= 0 ) {
                 DEBUG_gl_validate_buffer(r->vbo_outline_sizes);
-                glBindBuffer(GL_ARRAY_BUFFER, r->vbo_outline_sizes);
+                gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_outline_sizes);
                 glVertexAttribPointer(/*attrib location*/(GLuint)loc_s,
                                       /*size*/2, GL_FLOAT, /*normalize*/GL_FALSE,
                                       /*stride*/0, /*ptr*/0);
@@ -1813,7 +3673,7 @@ gpu_render(RenderBackend* r,  i32 view_x, i32 view_y, i32 view_width, i32 view_h
         // Update data if rect is not degenerate.
         // Draw outline.
         gl::use_program(r->exporter_program);
-        GLint loc = glGetAttribLocation(r->exporter_program, "a_position");
+        GLint loc = gl::attrib_location(r->exporter_program, "a_position");
         if ( loc>=0 && r->vbo_exporter > 0 ) {
             DEBUG_gl_validate_buffer(r->vbo_exporter);
             gl::vertex_attrib_v2f(r->exporter_program, "a_position", r->vbo_exporter);
@@ -1836,6 +3696,9 @@ gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w,
     RenderBackend* r = milton->renderer;
     CanvasView* view = milton->view;
 
+    // Exports are always at full resolution.
+    gpu_set_resolution_divisor(r, 1);
+
     i32 saved_width = r->width;
     i32 saved_height = r->height;
     GLuint saved_fbo = r->fbo;
@@ -1866,7 +3729,7 @@ gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w,
     }
 
     gpu_resize(r, view);
-    gpu_update_canvas(r, milton->canvas, view);
+    gpu_update_canvas(r, view);
 
     // TODO: Check for out-of-memory errors.
 
@@ -1876,7 +3739,7 @@ gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w,
     glViewport(0, 0, buf_w, buf_h);
     glScissor(0, 0, buf_w, buf_h);
     gpu_clip_strokes_and_update(&milton->root_arena, r, milton->view, milton->view->scale, milton->canvas->root_layer,
-                                &milton->working_stroke, 0, 0, buf_w, buf_h);
+                                &milton->working_stroke, 0, 0, buf_w, buf_h, ClipFlags_COOK_ALL);
 
     gpu_render_canvas(r, 0, 0, buf_w, buf_h, background_alpha);
 
@@ -1885,10 +3748,10 @@ gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w,
         gl::use_program(r->postproc_program);
         glBindTexture(GL_TEXTURE_2D, r->canvas_texture);
 
-        GLint loc = glGetAttribLocation(r->postproc_program, "a_position");
+        GLint loc = gl::attrib_location(r->postproc_program, "a_position");
         if ( loc >= 0 ) {
             DEBUG_gl_validate_buffer(r->vbo_screen_quad);
-            glBindBuffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
+            gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_screen_quad);
             glVertexAttribPointer((GLuint)loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
             glEnableVertexAttribArray((GLuint)loc);
 
@@ -1936,7 +3799,7 @@ gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w,
     glBindFramebufferEXT(GL_FRAMEBUFFER, r->fbo);
 
     gpu_resize(r, view);
-    gpu_update_canvas(r, milton->canvas, view);
+    gpu_update_canvas(r, view);
 
     // Re-render
     gpu_clip_strokes_and_update(&milton->root_arena,
@@ -1950,6 +3813,33 @@ void
 gpu_release_data(RenderBackend* r)
 {
     release(&r->clip_array);
+    release(&r->clip_ranges);
+    release(&r->clip_jobs);
+    release(&r->clip_visible);
+    release(&r->cook_items);
+    release(&r->cook_jobs);
+    workers_release(&r->clip_workers);
+    for ( i64 ci = 0; ci < r->clip_cache.count; ++ci ) {
+        release(&r->clip_cache.data[ci].elements);
+        release(&r->clip_cache.data[ci].stroke_indices);
+    }
+    release(&r->clip_cache);
+    r->clip_cache_valid = false;
+    while ( r->lru_head ) {
+        r->lru_head->slot = 0;
+        lru_unlink(r, r->lru_head);
+    }
+    buffer_pool_release(&r->stroke_pool);
+    release(&r->stroke_table);
+    release(&r->stroke_table_free_slots);
+    r->stroke_table_gpu_capacity = 0;
+    release(&r->batch_firsts);
+    release(&r->batch_counts);
+    release(&r->clip_layers);
+    release(&r->composite_below.keys);
+    release(&r->composite_above.keys);
+    r->composite_below.valid = false;
+    r->composite_above.valid = false;
 }
 
 
@@ -1993,7 +3883,7 @@ imm_rect(RenderBackend* r, float left, float right, float top, float bottom, flo
         right+line_width/r->width, bottom,
         right+line_width/r->width, top,
     };
-    glBindBuffer(GL_ARRAY_BUFFER, r->vbo_exporter);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->vbo_exporter);
     DEBUG_gl_mark_buffer(r->vbo_exporter);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)array_count(toparr)*sizeof(*toparr), toparr, GL_DYNAMIC_DRAW);
 
@@ -2014,7 +3904,7 @@ imm_rect(RenderBackend* r, float left, float right, float top, float bottom, flo
         12,13,14,
         14,15,12,
     };
-    glBindBuffer(GL_ARRAY_BUFFER, r->exporter_indices);
+    gl::bind_buffer(GL_ARRAY_BUFFER, r->exporter_indices);
     glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)array_count(indices)*sizeof(*indices), indices, GL_STATIC_DRAW);
 
     r->exporter_indices_count = array_count(indices);
@@ -2028,5 +3918,6 @@ gpu_reset_stroke(RenderBackend* r, RenderHandle handle)
     RenderElement* re = get_render_element(handle);
     if (re) {
         re->count = 0;
+        re->appendable_count = 0;
     }
 }
@@ -28,6 +28,7 @@ struct Stroke;
 struct Layer;
 struct Milton;
 struct CanvasState;
+struct BufferPoolStats;
 
 RenderBackend* gpu_allocate_render_backend(Arena* arena);
 
@@ -56,10 +57,16 @@ void gpu_update_picker(RenderBackend* renderer, ColorPicker* picker);
 void gpu_update_scale(RenderBackend* renderer, i32 scale);
 void gpu_update_export_rect(RenderBackend* renderer, Exporter* exporter);
 void gpu_update_background(RenderBackend* renderer, v3f background_color);
-void gpu_update_canvas(RenderBackend* renderer, CanvasState* canvas, CanvasView* view);
+void gpu_update_canvas(RenderBackend* renderer, CanvasView* view);
+
+// Draws the canvas at 1/divisor of the screen resolution and stretches it to
+// the screen. For frames where the view changes. 1 is full resolution.
+void gpu_set_resolution_divisor(RenderBackend* renderer, i32 divisor);
+i32  gpu_get_resolution_divisor(RenderBackend* renderer);
 
 void gpu_get_viewport_limits(RenderBackend* renderer, float* out_viewport_limits);
 i32  gpu_get_num_clipped_strokes(Layer* root_layer);
+i32  gpu_get_num_stroke_draw_calls(RenderBackend* renderer);  // In the last frame. Needs MILTON_ENABLE_PROFILING
 
 
 enum CookStrokeOpt
@@ -67,20 +74,46 @@ enum CookStrokeOpt
     CookStroke_NEW                   = 0,
     CookStroke_UPDATE_WORKING_STROKE = 1,
 };
+// Call when the working stroke changes in any way other than appending points.
 void gpu_reset_stroke(RenderBackend* r, RenderHandle handle);
 
 void gpu_cook_stroke(Arena* arena, RenderBackend* renderer, Stroke* stroke,
                      CookStrokeOpt cook_option = CookStroke_NEW);
 
+void gpu_free_strokes(RenderHandle* handles, i64 count, RenderBackend* renderer);
+void gpu_free_strokes(RenderBackend* renderer, Layer* layer);
 void gpu_free_strokes(RenderBackend* renderer, CanvasState* canvas);
 
+// Occupancy and fragmentation of the pool that holds stroke geometry.
+void gpu_get_buffer_pool_stats(RenderBackend* renderer, BufferPoolStats* out_stats);
+
+struct StrokeMemoryStats
+{
+    i64 resident_bytes;     // Stroke geometry on the GPU.
+    i64 budget_bytes;
+
+    // Strokes evicted and cooked again after an eviction, in the last clip
+    // pass and since startup.
+    i64 evictions_last_clip;
+    i64 recooks_last_clip;
+    i64 evictions;
+    i64 recooks;
+};
+void gpu_get_stroke_memory_stats(RenderBackend* renderer, StrokeMemoryStats* out_stats);
+
+// Cooked strokes that were not visible recently are freed when their total
+// size goes over the budget. Defaults to STROKE_GPU_BUDGET_MB.
+void gpu_set_stroke_budget(RenderBackend* renderer, i64 budget_bytes);
+
 
 // Creates OpenGL objects for strokes that are in view but are not loaded on the GPU. Deletes
-// content for strokes that are far away.
+// content for the least recently visible strokes when over the GPU budget.
 enum ClipFlags
 {
-    ClipFlags_UPDATE_GPU_DATA   = 1<<0,  // Free all strokes that are far away.
+    ClipFlags_UPDATE_GPU_DATA   = 1<<0,  // Evict strokes to stay within the budget. Pass for full-screen clips.
     ClipFlags_JUST_CLIP         = 1<<1,
+    ClipFlags_COOK_ALL          = 1<<2,  // Do not leave strokes for later frames, and do not use the layer composite caches. For exports.
+    ClipFlags_PROGRESSIVE       = 1<<3,  // A full-screen redraw may take several frames. The last image stays on the screen until it is done.
 };
 void gpu_clip_strokes_and_update(Arena* arena,
                                  RenderBackend* renderer,
@@ -88,10 +121,48 @@ void gpu_clip_strokes_and_update(Arena* arena,
                                  Layer* root_layer, Stroke* working_stroke,
                                  i32 x, i32 y, i32 w, i32 h, ClipFlags flags = ClipFlags_JUST_CLIP);
 
+// True when the last clip pass had more strokes to cook than it had time
+// for. The missing strokes are cooked on the next passes; keep redrawing.
+b32  gpu_has_pending_strokes(RenderBackend* renderer);
+
+// True while a redraw clipped with ClipFlags_PROGRESSIVE is partly drawn.
+// Keep redrawing the full screen with that flag until it is done.
+b32  gpu_has_pending_redraw(RenderBackend* renderer);
+// Frames that the last progressive redraw took. For the debug window.
+i32  gpu_get_progressive_redraw_frames(RenderBackend* renderer);
+
+// True if the layers with blur can be read from the composite caches, so that
+// the working stroke can be drawn without redrawing the whole screen. Blur
+// spreads pixels across the edges of the redrawn rect.
+b32  gpu_effects_are_cached(RenderBackend* renderer, Layer* root_layer, i32 working_layer_id);
+
 void gpu_reset_render_flags(RenderBackend* renderer, int flags);
 
+// Moves the canvas texture by the pan since the last frame, when the view did
+// not change otherwise and the pan is a whole number of pixels. Writes the
+// strips that came into view, up to two, in raster coordinates. Returns false
+// if the canvas has to be redrawn in full.
+b32  gpu_pan_copy(RenderBackend* renderer, Rect* strips, i32* num_strips);
+
 void gpu_render(RenderBackend* renderer,  i32 view_x, i32 view_y, i32 view_width, i32 view_height);
+
+// The canvas part of gpu_render, for frames that redraw more than one rect.
+// Clip each rect before drawing it.
+void gpu_render_canvas(RenderBackend* renderer, i32 view_x, i32 view_y,
+                       i32 view_width, i32 view_height, float background_alpha = 1.0f);
 void gpu_render_to_buffer(Milton* milton, u8* buffer, i32 scale, i32 x, i32 y, i32 w, i32 h, f32 background_alpha);
 
+// Animated zooms. gpu_snapshot_begin keeps the frame on the screen and starts
+// rendering the canvas at `scale`. Until gpu_snapshot_end, gpu_render draws
+// the current view from those two textures instead of drawing strokes.
+// Call gpu_snapshot_update instead of gpu_clip_strokes_and_update on those
+// frames. It cooks a few strokes of the zoomed-out view per frame, and
+// gpu_has_pending_strokes is true until it is rendered. Redraw in full
+// afterwards.
+void gpu_snapshot_begin(Milton* milton, i64 scale);
+void gpu_snapshot_update(Milton* milton);
+void gpu_snapshot_end(RenderBackend* renderer);
+b32  gpu_snapshot_active(RenderBackend* renderer);
+
 void gpu_release_data(RenderBackend* renderer);
 
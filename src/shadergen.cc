@@ -211,6 +211,7 @@ main(int argc, char** argv)
         output_shader(outfd, "src/stroke_info.f.glsl", "src/common.glsl");
         output_shader(outfd, "src/stroke_fill.f.glsl", "src/common.glsl");
         output_shader(outfd, "src/stroke_clear.f.glsl", "src/common.glsl");
+        output_shader(outfd, "src/stroke_soft.f.glsl", "src/common.glsl");
         output_shader(outfd, "src/stroke_debug.f.glsl", "src/common.glsl");
         output_shader(outfd, "src/exporter_rect.f.glsl");
         output_shader(outfd, "src/texture_fill.f.glsl");
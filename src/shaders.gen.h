@@ -0,0 +1,2773 @@
+static char g_picker_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 a_position;\n"
+"in vec2 a_norm;  // Normalized position\n"
+"\n"
+"out vec2 v_norm;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    v_norm = a_norm;\n"
+"    gl_Position = vec4(a_position, 0, 1);\n"
+"}\n"
+;
+static char g_picker_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// The triangle, in [-1,1].\n"
+"uniform vec2 u_pointa;\n"
+"uniform vec2 u_pointb;\n"
+"uniform vec2 u_pointc;\n"
+"\n"
+"uniform vec3 u_color;\n"
+"uniform float u_angle;\n"
+"\n"
+"uniform vec2 u_triangle_point;\n"
+"\n"
+"uniform vec4 u_colors[5]; // Colors for picker buttons.\n"
+"\n"
+"uniform vec2 u_screen_size;\n"
+"\n"
+"in vec2 v_norm;\n"
+"\n"
+"\n"
+"#define PI 3.14159\n"
+"\n"
+"float\n"
+"radians_to_degrees(float r)\n"
+"{\n"
+"    return (180.0 * r) / PI;\n"
+"}\n"
+"\n"
+"// http://lolengine.net/blog/2013/07/27/rgb-to-hsv-in-glsl\n"
+"vec3\n"
+"hsv2rgb(vec3 c)\n"
+"{\n"
+"    vec4 K = vec4(1.0, 2.0 / 3.0, 1.0 / 3.0, 3.0);\n"
+"    vec3 p = abs(fract(c.xxx + K.xyz) * 6.0 - K.www);\n"
+"    return c.z * mix(K.xxx, clamp(p - K.xxx, 0.0, 1.0), c.y);\n"
+"}\n"
+"\n"
+"vec3\n"
+"hsv_to_rgb(vec3 hsv)\n"
+"{\n"
+"    vec3 rgb;\n"
+"\n"
+"    float h = hsv.x;\n"
+"    float s = hsv.y;\n"
+"    float v = hsv.z;\n"
+"    float hh = h / 60.0;\n"
+"    int hi = int(floor(hh));\n"
+"    float cr = v * s;\n"
+"    float rem = mod(hh, 2.0);\n"
+"    float x = cr * (1.0 - abs(rem - 1.0));\n"
+"    float m = v - cr;\n"
+"\n"
+"    if( hi == 0 || hi == 6 ) {\n"
+"        rgb.r = cr;\n"
+"        rgb.g = x;\n"
+"        rgb.b = 0;\n"
+"    }\n"
+"    if( hi == 1 ) {\n"
+"        rgb.r = x;\n"
+"        rgb.g = cr;\n"
+"        rgb.b = 0;\n"
+"    }\n"
+"    if( hi == 2 ) {\n"
+"        rgb.r = 0;\n"
+"        rgb.g = cr;\n"
+"        rgb.b = x;\n"
+"    }\n"
+"    if( hi == 3 ) {\n"
+"        rgb.r = 0;\n"
+"        rgb.g = x;\n"
+"        rgb.b = cr;\n"
+"    }\n"
+"    if( hi == 4 ) {\n"
+"        rgb.r = x;\n"
+"        rgb.g = 0;\n"
+"        rgb.b = cr;\n"
+"    }\n"
+"    if( hi == 5 ) {\n"
+"        rgb.r = cr;\n"
+"        rgb.g = 0;\n"
+"        rgb.b = x;\n"
+"    }\n"
+"    rgb.r += m;\n"
+"    rgb.g += m;\n"
+"    rgb.b += m;\n"
+"\n"
+"    return rgb;\n"
+"}\n"
+"\n"
+"// Could be called a signed area. `orientation(a, b, c) / 2` is the area of the\n"
+"// triangle.\n"
+"// If positive, c is to the left of ab. Negative: right of ab. 0 if\n"
+"// colinear.\n"
+"float\n"
+"orientation(vec2 a, vec2 b, vec2 c)\n"
+"{\n"
+"    return (b.x - a.x)*(c.y - a.y) - (c.x - a.x)*(b.y - a.y);\n"
+"}\n"
+"\n"
+"bool\n"
+"is_inside_triangle(vec2 p)\n"
+"{\n"
+"    bool is_inside =\n"
+"           (orientation(u_pointa, u_pointb, p) <= 0) &&\n"
+"           (orientation(u_pointb, u_pointc, p) <= 0) &&\n"
+"           (orientation(u_pointc, u_pointa, p) <= 0);\n"
+"    return is_inside;\n"
+"}\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    // NOTE:\n"
+"    //  These constants gotten from gui.cc in gui_init. From bounds_radius_px, wheel_half_width, and so on.\n"
+"    float u_ui_scale = 1.75;\n"
+"    float half_width = 12.0 / 100.0;\n"
+"    float radius = (1.0 - (12.0 + 5) / 100.0);\n"
+"\n"
+"    /* vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y-gl_FragCoord.y); */\n"
+"    /* vec2 coord = screen_point / u_screen_size; */\n"
+"    /* coord.y = 1-coord.y; */\n"
+"    vec4 color = vec4(0.5, 0.5, 0.55, 0.6);\n"
+"\n"
+"    float dist = distance(vec2(0), v_norm);\n"
+"    // Wheel and triangle\n"
+"    // Show chosen color in preview circle\n"
+"    vec2 preview_center = vec2(0.75,-0.75);\n"
+"    const float preview_radius = 0.23;\n"
+"\n"
+"    float dist_to_preview = distance(preview_center, v_norm);\n"
+"    if ( dist_to_preview < preview_radius ) {\n"
+"        color = vec4(0,0,0,1);\n"
+"        const float epsilon = 0.02;\n"
+"        if ( dist_to_preview < preview_radius - epsilon ) {\n"
+"            color = vec4(u_color, 1);\n"
+"        }\n"
+"    }\n"
+"    // else if ( dist < radius + half_width ) {\n"
+"    //    color = vec4(0,0,0,1);\n"
+"    // }\n"
+"#if 1\n"
+"    else if ( dist < radius+half_width ) {\n"
+"        // Wheel\n"
+"        if ( dist > radius-half_width ) {\n"
+"            vec2 n = v_norm;\n"
+"            vec2 v = vec2(1, 0);\n"
+"            float angle = acos(dot(n, v)/ (length(n) * length(v)));\n"
+"            if ( v_norm.y > 0 ) {\n"
+"                angle = (2*PI) - angle;\n"
+"            }\n"
+"            vec3 hsv = vec3(radians_to_degrees(angle),1.0,1.0);\n"
+"            //vec3 hsv = vec3(angle,1.0,1.0);\n"
+"            vec3 rgb = hsv_to_rgb(hsv);\n"
+"            color = vec4(rgb,1);\n"
+"        }\n"
+"        // Triangle\n"
+"        else if ( is_inside_triangle(v_norm) ) {\n"
+"            float area = orientation(u_pointa, u_pointb, u_pointc);\n"
+"            float v = 1 - (orientation(v_norm, u_pointc, u_pointa) / area);\n"
+"            float s = orientation(u_pointb, v_norm, u_pointa) * v / area;\n"
+"            vec3 pure_color = hsv_to_rgb(vec3(u_angle,1.0,1.0));\n"
+"            color = vec4((1.0-(1.0-pure_color)*s)*v,1.0);\n"
+"        }\n"
+"    }\n"
+"#endif\n"
+"    // Render buttons\n"
+"    else if ( v_norm.y >= 1 ) {\n"
+"        // Get the color for the rects\n"
+"        int rect_i = int(((v_norm.x+1)/4) * 10);\n"
+"        vec4 rect_color = u_colors[rect_i];\n"
+"        color = rect_color;\n"
+"\n"
+"        // Black outlines\n"
+"        float h = ((v_norm.x+1)/4)*10;\n"
+"        float epsilon = 0.01;\n"
+"        float epsilon2 = 0.015;\n"
+"        if ( v_norm.y > 1.4-epsilon\n"
+"             || v_norm.y < 1+epsilon\n"
+"             || (h <     epsilon2 && h >   - epsilon2)\n"
+"             || (h < 1 + epsilon2 && h > 1 - epsilon2)\n"
+"             || (h < 2 + epsilon2 && h > 2 - epsilon2)\n"
+"             || (h < 3 + epsilon2 && h > 3 - epsilon2)\n"
+"             || (h < 4 + epsilon2 && h > 4 - epsilon2)\n"
+"             || (h < 5 + epsilon2 && h > 5 - epsilon2)\n"
+"             || (h < 6 + epsilon2 && h > 6 - epsilon2) ) {\n"
+"            color = vec4(0,0,0,1);\n"
+"        }\n"
+"    }\n"
+"\n"
+"    float dist_to_choice = distance(v_norm, u_triangle_point);\n"
+"    const float point_radius = 0.05;\n"
+"    const float girth = 0.01;\n"
+"    if ( dist_to_choice < point_radius+girth && dist_to_choice > point_radius-girth ) {\n"
+"        color.rgb = vec3(1- color.r, 1 - color.g, 1 - color.b);\n"
+"    }\n"
+"\n"
+"    out_color = color;\n"
+"}\n"
+;
+static char g_layer_blend_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 a_position;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    gl_Position = vec4(a_position, 0, 1);\n"
+"}\n"
+;
+static char g_layer_blend_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    uniform sampler2DMS u_canvas;\n"
+"#else\n"
+"    uniform sampler2D u_canvas;\n"
+"#endif\n"
+"uniform vec2      u_screen_size;\n"
+"\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec4 g_eraser_magic = vec4(0,1,0,1);\n"
+"\n"
+"    //vec2 coord = gl_FragCoord.xy/ u_screen_size;\n"
+"    vec2 coord = vec2(gl_FragCoord.x, u_screen_size.y-gl_FragCoord.y) / u_screen_size;\n"
+"\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    vec4 color = texelFetch(u_canvas, ivec2(gl_FragCoord.xy), 0);\n"
+"#else\n"
+"    vec4 color = texture(u_canvas, coord);\n"
+"#endif\n"
+"\n"
+"    if ( color == g_eraser_magic ) {\n"
+"        discard;\n"
+"    }\n"
+"    out_color = vec4(color);\n"
+"}\n"
+;
+static char g_simple_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 a_position;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    gl_Position = vec4(a_position, 0, 1);\n"
+"}\n"
+;
+static char g_simple_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    out_color = vec4(0,1,0,1);\n"
+"}\n"
+;
+static char g_outline_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 a_position;\n"
+"in vec2 a_sizes;\n"
+"\n"
+"out vec2 v_sizes;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    v_sizes = a_sizes;\n"
+"    gl_Position = vec4(a_position, 0.0, 1.0);\n"
+"}\n"
+;
+static char g_outline_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 v_sizes;\n"
+"\n"
+"uniform int u_radius;\n"
+"uniform bool u_fill;\n"
+"uniform vec4 u_color;\n"
+"\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    float r = length(v_sizes);\n"
+"\n"
+"    float girth = u_fill ? 2.0 : 1.0;\n"
+"    const float ring_alpha = 0.4;\n"
+"\n"
+"    if ( r <= u_radius\n"
+"         && r > u_radius - girth ) {\n"
+"        out_color = vec4(0,0,0,ring_alpha);\n"
+"    }\n"
+"    else if ( r < u_radius + girth && r >= u_radius ) {\n"
+"        out_color = vec4(1,1,1,ring_alpha);\n"
+"    }\n"
+"    else if ( u_fill && r < u_radius ) {\n"
+"        out_color = u_color;\n"
+"    }\n"
+"    else {\n"
+"        discard;\n"
+"    }\n"
+"}\n"
+"\n"
+;
+static char g_stroke_raster_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"#ifndef STROKE_BATCH\n"
+"#define STROKE_BATCH 0\n"
+"#endif\n"
+"\n"
+"#ifndef STROKE_SOFT\n"
+"#define STROKE_SOFT 0\n"
+"#endif\n"
+"\n"
+"#if STROKE_BATCH\n"
+"// Many strokes per draw call. There are no attributes: each run of 6\n"
+"// vertices is one segment, read from the pool page with gl_VertexID.\n"
+"uniform isamplerBuffer u_segments;      // 6 ints per StrokeSegment. See renderer.cc\n"
+"uniform isamplerBuffer u_stroke_table;  // 4 texels per StrokeTableEntry.\n"
+"\n"
+"flat out vec4  v_color;\n"
+"flat out float v_radius;\n"
+"\n"
+"#if STROKE_SOFT\n"
+"// What stroke_soft.f.glsl needs to look at the neighbors of the segment.\n"
+"flat out int   v_segment;       // Index in the pool page.\n"
+"flat out ivec3 v_stroke_range;  // First segment, number of segments, window.\n"
+"flat out vec2  v_origin;\n"
+"flat out vec2  v_opacity;       // Minimum opacity, hardness.\n"
+"#endif\n"
+"#else\n"
+"// Corner of the segment's quad: (0 on a's end / 1 on b's end, side).\n"
+"in vec2 a_corner;\n"
+"\n"
+"// Per segment. See StrokeSegment in renderer.cc\n"
+"in vec2 a_pointa;       // Relative to u_stroke_origin\n"
+"in vec2 a_pointb;\n"
+"in vec2 a_pressures;    // 0 to 65535\n"
+"\n"
+"uniform ivec2 u_stroke_origin;\n"
+"uniform float u_stroke_z;\n"
+"#endif\n"
+"\n"
+"out vec3 v_pointa;\n"
+"out vec3 v_pointb;\n"
+"\n"
+"#if STROKE_DEBUG_VIZ\n"
+"in vec3 a_debug_color;\n"
+"out vec3 v_debug_color;\n"
+"#endif\n"
+"\n"
+"#define MAX_DEPTH_VALUE 1048576.0\n"
+"\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"#if STROKE_BATCH\n"
+"    // Two triangles per quad, same order as RenderBackend::ibo_stroke_corners\n"
+"    const vec2 corners[6] = vec2[6](vec2(0,0), vec2(0,1), vec2(1,1),\n"
+"                                    vec2(1,1), vec2(0,0), vec2(1,0));\n"
+"    int segment = gl_VertexID / 6;\n"
+"    vec2 corner_uv = corners[gl_VertexID - 6*segment];\n"
+"\n"
+"    int base = 6*segment;\n"
+"    vec2 pointa = vec2(texelFetch(u_segments, base + 0).x, texelFetch(u_segments, base + 1).x);\n"
+"    vec2 pointb = vec2(texelFetch(u_segments, base + 2).x, texelFetch(u_segments, base + 3).x);\n"
+"    int pressures = texelFetch(u_segments, base + 4).x;\n"
+"    int slot = texelFetch(u_segments, base + 5).x;\n"
+"\n"
+"    ivec4 entry = texelFetch(u_stroke_table, 4*slot);\n"
+"    vec2 origin = vec2(entry.xy);\n"
+"    float radius = float(entry.z);\n"
+"    float stroke_z = float(entry.w);\n"
+"\n"
+"    v_color = intBitsToFloat(texelFetch(u_stroke_table, 4*slot + 1));\n"
+"    v_radius = radius;\n"
+"\n"
+"#if STROKE_SOFT\n"
+"    v_segment = segment;\n"
+"    v_stroke_range = texelFetch(u_stroke_table, 4*slot + 2).xyz;\n"
+"    v_origin = origin;\n"
+"    v_opacity = intBitsToFloat(texelFetch(u_stroke_table, 4*slot + 3)).xy;\n"
+"#endif\n"
+"\n"
+"    float pressure_a = float(pressures & 0xFFFF) / 65535.0;\n"
+"    float pressure_b = float((pressures >> 16) & 0xFFFF) / 65535.0;\n"
+"#else\n"
+"    vec2 corner_uv = a_corner;\n"
+"    vec2 pointa = a_pointa;\n"
+"    vec2 pointb = a_pointb;\n"
+"    vec2 origin = vec2(u_stroke_origin);\n"
+"    float radius = float(u_radius);\n"
+"    float stroke_z = u_stroke_z;\n"
+"\n"
+"    float pressure_a = a_pressures.x / 65535.0;\n"
+"    float pressure_b = a_pressures.y / 65535.0;\n"
+"#endif\n"
+"\n"
+"    vec2 a = pointa + origin;\n"
+"    vec2 b = pointb + origin;\n"
+"\n"
+"    v_pointa = vec3(a, pressure_a);\n"
+"    v_pointb = vec3(b, pressure_b);\n"
+"\n"
+"#if STROKE_DEBUG_VIZ\n"
+"    v_debug_color = a_debug_color;\n"
+"#endif\n"
+"\n"
+"    // Bounding box of the segment, aligned with it.\n"
+"    float rad = radius * max(pressure_a, pressure_b);\n"
+"    vec2 d = vec2(1.0, 0.0);\n"
+"    if ( a != b ) {\n"
+"        d = normalize(b - a);\n"
+"    }\n"
+"    vec2 n = vec2(d.y, -d.x);\n"
+"    vec2 corner = mix(a - d*rad, b + d*rad, corner_uv.x) + (2.0*corner_uv.y - 1.0) * rad * n;\n"
+"\n"
+"    gl_Position.xy = canvas_to_raster_gl(corner);\n"
+"    gl_Position.w = 1;\n"
+"\n"
+"    gl_Position.z = stroke_z / MAX_DEPTH_VALUE;\n"
+"}\n"
+;
+static char g_stroke_raster_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"#ifndef STROKE_BATCH\n"
+"#define STROKE_BATCH 0\n"
+"#endif\n"
+"\n"
+"in vec3 v_pointa;\n"
+"in vec3 v_pointb;\n"
+"\n"
+"#if STROKE_BATCH\n"
+"flat in vec4  v_color;\n"
+"flat in float v_radius;\n"
+"#endif\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);\n"
+"\n"
+"    vec2 canvas_point = raster_to_canvas_gl(screen_point);\n"
+"    vec2 a = v_pointa.xy;\n"
+"    vec2 b = v_pointb.xy;\n"
+"\n"
+"    vec2 ab = b - a;\n"
+"    float len_ab = length(ab);\n"
+"\n"
+"    float t = clamp(dot((canvas_point - a)/len_ab, ab / len_ab), 0.0, 1.0);\n"
+"\n"
+"    vec2 stroke_point = mix(a, b, t);\n"
+"\n"
+"    float pressure = mix(v_pointa.z, v_pointb.z, t);\n"
+"\n"
+"#if STROKE_BATCH\n"
+"    vec4 color = v_color;\n"
+"    float radius = v_radius;\n"
+"#else\n"
+"    vec4 color = u_brush_color;\n"
+"    float radius = float(u_radius);\n"
+"#endif\n"
+"\n"
+"    // Distance between fragment and stroke\n"
+"    float dist = distance(stroke_point, canvas_point) - radius*pressure;\n"
+"\n"
+"    if ( dist < 0 ) {\n"
+"        out_color = color;\n"
+"    } else {\n"
+"        discard;\n"
+"    }\n"
+"}\n"
+;
+static char g_stroke_eraser_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec3 v_pointa;\n"
+"in vec3 v_pointb;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);\n"
+"\n"
+"    vec2 canvas_point = raster_to_canvas_gl(screen_point);\n"
+"    vec2 a = v_pointa.xy;\n"
+"    vec2 b = v_pointb.xy;\n"
+"\n"
+"    vec2 ab = b - a;\n"
+"    float len_ab = length(ab);\n"
+"\n"
+"    float t = clamp(dot((canvas_point - a)/len_ab, ab / len_ab), 0.0, 1.0);\n"
+"\n"
+"    vec2 stroke_point = mix(a, b, t);\n"
+"\n"
+"    float pressure = mix(v_pointa.z, v_pointb.z, t);\n"
+"\n"
+"    // Distance between fragment and stroke\n"
+"    float dist = distance(stroke_point, canvas_point) - u_radius*pressure;\n"
+"\n"
+"    if ( dist < 0 ) {\n"
+"        // Drawn with glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA), which\n"
+"        // clears the layer under the stroke.\n"
+"        out_color = vec4(1.0);\n"
+"    } else {\n"
+"        discard;\n"
+"    }\n"
+"}//END\n"
+;
+static char g_stroke_info_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2019 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec3 v_pointa;\n"
+"in vec3 v_pointb;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);\n"
+"\n"
+"    vec2 canvas_point = raster_to_canvas_gl(screen_point);\n"
+"    vec2 a = v_pointa.xy;\n"
+"    vec2 b = v_pointb.xy;\n"
+"\n"
+"    vec2 ab = b - a;\n"
+"    float len_ab = length(ab);\n"
+"\n"
+"    float t = clamp(dot((canvas_point - a)/len_ab, ab / len_ab), 0.0, 1.0);\n"
+"\n"
+"    vec2 stroke_point = mix(a, b, t);\n"
+"\n"
+"    float pressure = mix(v_pointa.z, v_pointb.z, t);\n"
+"\n"
+"    // Distance between fragment and stroke\n"
+"    float dist = distance(stroke_point, canvas_point);\n"
+"\n"
+"    float rad = u_radius * pressure;\n"
+"    out_color.r = dist / rad;\n"
+"    out_color.a = 0.0f;\n"
+"    if (dist < rad) {\n"
+"        out_color.a = pressure;\n"
+"    }\n"
+"}\n"
+;
+static char g_stroke_fill_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"uniform float u_opacity_min;\n"
+"uniform float u_hardness;\n"
+"uniform sampler2D u_info;\n"
+"uniform vec2 u_info_size;   // Size of u_info, in pixels. The stroke may be drawn into a corner of it.\n"
+"\n"
+"#ifndef PRESSURE_TO_OPACITY\n"
+"#define PRESSURE_TO_OPACITY 1\n"
+"#endif\n"
+"\n"
+"#ifndef DISTANCE_TO_OPACITY\n"
+"#define DISTANCE_TO_OPACITY 0\n"
+"#endif\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 coord = gl_FragCoord.xy / u_info_size;\n"
+"    vec2 stroke_info = texture(u_info, coord).ra;\n"
+"    float pressure = stroke_info.y;\n"
+"    if ( stroke_info.x < 1.0f  ) {\n"
+"        out_color = u_brush_color;\n"
+"        #if PRESSURE_TO_OPACITY\n"
+"            out_color *= (1.0f - u_opacity_min) * pressure + u_opacity_min;\n"
+"        #endif\n"
+"        #if DISTANCE_TO_OPACITY\n"
+"            out_color *= pow(1 - (stroke_info.x), 1.0f / u_hardness);\n"
+"        #endif\n"
+"    }\n"
+"    else {\n"
+"        discard;\n"
+"    }\n"
+"}\n"
+;
+static char g_stroke_clear_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"void\n"
+"main()\n"
+"{\n"
+"    out_color = vec4(1.0f, 0.0f, 0.0f, 0.0f);\n"
+"}\n"
+;
+static char g_stroke_soft_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"// Strokes with pressure or distance to opacity, in a single pass.\n"
+"//\n"
+"// The segments of a stroke overlap, and a pixel takes the opacity of the\n"
+"// closest one. Every fragment looks at the segments around its own, and only\n"
+"// the first segment that covers the pixel writes it. renderer.cc makes sure\n"
+"// that segments that cover the same pixel are at most a window apart. See\n"
+"// stroke_soft_window.\n"
+"\n"
+"uniform isamplerBuffer u_segments;\n"
+"\n"
+"flat in vec4  v_color;\n"
+"flat in float v_radius;\n"
+"flat in int   v_segment;\n"
+"flat in ivec3 v_stroke_range;\n"
+"flat in vec2  v_origin;\n"
+"flat in vec2  v_opacity;\n"
+"\n"
+"// x: Distance from the point to the segment, over the radius there. Covered\n"
+"// when less than 1.\n"
+"// y: Pressure at the closest point.\n"
+"vec2\n"
+"segment_distance(int segment, vec2 canvas_point)\n"
+"{\n"
+"    int base = 6*segment;\n"
+"    vec2 a = v_origin + vec2(texelFetch(u_segments, base + 0).x, texelFetch(u_segments, base + 1).x);\n"
+"    vec2 b = v_origin + vec2(texelFetch(u_segments, base + 2).x, texelFetch(u_segments, base + 3).x);\n"
+"    int pressures = texelFetch(u_segments, base + 4).x;\n"
+"\n"
+"    vec2 ab = b - a;\n"
+"    float len_ab = length(ab);\n"
+"\n"
+"    float t = 0.0;\n"
+"    if ( len_ab > 0.0 ) {\n"
+"        t = clamp(dot((canvas_point - a)/len_ab, ab / len_ab), 0.0, 1.0);\n"
+"    }\n"
+"\n"
+"    vec2 stroke_point = mix(a, b, t);\n"
+"\n"
+"    float pressure = mix(float(pressures & 0xFFFF), float((pressures >> 16) & 0xFFFF), t) / 65535.0;\n"
+"\n"
+"    return vec2(distance(stroke_point, canvas_point) / (v_radius * pressure), pressure);\n"
+"}\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);\n"
+"\n"
+"    vec2 canvas_point = raster_to_canvas_gl(screen_point);\n"
+"\n"
+"    int first = max(v_stroke_range.x, v_segment - v_stroke_range.z);\n"
+"    int last = min(v_stroke_range.x + v_stroke_range.y - 1, v_segment + v_stroke_range.z);\n"
+"\n"
+"    // Same as the GL_MIN / GL_MAX blending of stroke_info.f.glsl\n"
+"    float min_distance = 1.0;\n"
+"    float max_pressure = 0.0;\n"
+"    int owner = -1;\n"
+"    for ( int s = first; s <= last; ++s ) {\n"
+"        vec2 d = segment_distance(s, canvas_point);\n"
+"        if ( d.x < 1.0 ) {\n"
+"            if ( owner < 0 ) {\n"
+"                owner = s;\n"
+"            }\n"
+"            min_distance = min(min_distance, d.x);\n"
+"            max_pressure = max(max_pressure, d.y);\n"
+"        }\n"
+"    }\n"
+"\n"
+"    if ( owner != v_segment ) {\n"
+"        discard;\n"
+"    }\n"
+"\n"
+"    // The minimum opacity is 1 without pressure to opacity, and the hardness\n"
+"    // is 0 without distance to opacity.\n"
+"    out_color = v_color;\n"
+"    out_color *= (1.0f - v_opacity.x) * max_pressure + v_opacity.x;\n"
+"    if ( v_opacity.y > 0.0 ) {\n"
+"        out_color *= pow(1 - min_distance, 1.0f / v_opacity.y);\n"
+"    }\n"
+"}\n"
+;
+static char g_stroke_debug_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"// Per-stroke uniforms\n"
+"uniform vec4 u_brush_color;\n"
+"\n"
+"// CanvasView elements. Shared by every stroke program. See ViewUniforms in renderer.cc\n"
+"#if HAS_UNIFORM_BLOCKS\n"
+"layout(std140) uniform ViewBlock\n"
+"{\n"
+"    mat2  u_rotation;\n"
+"    mat2  u_rotation_inverse;\n"
+"    ivec2 u_pan_center;\n"
+"    vec2  u_zoom_center;\n"
+"    vec2  u_screen_size;\n"
+"    int   u_scale;\n"
+"};\n"
+"#else\n"
+"uniform mat2 u_rotation;\n"
+"uniform mat2 u_rotation_inverse;\n"
+"uniform ivec2 u_pan_center;\n"
+"uniform vec2  u_zoom_center;\n"
+"uniform vec2  u_screen_size;\n"
+"uniform int   u_scale;\n"
+"#endif\n"
+"uniform int   u_radius;\n"
+"\n"
+"vec2\n"
+"canvas_to_raster_gl(vec2 cp)\n"
+"{\n"
+"    vec2 xy = (cp - u_pan_center) / u_scale;\n"
+"\n"
+"    vec2 rp = ( (u_rotation_inverse * xy) + u_zoom_center ) / u_screen_size;\n"
+"\n"
+"    // rp in [0, 1]x[0, 1]\n"
+"\n"
+"    rp *= 2.0;\n"
+"    rp -= 1.0;\n"
+"    /* // rp in [-1, 1]x[-1, 1] */\n"
+"\n"
+"    rp.y *= -1.0;\n"
+"\n"
+"    return vec2(rp);\n"
+"}\n"
+"\n"
+"vec2\n"
+"raster_to_canvas_gl(vec2 raster_point)\n"
+"{\n"
+"    vec2 canvas_point = (u_rotation * (raster_point - u_zoom_center) * u_scale) + vec2(u_pan_center);\n"
+"\n"
+"    return canvas_point;\n"
+"}\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec3 v_pointa;\n"
+"in vec3 v_pointb;\n"
+"\n"
+"uniform sampler2D u_canvas;\n"
+"\n"
+"in vec3 v_debug_color;\n"
+"\n"
+"// TODO: This whole shader should be a variation in stroke_raster.f.glsl\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);\n"
+"\n"
+"    vec2 canvas_point = raster_to_canvas_gl(screen_point);\n"
+"\n"
+"    vec2 a = v_pointa.xy;\n"
+"    vec2 b = v_pointb.xy;\n"
+"    vec2 ab = b - a;\n"
+"    float len_ab = length(ab);\n"
+"\n"
+"    float t = clamp(dot(canvas_point - a, ab)/len_ab, 0.0, len_ab) / len_ab;\n"
+"    vec2 stroke_point = mix(a, b, t);\n"
+"    float pressure = mix(v_pointa.z, v_pointb.z, t);\n"
+"\n"
+"    if ( distance(canvas_point, a) < u_radius*0.1 ) {\n"
+"        out_color = vec4(v_debug_color, 1.0);\n"
+"    } else {\n"
+"        discard;\n"
+"    }\n"
+"}//END\n"
+;
+static char g_exporter_rect_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    uniform sampler2DMS u_canvas;\n"
+"#else\n"
+"    uniform sampler2D u_canvas;\n"
+"#endif\n"
+"\n"
+"uniform vec2      u_screen_size;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 coord = gl_FragCoord.xy / u_screen_size;\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    vec3 color = texelFetch(u_canvas, ivec2(gl_FragCoord.xy), 0).rgb;\n"
+"#else\n"
+"    vec3 color = texture(u_canvas, coord).rgb;\n"
+"#endif\n"
+"\n"
+"\n"
+"    out_color = vec4(vec3(1)-color, 1);\n"
+"}\n"
+;
+static char g_texture_fill_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"\n"
+"uniform float u_alpha;\n"
+"\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    uniform sampler2DMS u_canvas;\n"
+"#else\n"
+"    uniform sampler2D u_canvas;\n"
+"#endif\n"
+"uniform vec2 u_screen_size;\n"
+"uniform ivec2 u_offset;     // In pixels. Zero except when gpu_pan_copy moves the canvas.\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"#if HAS_TEXTURE_MULTISAMPLE\n"
+"    vec4 color = texelFetch(u_canvas, ivec2(gl_FragCoord.xy) - u_offset, gl_SampleID);\n"
+"#else\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, gl_FragCoord.y) - vec2(u_offset);\n"
+"    vec2 coord = screen_point / u_screen_size;\n"
+"    vec4 color = texture(u_canvas, coord);\n"
+"#endif\n"
+"    out_color = color;\n"
+"    out_color *= u_alpha;\n"
+"}\n"
+;
+static char g_quad_v[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"in vec2 a_point;\n"
+"in vec2 a_uv;\n"
+"out vec2 v_uv;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    v_uv = a_uv;\n"
+"    gl_Position = vec4(a_point, 0,1);\n"
+"}\n"
+;
+static char g_quad_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"uniform sampler2D u_canvas;\n"
+"in vec2 v_uv;\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    // vec4 color = texture2D(u_canvas, v_uv);\n"
+"    vec4 color = texture(u_canvas, v_uv);\n"
+"\n"
+"    out_color = color;\n"
+"}\n"
+;
+static char g_postproc_f[] = 
+"\n"
+"//\n"
+"\n"
+"#define FXAA_GREEN_AS_LUMA 1  // TODO: pack luma into alpha\n"
+"#define FXAA_GLSL_120 1\n"
+"#define FXAA_PC 1\n"
+"#define FXAA_QUALITY__PRESET 39\n"
+"#define FXAA_GATHER4_ALPHA 0\n"
+"\n"
+"#define texture2DLod(s,v,f) texture(s,v)\n"
+"\n"
+"#define FXAA_FAST_PIXEL_OFFSET 0\n"
+"    // At least one Intel GPU on Linux does not define texture2DLodOffset when GL_ARB_gpu_shader5 is\n"
+"    // enabled. FXAA checks for GL_*_gpu_shader5 to use texture2DLodOffset but it seems like it's\n"
+"    // only officially supported for shader4.\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                             INTEGRATION KNOBS\n"
+"\n"
+"============================================================================*/\n"
+"//\n"
+"// FXAA_PS3 and FXAA_360 choose the console algorithm (FXAA3 CONSOLE).\n"
+"// FXAA_360_OPT is a prototype for the new optimized 360 version.\n"
+"//\n"
+"// 1 = Use API.\n"
+"// 0 = Don't use API.\n"
+"//\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_PS3\n"
+"    #define FXAA_PS3 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_360\n"
+"    #define FXAA_360 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_360_OPT\n"
+"    #define FXAA_360_OPT 0\n"
+"#endif\n"
+"/*==========================================================================*/\n"
+"#ifndef FXAA_PC\n"
+"    //\n"
+"    // FXAA Quality\n"
+"    // The high quality PC algorithm.\n"
+"    //\n"
+"    #define FXAA_PC 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_PC_CONSOLE\n"
+"    //\n"
+"    // The console algorithm for PC is included\n"
+"    // for developers targeting really low spec machines.\n"
+"    // Likely better to just run FXAA_PC, and use a really low preset.\n"
+"    //\n"
+"    #define FXAA_PC_CONSOLE 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_GLSL_120\n"
+"    #define FXAA_GLSL_120 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_GLSL_130\n"
+"    #define FXAA_GLSL_130 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_HLSL_3\n"
+"    #define FXAA_HLSL_3 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_HLSL_4\n"
+"    #define FXAA_HLSL_4 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_HLSL_5\n"
+"    #define FXAA_HLSL_5 0\n"
+"#endif\n"
+"/*==========================================================================*/\n"
+"#ifndef FXAA_GREEN_AS_LUMA\n"
+"    //\n"
+"    // For those using non-linear color,\n"
+"    // and either not able to get luma in alpha, or not wanting to,\n"
+"    // this enables FXAA to run using green as a proxy for luma.\n"
+"    // So with this enabled, no need to pack luma in alpha.\n"
+"    //\n"
+"    // This will turn off AA on anything which lacks some amount of green.\n"
+"    // Pure red and blue or combination of only R and B, will get no AA.\n"
+"    //\n"
+"    // Might want to lower the settings for both,\n"
+"    //    fxaaConsoleEdgeThresholdMin\n"
+"    //    fxaaQualityEdgeThresholdMin\n"
+"    // In order to insure AA does not get turned off on colors\n"
+"    // which contain a minor amount of green.\n"
+"    //\n"
+"    // 1 = On.\n"
+"    // 0 = Off.\n"
+"    //\n"
+"    #define FXAA_GREEN_AS_LUMA 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_EARLY_EXIT\n"
+"    //\n"
+"    // Controls algorithm's early exit path.\n"
+"    // On PS3 turning this ON adds 2 cycles to the shader.\n"
+"    // On 360 turning this OFF adds 10ths of a millisecond to the shader.\n"
+"    // Turning this off on console will result in a more blurry image.\n"
+"    // So this defaults to on.\n"
+"    //\n"
+"    // 1 = On.\n"
+"    // 0 = Off.\n"
+"    //\n"
+"    #define FXAA_EARLY_EXIT 1\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_DISCARD\n"
+"    //\n"
+"    // Only valid for PC OpenGL currently.\n"
+"    // Probably will not work when FXAA_GREEN_AS_LUMA = 1.\n"
+"    //\n"
+"    // 1 = Use discard on pixels which don't need AA.\n"
+"    //     For APIs which enable concurrent TEX+ROP from same surface.\n"
+"    // 0 = Return unchanged color on pixels which don't need AA.\n"
+"    //\n"
+"    #define FXAA_DISCARD 0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_FAST_PIXEL_OFFSET\n"
+"    //\n"
+"    // Used for GLSL 120 only.\n"
+"    //\n"
+"    // 1 = GL API supports fast pixel offsets\n"
+"    // 0 = do not use fast pixel offsets\n"
+"    //\n"
+"    #ifdef GL_EXT_gpu_shader4\n"
+"        #define FXAA_FAST_PIXEL_OFFSET 1\n"
+"    #endif\n"
+"    #ifdef GL_NV_gpu_shader5\n"
+"        #define FXAA_FAST_PIXEL_OFFSET 1\n"
+"    #endif\n"
+"    #ifdef GL_ARB_gpu_shader5\n"
+"        #define FXAA_FAST_PIXEL_OFFSET 1\n"
+"    #endif\n"
+"    #ifndef FXAA_FAST_PIXEL_OFFSET\n"
+"        #define FXAA_FAST_PIXEL_OFFSET 0\n"
+"    #endif\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_GATHER4_ALPHA\n"
+"    //\n"
+"    // 1 = API supports gather4 on alpha channel.\n"
+"    // 0 = API does not support gather4 on alpha channel.\n"
+"    //\n"
+"    #if (FXAA_HLSL_5 == 1)\n"
+"        #define FXAA_GATHER4_ALPHA 1\n"
+"    #endif\n"
+"    #ifdef GL_ARB_gpu_shader5\n"
+"        #define FXAA_GATHER4_ALPHA 1\n"
+"    #endif\n"
+"    #ifdef GL_NV_gpu_shader5\n"
+"        #define FXAA_GATHER4_ALPHA 1\n"
+"    #endif\n"
+"    #ifndef FXAA_GATHER4_ALPHA\n"
+"        #define FXAA_GATHER4_ALPHA 0\n"
+"    #endif\n"
+"#endif\n"
+"\n"
+"/*============================================================================\n"
+"                      FXAA CONSOLE PS3 - TUNING KNOBS\n"
+"============================================================================*/\n"
+"#ifndef FXAA_CONSOLE__PS3_EDGE_SHARPNESS\n"
+"    //\n"
+"    // Consoles the sharpness of edges on PS3 only.\n"
+"    // Non-PS3 tuning is done with shader input.\n"
+"    //\n"
+"    // Due to the PS3 being ALU bound,\n"
+"    // there are only two safe values here: 4 and 8.\n"
+"    // These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"    //\n"
+"    // 8.0 is sharper\n"
+"    // 4.0 is softer\n"
+"    // 2.0 is really soft (good for vector graphics inputs)\n"
+"    //\n"
+"    #if 1\n"
+"        #define FXAA_CONSOLE__PS3_EDGE_SHARPNESS 8.0\n"
+"    #endif\n"
+"    #if 0\n"
+"        #define FXAA_CONSOLE__PS3_EDGE_SHARPNESS 4.0\n"
+"    #endif\n"
+"    #if 0\n"
+"        #define FXAA_CONSOLE__PS3_EDGE_SHARPNESS 2.0\n"
+"    #endif\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#ifndef FXAA_CONSOLE__PS3_EDGE_THRESHOLD\n"
+"    //\n"
+"    // Only effects PS3.\n"
+"    // Non-PS3 tuning is done with shader input.\n"
+"    //\n"
+"    // The minimum amount of local contrast required to apply algorithm.\n"
+"    // The console setting has a different mapping than the quality setting.\n"
+"    //\n"
+"    // This only applies when FXAA_EARLY_EXIT is 1.\n"
+"    //\n"
+"    // Due to the PS3 being ALU bound,\n"
+"    // there are only two safe values here: 0.25 and 0.125.\n"
+"    // These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"    //\n"
+"    // 0.125 leaves less aliasing, but is softer\n"
+"    // 0.25 leaves more aliasing, and is sharper\n"
+"    //\n"
+"    #if 1\n"
+"        #define FXAA_CONSOLE__PS3_EDGE_THRESHOLD 0.125\n"
+"    #else\n"
+"        #define FXAA_CONSOLE__PS3_EDGE_THRESHOLD 0.25\n"
+"    #endif\n"
+"#endif\n"
+"\n"
+"/*============================================================================\n"
+"                        FXAA QUALITY - TUNING KNOBS\n"
+"------------------------------------------------------------------------------\n"
+"NOTE the other tuning knobs are now in the shader function inputs!\n"
+"============================================================================*/\n"
+"#ifndef FXAA_QUALITY__PRESET\n"
+"    //\n"
+"    // Choose the quality preset.\n"
+"    // This needs to be compiled into the shader as it effects code.\n"
+"    // Best option to include multiple presets is to\n"
+"    // in each shader define the preset, then include this file.\n"
+"    //\n"
+"    // OPTIONS\n"
+"    // -----------------------------------------------------------------------\n"
+"    // 10 to 15 - default medium dither (10=fastest, 15=highest quality)\n"
+"    // 20 to 29 - less dither, more expensive (20=fastest, 29=highest quality)\n"
+"    // 39       - no dither, very expensive\n"
+"    //\n"
+"    // NOTES\n"
+"    // -----------------------------------------------------------------------\n"
+"    // 12 = slightly faster then FXAA 3.9 and higher edge quality (default)\n"
+"    // 13 = about same speed as FXAA 3.9 and better than 12\n"
+"    // 23 = closest to FXAA 3.9 visually and performance wise\n"
+"    //  _ = the lowest digit is directly related to performance\n"
+"    // _  = the highest digit is directly related to style\n"
+"    //\n"
+"    #define FXAA_QUALITY__PRESET 12\n"
+"#endif\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                           FXAA QUALITY - PRESETS\n"
+"\n"
+"============================================================================*/\n"
+"\n"
+"/*============================================================================\n"
+"                     FXAA QUALITY - MEDIUM DITHER PRESETS\n"
+"============================================================================*/\n"
+"#if (FXAA_QUALITY__PRESET == 10)\n"
+"    #define FXAA_QUALITY__PS 3\n"
+"    #define FXAA_QUALITY__P0 1.5\n"
+"    #define FXAA_QUALITY__P1 3.0\n"
+"    #define FXAA_QUALITY__P2 12.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 11)\n"
+"    #define FXAA_QUALITY__PS 4\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 3.0\n"
+"    #define FXAA_QUALITY__P3 12.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 12)\n"
+"    #define FXAA_QUALITY__PS 5\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 4.0\n"
+"    #define FXAA_QUALITY__P4 12.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 13)\n"
+"    #define FXAA_QUALITY__PS 6\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 4.0\n"
+"    #define FXAA_QUALITY__P5 12.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 14)\n"
+"    #define FXAA_QUALITY__PS 7\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 4.0\n"
+"    #define FXAA_QUALITY__P6 12.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 15)\n"
+"    #define FXAA_QUALITY__PS 8\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 4.0\n"
+"    #define FXAA_QUALITY__P7 12.0\n"
+"#endif\n"
+"\n"
+"/*============================================================================\n"
+"                     FXAA QUALITY - LOW DITHER PRESETS\n"
+"============================================================================*/\n"
+"#if (FXAA_QUALITY__PRESET == 20)\n"
+"    #define FXAA_QUALITY__PS 3\n"
+"    #define FXAA_QUALITY__P0 1.5\n"
+"    #define FXAA_QUALITY__P1 2.0\n"
+"    #define FXAA_QUALITY__P2 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 21)\n"
+"    #define FXAA_QUALITY__PS 4\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 22)\n"
+"    #define FXAA_QUALITY__PS 5\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 23)\n"
+"    #define FXAA_QUALITY__PS 6\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 24)\n"
+"    #define FXAA_QUALITY__PS 7\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 3.0\n"
+"    #define FXAA_QUALITY__P6 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 25)\n"
+"    #define FXAA_QUALITY__PS 8\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 4.0\n"
+"    #define FXAA_QUALITY__P7 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 26)\n"
+"    #define FXAA_QUALITY__PS 9\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 2.0\n"
+"    #define FXAA_QUALITY__P7 4.0\n"
+"    #define FXAA_QUALITY__P8 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 27)\n"
+"    #define FXAA_QUALITY__PS 10\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 2.0\n"
+"    #define FXAA_QUALITY__P7 2.0\n"
+"    #define FXAA_QUALITY__P8 4.0\n"
+"    #define FXAA_QUALITY__P9 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 28)\n"
+"    #define FXAA_QUALITY__PS 11\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 2.0\n"
+"    #define FXAA_QUALITY__P7 2.0\n"
+"    #define FXAA_QUALITY__P8 2.0\n"
+"    #define FXAA_QUALITY__P9 4.0\n"
+"    #define FXAA_QUALITY__P10 8.0\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_QUALITY__PRESET == 29)\n"
+"    #define FXAA_QUALITY__PS 12\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.5\n"
+"    #define FXAA_QUALITY__P2 2.0\n"
+"    #define FXAA_QUALITY__P3 2.0\n"
+"    #define FXAA_QUALITY__P4 2.0\n"
+"    #define FXAA_QUALITY__P5 2.0\n"
+"    #define FXAA_QUALITY__P6 2.0\n"
+"    #define FXAA_QUALITY__P7 2.0\n"
+"    #define FXAA_QUALITY__P8 2.0\n"
+"    #define FXAA_QUALITY__P9 2.0\n"
+"    #define FXAA_QUALITY__P10 4.0\n"
+"    #define FXAA_QUALITY__P11 8.0\n"
+"#endif\n"
+"\n"
+"/*============================================================================\n"
+"                     FXAA QUALITY - EXTREME QUALITY\n"
+"============================================================================*/\n"
+"#if (FXAA_QUALITY__PRESET == 39)\n"
+"    #define FXAA_QUALITY__PS 12\n"
+"    #define FXAA_QUALITY__P0 1.0\n"
+"    #define FXAA_QUALITY__P1 1.0\n"
+"    #define FXAA_QUALITY__P2 1.0\n"
+"    #define FXAA_QUALITY__P3 1.0\n"
+"    #define FXAA_QUALITY__P4 1.0\n"
+"    #define FXAA_QUALITY__P5 1.5\n"
+"    #define FXAA_QUALITY__P6 2.0\n"
+"    #define FXAA_QUALITY__P7 2.0\n"
+"    #define FXAA_QUALITY__P8 2.0\n"
+"    #define FXAA_QUALITY__P9 2.0\n"
+"    #define FXAA_QUALITY__P10 4.0\n"
+"    #define FXAA_QUALITY__P11 8.0\n"
+"#endif\n"
+"\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                                API PORTING\n"
+"\n"
+"============================================================================*/\n"
+"#if (FXAA_GLSL_120 == 1) || (FXAA_GLSL_130 == 1)\n"
+"    #define FxaaBool bool\n"
+"    #define FxaaDiscard discard\n"
+"    #define FxaaFloat float\n"
+"    #define FxaaFloat2 vec2\n"
+"    #define FxaaFloat3 vec3\n"
+"    #define FxaaFloat4 vec4\n"
+"    #define FxaaHalf float\n"
+"    #define FxaaHalf2 vec2\n"
+"    #define FxaaHalf3 vec3\n"
+"    #define FxaaHalf4 vec4\n"
+"    #define FxaaInt2 ivec2\n"
+"    #define FxaaSat(x) clamp(x, 0.0, 1.0)\n"
+"    #define FxaaTex sampler2D\n"
+"#else\n"
+"    #define FxaaBool bool\n"
+"    #define FxaaDiscard clip(-1)\n"
+"    #define FxaaFloat float\n"
+"    #define FxaaFloat2 float2\n"
+"    #define FxaaFloat3 float3\n"
+"    #define FxaaFloat4 float4\n"
+"    #define FxaaHalf half\n"
+"    #define FxaaHalf2 half2\n"
+"    #define FxaaHalf3 half3\n"
+"    #define FxaaHalf4 half4\n"
+"    #define FxaaSat(x) saturate(x)\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_GLSL_120 == 1)\n"
+"    // Requires,\n"
+"    //  #version 120\n"
+"    // And at least,\n"
+"    //  #extension GL_EXT_gpu_shader4 : enable\n"
+"    //  (or set FXAA_FAST_PIXEL_OFFSET 1 to work like DX9)\n"
+"    #define FxaaTexTop(t, p) texture2DLod(t, p, 0.0)\n"
+"    #if (FXAA_FAST_PIXEL_OFFSET == 1)\n"
+"        #define FxaaTexOff(t, p, o, r) texture2DLodOffset(t, p, 0.0, o)\n"
+"    #else\n"
+"        #define FxaaTexOff(t, p, o, r) texture2DLod(t, p + (o * r), 0.0)\n"
+"    #endif\n"
+"    #if (FXAA_GATHER4_ALPHA == 1)\n"
+"        // use #extension GL_ARB_gpu_shader5 : enable\n"
+"        #define FxaaTexAlpha4(t, p) textureGather(t, p, 3)\n"
+"        #define FxaaTexOffAlpha4(t, p, o) textureGatherOffset(t, p, o, 3)\n"
+"        #define FxaaTexGreen4(t, p) textureGather(t, p, 1)\n"
+"        #define FxaaTexOffGreen4(t, p, o) textureGatherOffset(t, p, o, 1)\n"
+"    #endif\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_GLSL_130 == 1)\n"
+"    // Requires Q#version 130Q or better\n"
+"    #define FxaaTexTop(t, p) textureLod(t, p, 0.0)\n"
+"    #define FxaaTexOff(t, p, o, r) textureLodOffset(t, p, 0.0, o)\n"
+"    #if (FXAA_GATHER4_ALPHA == 1)\n"
+"        // use #extension GL_ARB_gpu_shader5 : enable\n"
+"        #define FxaaTexAlpha4(t, p) textureGather(t, p, 3)\n"
+"        #define FxaaTexOffAlpha4(t, p, o) textureGatherOffset(t, p, o, 3)\n"
+"        #define FxaaTexGreen4(t, p) textureGather(t, p, 1)\n"
+"        #define FxaaTexOffGreen4(t, p, o) textureGatherOffset(t, p, o, 1)\n"
+"    #endif\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_HLSL_3 == 1) || (FXAA_360 == 1) || (FXAA_PS3 == 1)\n"
+"    #define FxaaInt2 float2\n"
+"    #define FxaaTex sampler2D\n"
+"    #define FxaaTexTop(t, p) tex2Dlod(t, float4(p, 0.0, 0.0))\n"
+"    #define FxaaTexOff(t, p, o, r) tex2Dlod(t, float4(p + (o * r), 0, 0))\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_HLSL_4 == 1)\n"
+"    #define FxaaInt2 int2\n"
+"    struct FxaaTex { SamplerState smpl; Texture2D tex; };\n"
+"    #define FxaaTexTop(t, p) t.tex.SampleLevel(t.smpl, p, 0.0)\n"
+"    #define FxaaTexOff(t, p, o, r) t.tex.SampleLevel(t.smpl, p, 0.0, o)\n"
+"#endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"#if (FXAA_HLSL_5 == 1)\n"
+"    #define FxaaInt2 int2\n"
+"    struct FxaaTex { SamplerState smpl; Texture2D tex; };\n"
+"    #define FxaaTexTop(t, p) t.tex.SampleLevel(t.smpl, p, 0.0)\n"
+"    #define FxaaTexOff(t, p, o, r) t.tex.SampleLevel(t.smpl, p, 0.0, o)\n"
+"    #define FxaaTexAlpha4(t, p) t.tex.GatherAlpha(t.smpl, p)\n"
+"    #define FxaaTexOffAlpha4(t, p, o) t.tex.GatherAlpha(t.smpl, p, o)\n"
+"    #define FxaaTexGreen4(t, p) t.tex.GatherGreen(t.smpl, p)\n"
+"    #define FxaaTexOffGreen4(t, p, o) t.tex.GatherGreen(t.smpl, p, o)\n"
+"#endif\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"                   GREEN AS LUMA OPTION SUPPORT FUNCTION\n"
+"============================================================================*/\n"
+"#if (FXAA_GREEN_AS_LUMA == 0)\n"
+"    FxaaFloat FxaaLuma(FxaaFloat4 rgba) { return rgba.w; }\n"
+"#else\n"
+"    FxaaFloat FxaaLuma(FxaaFloat4 rgba) { return rgba.y; }\n"
+"#endif\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                             FXAA3 QUALITY - PC\n"
+"\n"
+"============================================================================*/\n"
+"#if (FXAA_PC == 1)\n"
+"/*--------------------------------------------------------------------------*/\n"
+"FxaaFloat4 FxaaPixelShader(\n"
+"    //\n"
+"    // Use noperspective interpolation here (turn off perspective interpolation).\n"
+"    // {xy} = center of pixel\n"
+"    FxaaFloat2 pos,\n"
+"    //\n"
+"    // Used only for FXAA Console, and not used on the 360 version.\n"
+"    // Use noperspective interpolation here (turn off perspective interpolation).\n"
+"    // {xy__} = upper left of pixel\n"
+"    // {__zw} = lower right of pixel\n"
+"    FxaaFloat4 fxaaConsolePosPos,\n"
+"    //\n"
+"    // Input color texture.\n"
+"    // {rgb_} = color in linear or perceptual color space\n"
+"    // if (FXAA_GREEN_AS_LUMA == 0)\n"
+"    //     {___a} = luma in perceptual color space (not linear)\n"
+"    FxaaTex tex,\n"
+"    //\n"
+"    // Only used on the optimized 360 version of FXAA Console.\n"
+"    // For everything but 360, just use the same input here as for QtexQ.\n"
+"    // For 360, same texture, just alias with a 2nd sampler.\n"
+"    // This sampler needs to have an exponent bias of -1.\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegOne,\n"
+"    //\n"
+"    // Only used on the optimized 360 version of FXAA Console.\n"
+"    // For everything but 360, just use the same input here as for QtexQ.\n"
+"    // For 360, same texture, just alias with a 3nd sampler.\n"
+"    // This sampler needs to have an exponent bias of -2.\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegTwo,\n"
+"    //\n"
+"    // Only used on FXAA Quality.\n"
+"    // This must be from a constant/uniform.\n"
+"    // {x_} = 1.0/screenWidthInPixels\n"
+"    // {_y} = 1.0/screenHeightInPixels\n"
+"    FxaaFloat2 fxaaQualityRcpFrame,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // This must be from a constant/uniform.\n"
+"    // This effects sub-pixel AA quality and inversely sharpness.\n"
+"    //   Where N ranges between,\n"
+"    //     N = 0.50 (default)\n"
+"    //     N = 0.33 (sharper)\n"
+"    // {x___} = -N/screenWidthInPixels\n"
+"    // {_y__} = -N/screenHeightInPixels\n"
+"    // {__z_} =  N/screenWidthInPixels\n"
+"    // {___w} =  N/screenHeightInPixels\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // Not used on 360, but used on PS3 and PC.\n"
+"    // This must be from a constant/uniform.\n"
+"    // {x___} = -2.0/screenWidthInPixels\n"
+"    // {_y__} = -2.0/screenHeightInPixels\n"
+"    // {__z_} =  2.0/screenWidthInPixels\n"
+"    // {___w} =  2.0/screenHeightInPixels\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt2,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // Only used on 360 in place of fxaaConsoleRcpFrameOpt2.\n"
+"    // This must be from a constant/uniform.\n"
+"    // {x___} =  8.0/screenWidthInPixels\n"
+"    // {_y__} =  8.0/screenHeightInPixels\n"
+"    // {__z_} = -4.0/screenWidthInPixels\n"
+"    // {___w} = -4.0/screenHeightInPixels\n"
+"    FxaaFloat4 fxaaConsole360RcpFrameOpt2,\n"
+"    //\n"
+"    // Only used on FXAA Quality.\n"
+"    // This used to be the FXAA_QUALITY__SUBPIX define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // Choose the amount of sub-pixel aliasing removal.\n"
+"    // This can effect sharpness.\n"
+"    //   1.00 - upper limit (softer)\n"
+"    //   0.75 - default amount of filtering\n"
+"    //   0.50 - lower limit (sharper, less sub-pixel aliasing removal)\n"
+"    //   0.25 - almost off\n"
+"    //   0.00 - completely off\n"
+"    FxaaFloat fxaaQualitySubpix,\n"
+"    //\n"
+"    // Only used on FXAA Quality.\n"
+"    // This used to be the FXAA_QUALITY__EDGE_THRESHOLD define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // The minimum amount of local contrast required to apply algorithm.\n"
+"    //   0.333 - too little (faster)\n"
+"    //   0.250 - low quality\n"
+"    //   0.166 - default\n"
+"    //   0.125 - high quality\n"
+"    //   0.063 - overkill (slower)\n"
+"    FxaaFloat fxaaQualityEdgeThreshold,\n"
+"    //\n"
+"    // Only used on FXAA Quality.\n"
+"    // This used to be the FXAA_QUALITY__EDGE_THRESHOLD_MIN define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // Trims the algorithm from processing darks.\n"
+"    //   0.0833 - upper limit (default, the start of visible unfiltered edges)\n"
+"    //   0.0625 - high quality (faster)\n"
+"    //   0.0312 - visible limit (slower)\n"
+"    // Special notes when using FXAA_GREEN_AS_LUMA,\n"
+"    //   Likely want to set this to zero.\n"
+"    //   As colors that are mostly not-green\n"
+"    //   will appear very dark in the green channel!\n"
+"    //   Tune by looking at mostly non-green content,\n"
+"    //   then start at zero and increase until aliasing is a problem.\n"
+"    FxaaFloat fxaaQualityEdgeThresholdMin,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // This used to be the FXAA_CONSOLE__EDGE_SHARPNESS define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // This does not effect PS3, as this needs to be compiled in.\n"
+"    //   Use FXAA_CONSOLE__PS3_EDGE_SHARPNESS for PS3.\n"
+"    //   Due to the PS3 being ALU bound,\n"
+"    //   there are only three safe values here: 2 and 4 and 8.\n"
+"    //   These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"    // For all other platforms can be a non-power of two.\n"
+"    //   8.0 is sharper (default!!!)\n"
+"    //   4.0 is softer\n"
+"    //   2.0 is really soft (good only for vector graphics inputs)\n"
+"    FxaaFloat fxaaConsoleEdgeSharpness,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // This used to be the FXAA_CONSOLE__EDGE_THRESHOLD define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // This does not effect PS3, as this needs to be compiled in.\n"
+"    //   Use FXAA_CONSOLE__PS3_EDGE_THRESHOLD for PS3.\n"
+"    //   Due to the PS3 being ALU bound,\n"
+"    //   there are only two safe values here: 1/4 and 1/8.\n"
+"    //   These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"    // The console setting has a different mapping than the quality setting.\n"
+"    // Other platforms can use other values.\n"
+"    //   0.125 leaves less aliasing, but is softer (default!!!)\n"
+"    //   0.25 leaves more aliasing, and is sharper\n"
+"    FxaaFloat fxaaConsoleEdgeThreshold,\n"
+"    //\n"
+"    // Only used on FXAA Console.\n"
+"    // This used to be the FXAA_CONSOLE__EDGE_THRESHOLD_MIN define.\n"
+"    // It is here now to allow easier tuning.\n"
+"    // Trims the algorithm from processing darks.\n"
+"    // The console setting has a different mapping than the quality setting.\n"
+"    // This only applies when FXAA_EARLY_EXIT is 1.\n"
+"    // This does not apply to PS3,\n"
+"    // PS3 was simplified to avoid more shader instructions.\n"
+"    //   0.06 - faster but more aliasing in darks\n"
+"    //   0.05 - default\n"
+"    //   0.04 - slower and less aliasing in darks\n"
+"    // Special notes when using FXAA_GREEN_AS_LUMA,\n"
+"    //   Likely want to set this to zero.\n"
+"    //   As colors that are mostly not-green\n"
+"    //   will appear very dark in the green channel!\n"
+"    //   Tune by looking at mostly non-green content,\n"
+"    //   then start at zero and increase until aliasing is a problem.\n"
+"    FxaaFloat fxaaConsoleEdgeThresholdMin,\n"
+"    //\n"
+"    // Extra constants for 360 FXAA Console only.\n"
+"    // Use zeros or anything else for other platforms.\n"
+"    // These must be in physical constant registers and NOT immedates.\n"
+"    // Immedates will result in compiler un-optimizing.\n"
+"    // {xyzw} = float4(1.0, -1.0, 0.25, -0.25)\n"
+"    FxaaFloat4 fxaaConsole360ConstDir\n"
+") {\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat2 posM;\n"
+"    posM.x = pos.x;\n"
+"    posM.y = pos.y;\n"
+"    #if (FXAA_GATHER4_ALPHA == 1)\n"
+"        #if (FXAA_DISCARD == 0)\n"
+"            FxaaFloat4 rgbyM = FxaaTexTop(tex, posM);\n"
+"            #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"                #define lumaM rgbyM.w\n"
+"            #else\n"
+"                #define lumaM rgbyM.y\n"
+"            #endif\n"
+"        #endif\n"
+"        #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"            FxaaFloat4 luma4A = FxaaTexAlpha4(tex, posM);\n"
+"            FxaaFloat4 luma4B = FxaaTexOffAlpha4(tex, posM, FxaaInt2(-1, -1));\n"
+"        #else\n"
+"            FxaaFloat4 luma4A = FxaaTexGreen4(tex, posM);\n"
+"            FxaaFloat4 luma4B = FxaaTexOffGreen4(tex, posM, FxaaInt2(-1, -1));\n"
+"        #endif\n"
+"        #if (FXAA_DISCARD == 1)\n"
+"            #define lumaM luma4A.w\n"
+"        #endif\n"
+"        #define lumaE luma4A.z\n"
+"        #define lumaS luma4A.x\n"
+"        #define lumaSE luma4A.y\n"
+"        #define lumaNW luma4B.w\n"
+"        #define lumaN luma4B.z\n"
+"        #define lumaW luma4B.x\n"
+"    #else\n"
+"        FxaaFloat4 rgbyM = FxaaTexTop(tex, posM);\n"
+"        #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"            #define lumaM rgbyM.w\n"
+"        #else\n"
+"            #define lumaM rgbyM.y\n"
+"        #endif\n"
+"        FxaaFloat lumaS = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2( 0, 1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2( 1, 0), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaN = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2( 0,-1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 0), fxaaQualityRcpFrame.xy));\n"
+"    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat maxSM = max(lumaS, lumaM);\n"
+"    FxaaFloat minSM = min(lumaS, lumaM);\n"
+"    FxaaFloat maxESM = max(lumaE, maxSM);\n"
+"    FxaaFloat minESM = min(lumaE, minSM);\n"
+"    FxaaFloat maxWN = max(lumaN, lumaW);\n"
+"    FxaaFloat minWN = min(lumaN, lumaW);\n"
+"    FxaaFloat rangeMax = max(maxWN, maxESM);\n"
+"    FxaaFloat rangeMin = min(minWN, minESM);\n"
+"    FxaaFloat rangeMaxScaled = rangeMax * fxaaQualityEdgeThreshold;\n"
+"    FxaaFloat range = rangeMax - rangeMin;\n"
+"    FxaaFloat rangeMaxClamped = max(fxaaQualityEdgeThresholdMin, rangeMaxScaled);\n"
+"    FxaaBool earlyExit = range < rangeMaxClamped;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    if(earlyExit)\n"
+"        #if (FXAA_DISCARD == 1)\n"
+"            FxaaDiscard;\n"
+"        #else\n"
+"            return rgbyM;\n"
+"        #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    #if (FXAA_GATHER4_ALPHA == 0)\n"
+"        FxaaFloat lumaNW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1,-1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaSE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2( 1, 1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2( 1,-1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));\n"
+"    #else\n"
+"        FxaaFloat lumaNE = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(1, -1), fxaaQualityRcpFrame.xy));\n"
+"        FxaaFloat lumaSW = FxaaLuma(FxaaTexOff(tex, posM, FxaaInt2(-1, 1), fxaaQualityRcpFrame.xy));\n"
+"    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaNS = lumaN + lumaS;\n"
+"    FxaaFloat lumaWE = lumaW + lumaE;\n"
+"    FxaaFloat subpixRcpRange = 1.0/range;\n"
+"    FxaaFloat subpixNSWE = lumaNS + lumaWE;\n"
+"    FxaaFloat edgeHorz1 = (-2.0 * lumaM) + lumaNS;\n"
+"    FxaaFloat edgeVert1 = (-2.0 * lumaM) + lumaWE;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaNESE = lumaNE + lumaSE;\n"
+"    FxaaFloat lumaNWNE = lumaNW + lumaNE;\n"
+"    FxaaFloat edgeHorz2 = (-2.0 * lumaE) + lumaNESE;\n"
+"    FxaaFloat edgeVert2 = (-2.0 * lumaN) + lumaNWNE;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaNWSW = lumaNW + lumaSW;\n"
+"    FxaaFloat lumaSWSE = lumaSW + lumaSE;\n"
+"    FxaaFloat edgeHorz4 = (abs(edgeHorz1) * 2.0) + abs(edgeHorz2);\n"
+"    FxaaFloat edgeVert4 = (abs(edgeVert1) * 2.0) + abs(edgeVert2);\n"
+"    FxaaFloat edgeHorz3 = (-2.0 * lumaW) + lumaNWSW;\n"
+"    FxaaFloat edgeVert3 = (-2.0 * lumaS) + lumaSWSE;\n"
+"    FxaaFloat edgeHorz = abs(edgeHorz3) + edgeHorz4;\n"
+"    FxaaFloat edgeVert = abs(edgeVert3) + edgeVert4;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat subpixNWSWNESE = lumaNWSW + lumaNESE;\n"
+"    FxaaFloat lengthSign = fxaaQualityRcpFrame.x;\n"
+"    FxaaBool horzSpan = edgeHorz >= edgeVert;\n"
+"    FxaaFloat subpixA = subpixNSWE * 2.0 + subpixNWSWNESE;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    if(!horzSpan) lumaN = lumaW;\n"
+"    if(!horzSpan) lumaS = lumaE;\n"
+"    if(horzSpan) lengthSign = fxaaQualityRcpFrame.y;\n"
+"    FxaaFloat subpixB = (subpixA * (1.0/12.0)) - lumaM;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat gradientN = lumaN - lumaM;\n"
+"    FxaaFloat gradientS = lumaS - lumaM;\n"
+"    FxaaFloat lumaNN = lumaN + lumaM;\n"
+"    FxaaFloat lumaSS = lumaS + lumaM;\n"
+"    FxaaBool pairN = abs(gradientN) >= abs(gradientS);\n"
+"    FxaaFloat gradient = max(abs(gradientN), abs(gradientS));\n"
+"    if(pairN) lengthSign = -lengthSign;\n"
+"    FxaaFloat subpixC = FxaaSat(abs(subpixB) * subpixRcpRange);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat2 posB;\n"
+"    posB.x = posM.x;\n"
+"    posB.y = posM.y;\n"
+"    FxaaFloat2 offNP;\n"
+"    offNP.x = (!horzSpan) ? 0.0 : fxaaQualityRcpFrame.x;\n"
+"    offNP.y = ( horzSpan) ? 0.0 : fxaaQualityRcpFrame.y;\n"
+"    if(!horzSpan) posB.x += lengthSign * 0.5;\n"
+"    if( horzSpan) posB.y += lengthSign * 0.5;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat2 posN;\n"
+"    posN.x = posB.x - offNP.x * FXAA_QUALITY__P0;\n"
+"    posN.y = posB.y - offNP.y * FXAA_QUALITY__P0;\n"
+"    FxaaFloat2 posP;\n"
+"    posP.x = posB.x + offNP.x * FXAA_QUALITY__P0;\n"
+"    posP.y = posB.y + offNP.y * FXAA_QUALITY__P0;\n"
+"    FxaaFloat subpixD = ((-2.0)*subpixC) + 3.0;\n"
+"    FxaaFloat lumaEndN = FxaaLuma(FxaaTexTop(tex, posN));\n"
+"    FxaaFloat subpixE = subpixC * subpixC;\n"
+"    FxaaFloat lumaEndP = FxaaLuma(FxaaTexTop(tex, posP));\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    if(!pairN) lumaNN = lumaSS;\n"
+"    FxaaFloat gradientScaled = gradient * 1.0/4.0;\n"
+"    FxaaFloat lumaMM = lumaM - lumaNN * 0.5;\n"
+"    FxaaFloat subpixF = subpixD * subpixE;\n"
+"    FxaaBool lumaMLTZero = lumaMM < 0.0;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    lumaEndN -= lumaNN * 0.5;\n"
+"    lumaEndP -= lumaNN * 0.5;\n"
+"    FxaaBool doneN = abs(lumaEndN) >= gradientScaled;\n"
+"    FxaaBool doneP = abs(lumaEndP) >= gradientScaled;\n"
+"    if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P1;\n"
+"    if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P1;\n"
+"    FxaaBool doneNP = (!doneN) || (!doneP);\n"
+"    if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P1;\n"
+"    if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P1;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    if(doneNP) {\n"
+"        if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"        if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"        if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"        if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"        doneN = abs(lumaEndN) >= gradientScaled;\n"
+"        doneP = abs(lumaEndP) >= gradientScaled;\n"
+"        if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P2;\n"
+"        if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P2;\n"
+"        doneNP = (!doneN) || (!doneP);\n"
+"        if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P2;\n"
+"        if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P2;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"        #if (FXAA_QUALITY__PS > 3)\n"
+"        if(doneNP) {\n"
+"            if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"            if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"            if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"            if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"            doneN = abs(lumaEndN) >= gradientScaled;\n"
+"            doneP = abs(lumaEndP) >= gradientScaled;\n"
+"            if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P3;\n"
+"            if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P3;\n"
+"            doneNP = (!doneN) || (!doneP);\n"
+"            if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P3;\n"
+"            if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P3;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"            #if (FXAA_QUALITY__PS > 4)\n"
+"            if(doneNP) {\n"
+"                if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P4;\n"
+"                if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P4;\n"
+"                doneNP = (!doneN) || (!doneP);\n"
+"                if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P4;\n"
+"                if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P4;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                #if (FXAA_QUALITY__PS > 5)\n"
+"                if(doneNP) {\n"
+"                    if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                    if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                    if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                    if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                    doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                    doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                    if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P5;\n"
+"                    if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P5;\n"
+"                    doneNP = (!doneN) || (!doneP);\n"
+"                    if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P5;\n"
+"                    if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P5;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                    #if (FXAA_QUALITY__PS > 6)\n"
+"                    if(doneNP) {\n"
+"                        if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                        if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                        if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                        if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                        doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                        doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                        if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P6;\n"
+"                        if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P6;\n"
+"                        doneNP = (!doneN) || (!doneP);\n"
+"                        if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P6;\n"
+"                        if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P6;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                        #if (FXAA_QUALITY__PS > 7)\n"
+"                        if(doneNP) {\n"
+"                            if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                            if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                            if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                            if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                            doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                            doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                            if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P7;\n"
+"                            if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P7;\n"
+"                            doneNP = (!doneN) || (!doneP);\n"
+"                            if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P7;\n"
+"                            if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P7;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    #if (FXAA_QUALITY__PS > 8)\n"
+"    if(doneNP) {\n"
+"        if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"        if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"        if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"        if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"        doneN = abs(lumaEndN) >= gradientScaled;\n"
+"        doneP = abs(lumaEndP) >= gradientScaled;\n"
+"        if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P8;\n"
+"        if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P8;\n"
+"        doneNP = (!doneN) || (!doneP);\n"
+"        if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P8;\n"
+"        if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P8;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"        #if (FXAA_QUALITY__PS > 9)\n"
+"        if(doneNP) {\n"
+"            if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"            if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"            if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"            if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"            doneN = abs(lumaEndN) >= gradientScaled;\n"
+"            doneP = abs(lumaEndP) >= gradientScaled;\n"
+"            if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P9;\n"
+"            if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P9;\n"
+"            doneNP = (!doneN) || (!doneP);\n"
+"            if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P9;\n"
+"            if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P9;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"            #if (FXAA_QUALITY__PS > 10)\n"
+"            if(doneNP) {\n"
+"                if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P10;\n"
+"                if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P10;\n"
+"                doneNP = (!doneN) || (!doneP);\n"
+"                if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P10;\n"
+"                if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P10;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                #if (FXAA_QUALITY__PS > 11)\n"
+"                if(doneNP) {\n"
+"                    if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                    if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                    if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                    if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                    doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                    doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                    if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P11;\n"
+"                    if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P11;\n"
+"                    doneNP = (!doneN) || (!doneP);\n"
+"                    if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P11;\n"
+"                    if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P11;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                    #if (FXAA_QUALITY__PS > 12)\n"
+"                    if(doneNP) {\n"
+"                        if(!doneN) lumaEndN = FxaaLuma(FxaaTexTop(tex, posN.xy));\n"
+"                        if(!doneP) lumaEndP = FxaaLuma(FxaaTexTop(tex, posP.xy));\n"
+"                        if(!doneN) lumaEndN = lumaEndN - lumaNN * 0.5;\n"
+"                        if(!doneP) lumaEndP = lumaEndP - lumaNN * 0.5;\n"
+"                        doneN = abs(lumaEndN) >= gradientScaled;\n"
+"                        doneP = abs(lumaEndP) >= gradientScaled;\n"
+"                        if(!doneN) posN.x -= offNP.x * FXAA_QUALITY__P12;\n"
+"                        if(!doneN) posN.y -= offNP.y * FXAA_QUALITY__P12;\n"
+"                        doneNP = (!doneN) || (!doneP);\n"
+"                        if(!doneP) posP.x += offNP.x * FXAA_QUALITY__P12;\n"
+"                        if(!doneP) posP.y += offNP.y * FXAA_QUALITY__P12;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                    }\n"
+"                    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                }\n"
+"                #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"            }\n"
+"            #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"        }\n"
+"        #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    }\n"
+"    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                        }\n"
+"                        #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                    }\n"
+"                    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"                }\n"
+"                #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"            }\n"
+"            #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"        }\n"
+"        #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    }\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat dstN = posM.x - posN.x;\n"
+"    FxaaFloat dstP = posP.x - posM.x;\n"
+"    if(!horzSpan) dstN = posM.y - posN.y;\n"
+"    if(!horzSpan) dstP = posP.y - posM.y;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaBool goodSpanN = (lumaEndN < 0.0) != lumaMLTZero;\n"
+"    FxaaFloat spanLength = (dstP + dstN);\n"
+"    FxaaBool goodSpanP = (lumaEndP < 0.0) != lumaMLTZero;\n"
+"    FxaaFloat spanLengthRcp = 1.0/spanLength;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaBool directionN = dstN < dstP;\n"
+"    FxaaFloat dst = min(dstN, dstP);\n"
+"    FxaaBool goodSpan = directionN ? goodSpanN : goodSpanP;\n"
+"    FxaaFloat subpixG = subpixF * subpixF;\n"
+"    FxaaFloat pixelOffset = (dst * (-spanLengthRcp)) + 0.5;\n"
+"    FxaaFloat subpixH = subpixG * fxaaQualitySubpix;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat pixelOffsetGood = goodSpan ? pixelOffset : 0.0;\n"
+"    FxaaFloat pixelOffsetSubpix = max(pixelOffsetGood, subpixH);\n"
+"    if(!horzSpan) posM.x += pixelOffsetSubpix * lengthSign;\n"
+"    if( horzSpan) posM.y += pixelOffsetSubpix * lengthSign;\n"
+"    #if (FXAA_DISCARD == 1)\n"
+"        return FxaaTexTop(tex, posM);\n"
+"    #else\n"
+"        return FxaaFloat4(FxaaTexTop(tex, posM).xyz, lumaM);\n"
+"    #endif\n"
+"}\n"
+"/*==========================================================================*/\n"
+"#endif\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                         FXAA3 CONSOLE - PC VERSION\n"
+"\n"
+"------------------------------------------------------------------------------\n"
+"Instead of using this on PC, I'd suggest just using FXAA Quality with\n"
+"    #define FXAA_QUALITY__PRESET 10\n"
+"Or\n"
+"    #define FXAA_QUALITY__PRESET 20\n"
+"Either are higher qualilty and almost as fast as this on modern PC GPUs.\n"
+"============================================================================*/\n"
+"#if (FXAA_PC_CONSOLE == 1)\n"
+"/*--------------------------------------------------------------------------*/\n"
+"FxaaFloat4 FxaaPixelShader(\n"
+"    // See FXAA Quality FxaaPixelShader() source for docs on Inputs!\n"
+"    FxaaFloat2 pos,\n"
+"    FxaaFloat4 fxaaConsolePosPos,\n"
+"    FxaaTex tex,\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegOne,\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegTwo,\n"
+"    FxaaFloat2 fxaaQualityRcpFrame,\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt,\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt2,\n"
+"    FxaaFloat4 fxaaConsole360RcpFrameOpt2,\n"
+"    FxaaFloat fxaaQualitySubpix,\n"
+"    FxaaFloat fxaaQualityEdgeThreshold,\n"
+"    FxaaFloat fxaaQualityEdgeThresholdMin,\n"
+"    FxaaFloat fxaaConsoleEdgeSharpness,\n"
+"    FxaaFloat fxaaConsoleEdgeThreshold,\n"
+"    FxaaFloat fxaaConsoleEdgeThresholdMin,\n"
+"    FxaaFloat4 fxaaConsole360ConstDir\n"
+") {\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaNw = FxaaLuma(FxaaTexTop(tex, fxaaConsolePosPos.xy));\n"
+"    FxaaFloat lumaSw = FxaaLuma(FxaaTexTop(tex, fxaaConsolePosPos.xw));\n"
+"    FxaaFloat lumaNe = FxaaLuma(FxaaTexTop(tex, fxaaConsolePosPos.zy));\n"
+"    FxaaFloat lumaSe = FxaaLuma(FxaaTexTop(tex, fxaaConsolePosPos.zw));\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat4 rgbyM = FxaaTexTop(tex, pos.xy);\n"
+"    #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"        FxaaFloat lumaM = rgbyM.w;\n"
+"    #else\n"
+"        FxaaFloat lumaM = rgbyM.y;\n"
+"    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaMaxNwSw = max(lumaNw, lumaSw);\n"
+"    lumaNe += 1.0/384.0;\n"
+"    FxaaFloat lumaMinNwSw = min(lumaNw, lumaSw);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaMaxNeSe = max(lumaNe, lumaSe);\n"
+"    FxaaFloat lumaMinNeSe = min(lumaNe, lumaSe);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaMax = max(lumaMaxNeSe, lumaMaxNwSw);\n"
+"    FxaaFloat lumaMin = min(lumaMinNeSe, lumaMinNwSw);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaMaxScaled = lumaMax * fxaaConsoleEdgeThreshold;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat lumaMinM = min(lumaMin, lumaM);\n"
+"    FxaaFloat lumaMaxScaledClamped = max(fxaaConsoleEdgeThresholdMin, lumaMaxScaled);\n"
+"    FxaaFloat lumaMaxM = max(lumaMax, lumaM);\n"
+"    FxaaFloat dirSwMinusNe = lumaSw - lumaNe;\n"
+"    FxaaFloat lumaMaxSubMinM = lumaMaxM - lumaMinM;\n"
+"    FxaaFloat dirSeMinusNw = lumaSe - lumaNw;\n"
+"    if(lumaMaxSubMinM < lumaMaxScaledClamped) return rgbyM;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat2 dir;\n"
+"    dir.x = dirSwMinusNe + dirSeMinusNw;\n"
+"    dir.y = dirSwMinusNe - dirSeMinusNw;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat2 dir1 = normalize(dir.xy);\n"
+"    FxaaFloat4 rgbyN1 = FxaaTexTop(tex, pos.xy - dir1 * fxaaConsoleRcpFrameOpt.zw);\n"
+"    FxaaFloat4 rgbyP1 = FxaaTexTop(tex, pos.xy + dir1 * fxaaConsoleRcpFrameOpt.zw);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat dirAbsMinTimesC = min(abs(dir1.x), abs(dir1.y)) * fxaaConsoleEdgeSharpness;\n"
+"    FxaaFloat2 dir2 = clamp(dir1.xy / dirAbsMinTimesC, -2.0, 2.0);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat4 rgbyN2 = FxaaTexTop(tex, pos.xy - dir2 * fxaaConsoleRcpFrameOpt2.zw);\n"
+"    FxaaFloat4 rgbyP2 = FxaaTexTop(tex, pos.xy + dir2 * fxaaConsoleRcpFrameOpt2.zw);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    FxaaFloat4 rgbyA = rgbyN1 + rgbyP1;\n"
+"    FxaaFloat4 rgbyB = ((rgbyN2 + rgbyP2) * 0.25) + (rgbyA * 0.25);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"        FxaaBool twoTap = (rgbyB.w < lumaMin) || (rgbyB.w > lumaMax);\n"
+"    #else\n"
+"        FxaaBool twoTap = (rgbyB.y < lumaMin) || (rgbyB.y > lumaMax);\n"
+"    #endif\n"
+"    if(twoTap) rgbyB.xyz = rgbyA.xyz * 0.5;\n"
+"    return rgbyB; }\n"
+"/*==========================================================================*/\n"
+"#endif\n"
+"\n"
+"\n"
+"\n"
+"/*============================================================================\n"
+"\n"
+"                      FXAA3 CONSOLE - 360 PIXEL SHADER\n"
+"\n"
+"------------------------------------------------------------------------------\n"
+"This optimized version thanks to suggestions from Andy Luedke.\n"
+"Should be fully tex bound in all cases.\n"
+"As of the FXAA 3.11 release, I have still not tested this code,\n"
+"however I fixed a bug which was in both FXAA 3.9 and FXAA 3.10.\n"
+"And note this is replacing the old unoptimized version.\n"
+"If it does not work, please let me know so I can fix it.\n"
+"============================================================================*/\n"
+"#if (FXAA_360 == 1)\n"
+"/*--------------------------------------------------------------------------*/\n"
+"[reduceTempRegUsage(4)]\n"
+"float4 FxaaPixelShader(\n"
+"    // See FXAA Quality FxaaPixelShader() source for docs on Inputs!\n"
+"    FxaaFloat2 pos,\n"
+"    FxaaFloat4 fxaaConsolePosPos,\n"
+"    FxaaTex tex,\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegOne,\n"
+"    FxaaTex fxaaConsole360TexExpBiasNegTwo,\n"
+"    FxaaFloat2 fxaaQualityRcpFrame,\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt,\n"
+"    FxaaFloat4 fxaaConsoleRcpFrameOpt2,\n"
+"    FxaaFloat4 fxaaConsole360RcpFrameOpt2,\n"
+"    FxaaFloat fxaaQualitySubpix,\n"
+"    FxaaFloat fxaaQualityEdgeThreshold,\n"
+"    FxaaFloat fxaaQualityEdgeThresholdMin,\n"
+"    FxaaFloat fxaaConsoleEdgeSharpness,\n"
+"    FxaaFloat fxaaConsoleEdgeThreshold,\n"
+"    FxaaFloat fxaaConsoleEdgeThresholdMin,\n"
+"    FxaaFloat4 fxaaConsole360ConstDir\n"
+") {\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 lumaNwNeSwSe;\n"
+"    #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"        asm {\n"
+"            tfetch2D lumaNwNeSwSe.w___, tex, pos.xy, OffsetX = -0.5, OffsetY = -0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe._w__, tex, pos.xy, OffsetX =  0.5, OffsetY = -0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe.__w_, tex, pos.xy, OffsetX = -0.5, OffsetY =  0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe.___w, tex, pos.xy, OffsetX =  0.5, OffsetY =  0.5, UseComputedLOD=false\n"
+"        };\n"
+"    #else\n"
+"        asm {\n"
+"            tfetch2D lumaNwNeSwSe.y___, tex, pos.xy, OffsetX = -0.5, OffsetY = -0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe._y__, tex, pos.xy, OffsetX =  0.5, OffsetY = -0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe.__y_, tex, pos.xy, OffsetX = -0.5, OffsetY =  0.5, UseComputedLOD=false\n"
+"            tfetch2D lumaNwNeSwSe.___y, tex, pos.xy, OffsetX =  0.5, OffsetY =  0.5, UseComputedLOD=false\n"
+"        };\n"
+"    #endif\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    lumaNwNeSwSe.y += 1.0/384.0;\n"
+"    float2 lumaMinTemp = min(lumaNwNeSwSe.xy, lumaNwNeSwSe.zw);\n"
+"    float2 lumaMaxTemp = max(lumaNwNeSwSe.xy, lumaNwNeSwSe.zw);\n"
+"    float lumaMin = min(lumaMinTemp.x, lumaMinTemp.y);\n"
+"    float lumaMax = max(lumaMaxTemp.x, lumaMaxTemp.y);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 rgbyM = tex2Dlod(tex, float4(pos.xy, 0.0, 0.0));\n"
+"    #if (FXAA_GREEN_AS_LUMA == 0)\n"
+"        float lumaMinM = min(lumaMin, rgbyM.w);\n"
+"        float lumaMaxM = max(lumaMax, rgbyM.w);\n"
+"    #else\n"
+"        float lumaMinM = min(lumaMin, rgbyM.y);\n"
+"        float lumaMaxM = max(lumaMax, rgbyM.y);\n"
+"    #endif\n"
+"    if((lumaMaxM - lumaMinM) < max(fxaaConsoleEdgeThresholdMin, lumaMax * fxaaConsoleEdgeThreshold)) return rgbyM;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float2 dir;\n"
+"    dir.x = dot(lumaNwNeSwSe, fxaaConsole360ConstDir.yyxx);\n"
+"    dir.y = dot(lumaNwNeSwSe, fxaaConsole360ConstDir.xyxy);\n"
+"    dir = normalize(dir);\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 dir1 = dir.xyxy * fxaaConsoleRcpFrameOpt.xyzw;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 dir2;\n"
+"    float dirAbsMinTimesC = min(abs(dir.x), abs(dir.y)) * fxaaConsoleEdgeSharpness;\n"
+"    dir2 = saturate(fxaaConsole360ConstDir.zzww * dir.xyxy / dirAbsMinTimesC + 0.5);\n"
+"    dir2 = dir2 * fxaaConsole360RcpFrameOpt2.xyxy + fxaaConsole360RcpFrameOpt2.zwzw;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 rgbyN1 = tex2Dlod(fxaaConsole360TexExpBiasNegOne, float4(pos.xy + dir1.xy, 0.0, 0.0));\n"
+"    float4 rgbyP1 = tex2Dlod(fxaaConsole360TexExpBiasNegOne, float4(pos.xy + dir1.zw, 0.0, 0.0));\n"
+"    float4 rgbyN2 = tex2Dlod(fxaaConsole360TexExpBiasNegTwo, float4(pos.xy + dir2.xy, 0.0, 0.0));\n"
+"    float4 rgbyP2 = tex2Dlod(fxaaConsole360TexExpBiasNegTwo, float4(pos.xy + dir2.zw, 0.0, 0.0));\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 rgbyA = rgbyN1 + rgbyP1;\n"
+"    float4 rgbyB = rgbyN2 + rgbyP2 + rgbyA * 0.5;\n"
+"/*--------------------------------------------------------------------------*/\n"
+"    float4 rgbyR = ((FxaaLuma(rgbyB) - lumaMax) > 0.0) ? rgbyA : rgbyB;\n"
+"    rgbyR = ((FxaaLuma(rgbyB) - lumaMin) > 0.0) ? rgbyR : rgbyA;\n"
+"    return rgbyR; }\n"
+"/*==========================================================================*/\n"
+"#endif\n"
+"\n"
+"// NOTE(Sergio): Removed rest of shader because compiler complains about long string.\n"
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"uniform sampler2D u_canvas;\n"
+"uniform vec2 u_screen_size;\n"
+"\n"
+"vec4 FxaaPixelShader(\n"
+"    vec2 pos,\n"
+"    vec4 fxaaConsolePosPos,\n"
+"    sampler2D tex,\n"
+"    sampler2D fxaaConsole360TexExpBiasNegOne,\n"
+"    sampler2D fxaaConsole360TexExpBiasNegTwo,\n"
+"    vec2 fxaaQualityRcpFrame,\n"
+"    vec4 fxaaConsoleRcpFrameOpt,\n"
+"    vec4 fxaaConsoleRcpFrameOpt2,\n"
+"    vec4 fxaaConsole360RcpFrameOpt2,\n"
+"    float fxaaQualitySubpix,\n"
+"    float fxaaQualityEdgeThreshold,\n"
+"    float fxaaQualityEdgeThresholdMin,\n"
+"    float fxaaConsoleEdgeSharpness,\n"
+"    float fxaaConsoleEdgeThreshold,\n"
+"    float fxaaConsoleEdgeThresholdMin,\n"
+"    vec4 fxaaConsole360ConstDir\n"
+");\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    // Pixel width / height.\n"
+"    float pw = 1 / u_screen_size.x;\n"
+"    float ph = 1 / u_screen_size.y;\n"
+"    vec2 coord = gl_FragCoord.xy / u_screen_size;\n"
+"\n"
+"    out_color = texture(u_canvas, coord, 0);\n"
+"    out_color.rgb = FxaaPixelShader(\n"
+"        // Use noperspective interpolation here (turn off perspective interpolation).\n"
+"        // {xy} = center of pixel\n"
+"        gl_FragCoord.xy / u_screen_size, // FxaaFloat2 pos,\n"
+"        //\n"
+"        // Used only for FXAA Console, and not used on the 360 version.\n"
+"        // Use noperspective interpolation here (turn off perspective interpolation).\n"
+"        // {xy__} = upper left of pixel\n"
+"        // {__zw} = lower right of pixel\n"
+"        vec4(0), // FxaaFloat4 fxaaConsolePosPos,\n"
+"        //\n"
+"        // Input color texture.\n"
+"        // {rgb_} = color in linear or perceptual color space\n"
+"        // if (FXAA_GREEN_AS_LUMA == 0)\n"
+"        //     {___a} = luma in perceptual color space (not linear)\n"
+"        u_canvas, // FxaaTex tex,\n"
+"        //\n"
+"        // Only used on the optimized 360 version of FXAA Console.\n"
+"        // For everything but 360, just use the same input here as for tex.\n"
+"        // For 360, same texture, just alias with a 2nd sampler.\n"
+"        // This sampler needs to have an exponent bias of -1.\n"
+"        u_canvas,  // FxaaTex fxaaConsole360TexExpBiasNegOne,\n"
+"        //\n"
+"        // Only used on the optimized 360 version of FXAA Console.\n"
+"        // For everything but 360, just use the same input here as for texÏ.\n"
+"        // For 360, same texture, just alias with a 3nd sampler.\n"
+"        // This sampler needs to have an exponent bias of -2.\n"
+"        u_canvas, // FxaaTex fxaaConsole360TexExpBiasNegTwo,\n"
+"        //\n"
+"        // Only used on FXAA Quality.\n"
+"        // This must be from a constant/uniform.\n"
+"        // {x_} = 1.0/screenWidthInPixels\n"
+"        // {_y} = 1.0/screenHeightInPixels\n"
+"        1/u_screen_size, //FxaaFloat2 fxaaQualityRcpFrame,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // This must be from a constant/uniform.\n"
+"        // This effects sub-pixel AA quality and inversely sharpness.\n"
+"        //   Where N ranges between,\n"
+"        //     N = 0.50 (default)\n"
+"        //     N = 0.33 (sharper)\n"
+"        // {x___} = -N/screenWidthInPixels\n"
+"        // {_y__} = -N/screenHeightInPixels\n"
+"        // {__z_} =  N/screenWidthInPixels\n"
+"        // {___w} =  N/screenHeightInPixels\n"
+"        vec4(0), // FxaaFloat4 fxaaConsoleRcpFrameOpt,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // Not used on 360, but used on PS3 and PC.\n"
+"        // This must be from a constant/uniform.\n"
+"        // {x___} = -2.0/screenWidthInPixels\n"
+"        // {_y__} = -2.0/screenHeightInPixels\n"
+"        // {__z_} =  2.0/screenWidthInPixels\n"
+"        // {___w} =  2.0/screenHeightInPixels\n"
+"        vec4(0), //FxaaFloat4 fxaaConsoleRcpFrameOpt2,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // Only used on 360 in place of fxaaConsoleRcpFrameOpt2.\n"
+"        // This must be from a constant/uniform.\n"
+"        // {x___} =  8.0/screenWidthInPixels\n"
+"        // {_y__} =  8.0/screenHeightInPixels\n"
+"        // {__z_} = -4.0/screenWidthInPixels\n"
+"        // {___w} = -4.0/screenHeightInPixels\n"
+"        vec4(0), // FxaaFloat4 fxaaConsole360RcpFrameOpt2,\n"
+"        //\n"
+"        // Only used on FXAA Quality.\n"
+"        // This used to be the FXAA_QUALITY__SUBPIX define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // Choose the amount of sub-pixel aliasing removal.\n"
+"        // This can effect sharpness.\n"
+"        //   1.00 - upper limit (softer)\n"
+"        //   0.75 - default amount of filtering\n"
+"        //   0.50 - lower limit (sharper, less sub-pixel aliasing removal)\n"
+"        //   0.25 - almost off\n"
+"        //   0.00 - completely off\n"
+"        0.25, // FxaaFloat fxaaQualitySubpix,\n"
+"        //\n"
+"        // Only used on FXAA Quality.\n"
+"        // This used to be the FXAA_QUALITY__EDGE_THRESHOLD define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // The minimum amount of local contrast required to apply algorithm.\n"
+"        //   0.333 - too little (faster)\n"
+"        //   0.250 - low quality\n"
+"        //   0.166 - default\n"
+"        //   0.125 - high quality\n"
+"        //   0.063 - overkill (slower)\n"
+"        0.063, // FxaaFloat fxaaQualityEdgeThreshold,\n"
+"        //\n"
+"        // Only used on FXAA Quality.\n"
+"        // This used to be the FXAA_QUALITY__EDGE_THRESHOLD_MIN define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // Trims the algorithm from processing darks.\n"
+"        //   0.0833 - upper limit (default, the start of visible unfiltered edges)\n"
+"        //   0.0625 - high quality (faster)\n"
+"        //   0.0312 - visible limit (slower)\n"
+"        // Special notes when using FXAA_GREEN_AS_LUMA,\n"
+"        //   Likely want to set this to zero.\n"
+"        //   As colors that are mostly not-green\n"
+"        //   will appear very dark in the green channel!\n"
+"        //   Tune by looking at mostly non-green content,\n"
+"        //   then start at zero and increase until aliasing is a problem.\n"
+"        0.0312, // FxaaFloat fxaaQualityEdgeThresholdMin,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // This used to be the FXAA_CONSOLE__EDGE_SHARPNESS define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // This does not effect PS3, as this needs to be compiled in.\n"
+"        //   Use FXAA_CONSOLE__PS3_EDGE_SHARPNESS for PS3.\n"
+"        //   Due to the PS3 being ALU bound,\n"
+"        //   there are only three safe values here: 2 and 4 and 8.\n"
+"        //   These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"        // For all other platforms can be a non-power of two.\n"
+"        //   8.0 is sharper (default!!!)\n"
+"        //   4.0 is softer\n"
+"        //   2.0 is really soft (good only for vector graphics inputs)\n"
+"        0.0, // FxaaFloat fxaaConsoleEdgeSharpness,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // This used to be the FXAA_CONSOLE__EDGE_THRESHOLD define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // This does not effect PS3, as this needs to be compiled in.\n"
+"        //   Use FXAA_CONSOLE__PS3_EDGE_THRESHOLD for PS3.\n"
+"        //   Due to the PS3 being ALU bound,\n"
+"        //   there are only two safe values here: 1/4 and 1/8.\n"
+"        //   These options use the shaders ability to a free *|/ by 2|4|8.\n"
+"        // The console setting has a different mapping than the quality setting.\n"
+"        // Other platforms can use other values.\n"
+"        //   0.125 leaves less aliasing, but is softer (default!!!)\n"
+"        //   0.25 leaves more aliasing, and is sharper\n"
+"        0.0, //FxaaFloat fxaaConsoleEdgeThreshold,\n"
+"        //\n"
+"        // Only used on FXAA Console.\n"
+"        // This used to be the FXAA_CONSOLE__EDGE_THRESHOLD_MIN define.\n"
+"        // It is here now to allow easier tuning.\n"
+"        // Trims the algorithm from processing darks.\n"
+"        // The console setting has a different mapping than the quality setting.\n"
+"        // This only applies when FXAA_EARLY_EXIT is 1.\n"
+"        // This does not apply to PS3,\n"
+"        // PS3 was simplified to avoid more shader instructions.\n"
+"        //   0.06 - faster but more aliasing in darks\n"
+"        //   0.05 - default\n"
+"        //   0.04 - slower and less aliasing in darks\n"
+"        // Special notes when using FXAA_GREEN_AS_LUMA,\n"
+"        //   Likely want to set this to zero.\n"
+"        //   As colors that are mostly not-green\n"
+"        //   will appear very dark in the green channel!\n"
+"        //   Tune by looking at mostly non-green content,\n"
+"        //   then start at zero and increase until aliasing is a problem.\n"
+"        0.0, // FxaaFloat fxaaConsoleEdgeThresholdMin,\n"
+"        //\n"
+"        // Extra constants for 360 FXAA Console only.\n"
+"        // Use zeros or anything else for other platforms.\n"
+"        // These must be in physical constant registers and NOT immedates.\n"
+"        // Immedates will result in compiler un-optimizing.\n"
+"        // {xyzw} = float4(1.0, -1.0, 0.25, -0.25)\n"
+"        vec4(0) // FxaaFloat4 fxaaConsole360ConstDir\n"
+"    ).rgb;\n"
+"}\n"
+;
+static char g_blur_f[] = 
+"// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.\n"
+"// License: https://github.com/serge-rgb/milton#license\n"
+"\n"
+"uniform sampler2D u_canvas;\n"
+"uniform vec2 u_texture_size;    // Size of u_canvas, in pixels.\n"
+"uniform vec2 u_source_size;     // Pixels of u_canvas that hold the image. Samples are clamped to them.\n"
+"uniform int u_kernel_size;\n"
+"uniform int u_direction;        // BoxFilterPass in renderer.cc\n"
+"uniform float u_step;           // BoxFilterPass_RESAMPLE: Source pixels per output pixel.\n"
+"\n"
+"vec4\n"
+"sample_source(vec2 point)\n"
+"{\n"
+"    point = clamp(point, vec2(0.5), u_source_size - vec2(0.5));\n"
+"    return texture(u_canvas, point / u_texture_size);\n"
+"}\n"
+"\n"
+"void\n"
+"main()\n"
+"{\n"
+"    vec2 screen_point = vec2(gl_FragCoord.x, gl_FragCoord.y);\n"
+"    out_color = vec4(0);\n"
+"    if ( u_direction == 2 ) {\n"
+"        // Halving lands on the corner of four source pixels and averages them.\n"
+"        out_color = sample_source(screen_point * u_step);\n"
+"    } else if ( u_kernel_size > 1 ) {\n"
+"        // LINEAR. Every sample is the mean of two pixels.\n"
+"        if ( u_direction == 0 ) {\n"
+"            for ( int y = -u_kernel_size+1; y < u_kernel_size; y+=2 ) {\n"
+"                vec4 sample = sample_source(screen_point+vec2(0.0,y-0.5));\n"
+"                out_color += sample * sample;\n"
+"            }\n"
+"        } else {\n"
+"            for ( int x = -u_kernel_size+1; x < u_kernel_size; x+=2 ) {\n"
+"                vec4 sample = sample_source(screen_point+vec2(x-0.5,0.0));\n"
+"                out_color += sample * sample;\n"
+"            }\n"
+"        }\n"
+"        out_color /= u_kernel_size;\n"
+"        out_color = sqrt(out_color);\n"
+"    } else {\n"
+"        out_color = sample_source(screen_point);\n"
+"    }\n"
+"}\n"
+;
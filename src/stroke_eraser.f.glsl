@@ -4,8 +4,6 @@
 in vec3 v_pointa;
 in vec3 v_pointb;
 
-uniform sampler2D u_canvas;
-
 void
 main()
 {
@@ -28,9 +26,9 @@ main()
     float dist = distance(stroke_point, canvas_point) - u_radius*pressure;
 
     if ( dist < 0 ) {
-        vec2 coord = gl_FragCoord.xy / u_screen_size;
-        vec4 eraser_color = texture(u_canvas, coord);
-        out_color = eraser_color;
+        // Drawn with glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA), which
+        // clears the layer under the stroke.
+        out_color = vec4(1.0);
     } else {
         discard;
     }
@@ -4,6 +4,7 @@
 uniform float u_opacity_min;
 uniform float u_hardness;
 uniform sampler2D u_info;
+uniform vec2 u_info_size;   // Size of u_info, in pixels. The stroke may be drawn into a corner of it.
 
 #ifndef PRESSURE_TO_OPACITY
 #define PRESSURE_TO_OPACITY 1
@@ -16,7 +17,7 @@ uniform sampler2D u_info;
 void
 main()
 {
-    vec2 coord = gl_FragCoord.xy / u_screen_size;
+    vec2 coord = gl_FragCoord.xy / u_info_size;
     vec2 stroke_info = texture(u_info, coord).ra;
     float pressure = stroke_info.y;
     if ( stroke_info.x < 1.0f  ) {
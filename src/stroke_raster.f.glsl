@@ -1,9 +1,18 @@
 // Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
 // License: https://github.com/serge-rgb/milton#license
 
+#ifndef STROKE_BATCH
+#define STROKE_BATCH 0
+#endif
+
 in vec3 v_pointa;
 in vec3 v_pointb;
 
+#if STROKE_BATCH
+flat in vec4  v_color;
+flat in float v_radius;
+#endif
+
 void
 main()
 {
@@ -22,11 +31,19 @@ main()
 
     float pressure = mix(v_pointa.z, v_pointb.z, t);
 
+#if STROKE_BATCH
+    vec4 color = v_color;
+    float radius = v_radius;
+#else
+    vec4 color = u_brush_color;
+    float radius = float(u_radius);
+#endif
+
     // Distance between fragment and stroke
-    float dist = distance(stroke_point, canvas_point) - u_radius*pressure;
+    float dist = distance(stroke_point, canvas_point) - radius*pressure;
 
     if ( dist < 0 ) {
-        out_color = u_brush_color;
+        out_color = color;
     } else {
         discard;
     }
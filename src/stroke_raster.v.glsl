@@ -1,9 +1,42 @@
 // Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
 // License: https://github.com/serge-rgb/milton#license
 
-in vec3 a_position;
-in vec3 a_pointa;
-in vec3 a_pointb;
+#ifndef STROKE_BATCH
+#define STROKE_BATCH 0
+#endif
+
+#ifndef STROKE_SOFT
+#define STROKE_SOFT 0
+#endif
+
+#if STROKE_BATCH
+// Many strokes per draw call. There are no attributes: each run of 6
+// vertices is one segment, read from the pool page with gl_VertexID.
+uniform isamplerBuffer u_segments;      // 6 ints per StrokeSegment. See renderer.cc
+uniform isamplerBuffer u_stroke_table;  // 4 texels per StrokeTableEntry.
+
+flat out vec4  v_color;
+flat out float v_radius;
+
+#if STROKE_SOFT
+// What stroke_soft.f.glsl needs to look at the neighbors of the segment.
+flat out int   v_segment;       // Index in the pool page.
+flat out ivec3 v_stroke_range;  // First segment, number of segments, window.
+flat out vec2  v_origin;
+flat out vec2  v_opacity;       // Minimum opacity, hardness.
+#endif
+#else
+// Corner of the segment's quad: (0 on a's end / 1 on b's end, side).
+in vec2 a_corner;
+
+// Per segment. See StrokeSegment in renderer.cc
+in vec2 a_pointa;       // Relative to u_stroke_origin
+in vec2 a_pointb;
+in vec2 a_pressures;    // 0 to 65535
+
+uniform ivec2 u_stroke_origin;
+uniform float u_stroke_z;
+#endif
 
 out vec3 v_pointa;
 out vec3 v_pointb;
@@ -19,15 +52,69 @@ out vec3 v_debug_color;
 void
 main()
 {
-    v_pointa = a_pointa;
-    v_pointb = a_pointb;
+#if STROKE_BATCH
+    // Two triangles per quad, same order as RenderBackend::ibo_stroke_corners
+    const vec2 corners[6] = vec2[6](vec2(0,0), vec2(0,1), vec2(1,1),
+                                    vec2(1,1), vec2(0,0), vec2(1,0));
+    int segment = gl_VertexID / 6;
+    vec2 corner_uv = corners[gl_VertexID - 6*segment];
+
+    int base = 6*segment;
+    vec2 pointa = vec2(texelFetch(u_segments, base + 0).x, texelFetch(u_segments, base + 1).x);
+    vec2 pointb = vec2(texelFetch(u_segments, base + 2).x, texelFetch(u_segments, base + 3).x);
+    int pressures = texelFetch(u_segments, base + 4).x;
+    int slot = texelFetch(u_segments, base + 5).x;
+
+    ivec4 entry = texelFetch(u_stroke_table, 4*slot);
+    vec2 origin = vec2(entry.xy);
+    float radius = float(entry.z);
+    float stroke_z = float(entry.w);
+
+    v_color = intBitsToFloat(texelFetch(u_stroke_table, 4*slot + 1));
+    v_radius = radius;
+
+#if STROKE_SOFT
+    v_segment = segment;
+    v_stroke_range = texelFetch(u_stroke_table, 4*slot + 2).xyz;
+    v_origin = origin;
+    v_opacity = intBitsToFloat(texelFetch(u_stroke_table, 4*slot + 3)).xy;
+#endif
+
+    float pressure_a = float(pressures & 0xFFFF) / 65535.0;
+    float pressure_b = float((pressures >> 16) & 0xFFFF) / 65535.0;
+#else
+    vec2 corner_uv = a_corner;
+    vec2 pointa = a_pointa;
+    vec2 pointb = a_pointb;
+    vec2 origin = vec2(u_stroke_origin);
+    float radius = float(u_radius);
+    float stroke_z = u_stroke_z;
+
+    float pressure_a = a_pressures.x / 65535.0;
+    float pressure_b = a_pressures.y / 65535.0;
+#endif
+
+    vec2 a = pointa + origin;
+    vec2 b = pointb + origin;
+
+    v_pointa = vec3(a, pressure_a);
+    v_pointb = vec3(b, pressure_b);
 
 #if STROKE_DEBUG_VIZ
     v_debug_color = a_debug_color;
 #endif
-    gl_Position.xy = canvas_to_raster_gl(a_position.xy);
+
+    // Bounding box of the segment, aligned with it.
+    float rad = radius * max(pressure_a, pressure_b);
+    vec2 d = vec2(1.0, 0.0);
+    if ( a != b ) {
+        d = normalize(b - a);
+    }
+    vec2 n = vec2(d.y, -d.x);
+    vec2 corner = mix(a - d*rad, b + d*rad, corner_uv.x) + (2.0*corner_uv.y - 1.0) * rad * n;
+
+    gl_Position.xy = canvas_to_raster_gl(corner);
     gl_Position.w = 1;
 
-    gl_Position.z = a_position.z / MAX_DEPTH_VALUE;
+    gl_Position.z = stroke_z / MAX_DEPTH_VALUE;
 }
-
@@ -0,0 +1,83 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+// Strokes with pressure or distance to opacity, in a single pass.
+//
+// The segments of a stroke overlap, and a pixel takes the opacity of the
+// closest one. Every fragment looks at the segments around its own, and only
+// the first segment that covers the pixel writes it. renderer.cc makes sure
+// that segments that cover the same pixel are at most a window apart. See
+// stroke_soft_window.
+
+uniform isamplerBuffer u_segments;
+
+flat in vec4  v_color;
+flat in float v_radius;
+flat in int   v_segment;
+flat in ivec3 v_stroke_range;
+flat in vec2  v_origin;
+flat in vec2  v_opacity;
+
+// x: Distance from the point to the segment, over the radius there. Covered
+// when less than 1.
+// y: Pressure at the closest point.
+vec2
+segment_distance(int segment, vec2 canvas_point)
+{
+    int base = 6*segment;
+    vec2 a = v_origin + vec2(texelFetch(u_segments, base + 0).x, texelFetch(u_segments, base + 1).x);
+    vec2 b = v_origin + vec2(texelFetch(u_segments, base + 2).x, texelFetch(u_segments, base + 3).x);
+    int pressures = texelFetch(u_segments, base + 4).x;
+
+    vec2 ab = b - a;
+    float len_ab = length(ab);
+
+    float t = 0.0;
+    if ( len_ab > 0.0 ) {
+        t = clamp(dot((canvas_point - a)/len_ab, ab / len_ab), 0.0, 1.0);
+    }
+
+    vec2 stroke_point = mix(a, b, t);
+
+    float pressure = mix(float(pressures & 0xFFFF), float((pressures >> 16) & 0xFFFF), t) / 65535.0;
+
+    return vec2(distance(stroke_point, canvas_point) / (v_radius * pressure), pressure);
+}
+
+void
+main()
+{
+    vec2 screen_point = vec2(gl_FragCoord.x, u_screen_size.y - gl_FragCoord.y);
+
+    vec2 canvas_point = raster_to_canvas_gl(screen_point);
+
+    int first = max(v_stroke_range.x, v_segment - v_stroke_range.z);
+    int last = min(v_stroke_range.x + v_stroke_range.y - 1, v_segment + v_stroke_range.z);
+
+    // Same as the GL_MIN / GL_MAX blending of stroke_info.f.glsl
+    float min_distance = 1.0;
+    float max_pressure = 0.0;
+    int owner = -1;
+    for ( int s = first; s <= last; ++s ) {
+        vec2 d = segment_distance(s, canvas_point);
+        if ( d.x < 1.0 ) {
+            if ( owner < 0 ) {
+                owner = s;
+            }
+            min_distance = min(min_distance, d.x);
+            max_pressure = max(max_pressure, d.y);
+        }
+    }
+
+    if ( owner != v_segment ) {
+        discard;
+    }
+
+    // The minimum opacity is 1 without pressure to opacity, and the hardness
+    // is 0 without distance to opacity.
+    out_color = v_color;
+    out_color *= (1.0f - v_opacity.x) * max_pressure + v_opacity.x;
+    if ( v_opacity.y > 0.0 ) {
+        out_color *= pow(1 - min_distance, 1.0f / v_opacity.y);
+    }
+}
@@ -71,9 +71,253 @@ test_save_load()
     EXPECT_TRUE( COMPARE_BYTES_COUNT(milton.brush_sizes, loaded_milton.brush_sizes, BrushEnum_COUNT) );
 }
 
+static i64
+count_strokes_in_rect(StrokeList* strokes, StrokeIndex* index, Rect rect, b32 use_index)
+{
+    DArray<StrokeRange> ranges = {};
+    if ( use_index ) {
+        stroke_index_query(index, rect, &ranges);
+    }
+    else {
+        StrokeRange all = { 0, strokes->count };
+        push(&ranges, all);
+    }
+    i64 found = 0;
+    for ( i64 ri = 0; ri < ranges.count; ++ri ) {
+        for ( i64 si = ranges.data[ri].begin; si < ranges.data[ri].end; ++si ) {
+            if ( rect_intersects_rect(get(strokes, si)->bounding_rect, rect) ) {
+                ++found;
+            }
+        }
+    }
+    release(&ranges);
+    return found;
+}
+
+void
+test_stroke_index()
+{
+    Arena arena = arena_init(1024*1024);
+    StrokeList strokes = {};
+    strokes.arena = &arena;
+    StrokeIndex index = {};
+
+    // Strokes along a diagonal.
+    i64 num_strokes = 10000;
+    for ( i64 i = 0; i < num_strokes; ++i ) {
+        Stroke stroke = {};
+        stroke.bounding_rect = rect_from_xywh((i32)i*10, (i32)i*10, 5, 5);
+        push(&strokes, stroke);
+        stroke_index_push(&index, stroke.bounding_rect);
+    }
+
+    Rect near = rect_from_xywh(20000, 20000, 100, 100);
+    Rect far = rect_from_xywh(80000, 80000, 100, 100);
+
+    EXPECT_TRUE( count_strokes_in_rect(&strokes, &index, near, true) > 0 );
+    EXPECT_TRUE( count_strokes_in_rect(&strokes, &index, near, true) ==
+                 count_strokes_in_rect(&strokes, &index, near, false) );
+    EXPECT_TRUE( count_strokes_in_rect(&strokes, &index, far, true) ==
+                 count_strokes_in_rect(&strokes, &index, far, false) );
+
+    // Undo the second half.
+    while ( strokes.count > num_strokes / 2 ) {
+        pop(&strokes);
+        stroke_index_pop(&index, &strokes);
+    }
+    EXPECT_TRUE( count_strokes_in_rect(&strokes, &index, near, true) ==
+                 count_strokes_in_rect(&strokes, &index, near, false) );
+    EXPECT_TRUE( count_strokes_in_rect(&strokes, &index, far, true) == 0 );
+
+    stroke_index_release(&index);
+    arena_free(&arena);
+}
+
+// Rects on a grid, with a few degenerate and extreme ones.
+static void
+make_cull_rects(i64 count, i64* left, i64* top, i64* right, i64* bottom)
+{
+    Rect empty = rect_without_size();
+    for ( i64 i = 0; i < count; ++i ) {
+        Rect r = rect_from_xywh((i32)(i % 1000) * 50, (i32)(i / 1000) * 50, 40 + (i32)(i % 7) * 20, 40);
+        if ( i % 97 == 0 ) {
+            r = empty;
+        }
+        if ( i % 89 == 0 ) {
+            r.left = -((i64)1 << 40) + i;
+        }
+        left[i] = r.left;
+        top[i] = r.top;
+        right[i] = r.right;
+        bottom[i] = r.bottom;
+    }
+}
+
+void
+test_cull_rects()
+{
+    const i64 count = 10001;  // Odd, to exercise the scalar tail.
+    i64* left = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* top = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* right = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* bottom = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i32* expected = (i32*)mlt_calloc(count, sizeof(i32), "Test");
+    i32* result = (i32*)mlt_calloc(count, sizeof(i32), "Test");
+
+    make_cull_rects(count, left, top, right, bottom);
+
+    Rect screen = rect_from_xywh(1000, 100, 1920, 1080);
+    for ( i32 flags = CullFlags_NONE; flags <= CullFlags_OUTSIDE; ++flags ) {
+        i64 num_expected = 0;
+        for ( i64 i = 0; i < count; ++i ) {
+            b32 outside =   screen.left   > right[i]
+                         || screen.top    > bottom[i]
+                         || screen.right  < left[i]
+                         || screen.bottom < top[i];
+            if ( outside == ((flags & CullFlags_OUTSIDE) != 0) ) {
+                expected[num_expected++] = (i32)i;
+            }
+        }
+        EXPECT_TRUE( num_expected > 0 );
+
+        i64 n = cull_rects_scalar(left, top, right, bottom, count, screen, flags, result);
+        EXPECT_TRUE( n == num_expected && (COMPARE_BYTES_COUNT(expected, result, n)) );
+
+        if ( cull_has_avx2() ) {
+            n = cull_rects_avx2(left, top, right, bottom, count, screen, flags, result);
+            EXPECT_TRUE( n == num_expected && (COMPARE_BYTES_COUNT(expected, result, n)) );
+        }
+    }
+
+    mlt_free(left, "Test");
+    mlt_free(top, "Test");
+    mlt_free(right, "Test");
+    mlt_free(bottom, "Test");
+    mlt_free(expected, "Test");
+    mlt_free(result, "Test");
+}
+
+static void
+test_worker_job(void* data)
+{
+    i64* job = (i64*)data;
+    *job = *job * 2;
+}
+
+void
+test_workers()
+{
+    WorkerPool pool = {};
+    workers_init(&pool, 3);
+
+    i64 jobs[1000];
+    for ( int pass = 0; pass < 10; ++pass ) {
+        i64 num_jobs = pass * 100 + 1;
+        for ( i64 i = 0; i < num_jobs; ++i ) {
+            jobs[i] = i;
+        }
+        workers_run(&pool, test_worker_job, jobs, sizeof(*jobs), num_jobs);
+        b32 ok = true;
+        for ( i64 i = 0; i < num_jobs; ++i ) {
+            ok = ok && jobs[i] == 2 * i;
+        }
+        EXPECT_TRUE( ok );
+    }
+
+    workers_release(&pool);
+}
+
+// Not run by default. Pass --bench to the test executable.
+void
+bench_load(i64 num_strokes)
+{
+    Milton milton = {};
+    PATH_CHAR* path = TO_PATH_STR("BENCH_loading.mlt");
+
+    milton_init(&milton, 0, 0, 1, path, MiltonInit_FOR_TEST);
+    milton_reset_canvas_and_set_default(&milton);
+    milton.persist->mlt_file_path = path;
+
+    CanvasState* canvas = milton.canvas;
+    for ( i64 i = 0; i < num_strokes; ++i ) {
+        Stroke stroke = {};
+        stroke.id = canvas->stroke_id_count++;
+        stroke.brush = milton.brushes[BrushEnum_PEN];
+        stroke.num_points = 2;
+        stroke.points = arena_alloc_array(&canvas->arena, stroke.num_points, v2l);
+        stroke.pressures = arena_alloc_array(&canvas->arena, stroke.num_points, f32);
+        stroke.points[0] = v2l{ i % 4096, i / 4096 };
+        stroke.points[1] = stroke.points[0] + v2l{ 1, 1 };
+        stroke.pressures[0] = stroke.pressures[1] = 1.0f;
+        stroke.layer_id = canvas->working_layer->id;
+        stroke.bounding_rect = bounding_box_for_stroke(&stroke);
+        layer::layer_push_stroke(canvas->working_layer, stroke);
+    }
+    milton_save(&milton);
+
+    Milton loaded_milton = {};
+    milton_init(&loaded_milton, 0, 0, 1, path, MiltonInit_FOR_TEST);
+
+    u64 start = perf_counter();
+    milton_load(&loaded_milton);
+    float seconds = perf_count_to_sec(perf_counter() - start);
+
+    EXPECT_TRUE( loaded_milton.canvas->root_layer->strokes.count == num_strokes );
+    milton_log("Loaded %d strokes in %f seconds.\n", (int)num_strokes, seconds);
+}
+
+void
+bench_cull()
+{
+    const i64 count = STROKELIST_BUCKET_COUNT;
+    const int reps = 2000;
+    i64* left = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* top = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* right = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i64* bottom = (i64*)mlt_calloc(count, sizeof(i64), "Test");
+    i32* result = (i32*)mlt_calloc(count, sizeof(i32), "Test");
+
+    make_cull_rects(count, left, top, right, bottom);
+    Rect screen = rect_from_xywh(1000, 100, 1920, 1080);
+
+    i64 n = 0;
+    u64 start = perf_counter();
+    for ( int rep = 0; rep < reps; ++rep ) {
+        n = cull_rects_scalar(left, top, right, bottom, count, screen, CullFlags_NONE, result);
+    }
+    float scalar = perf_count_to_sec(perf_counter() - start);
+
+    float avx2 = 0;
+    if ( cull_has_avx2() ) {
+        start = perf_counter();
+        for ( int rep = 0; rep < reps; ++rep ) {
+            n = cull_rects_avx2(left, top, right, bottom, count, screen, CullFlags_NONE, result);
+        }
+        avx2 = perf_count_to_sec(perf_counter() - start);
+    }
+
+    float to_ns = 1e9f / (reps * count);
+    milton_log("Culling, ns per rect: scalar %f, AVX2 %f (%d visible)\n",
+               scalar * to_ns, avx2 * to_ns, (int)n);
+
+    mlt_free(left, "Test");
+    mlt_free(top, "Test");
+    mlt_free(right, "Test");
+    mlt_free(bottom, "Test");
+    mlt_free(result, "Test");
+}
+
 extern "C" int
-main()
+main(int argc, char** argv)
 {
     test_save_load();
+    test_stroke_index();
+    test_cull_rects();
+    test_workers();
+
+    if ( argc > 1 && !strcmp(argv[1], "--bench") ) {
+        bench_load(4*1000*1000);
+        bench_cull();
+    }
     return 0;
 }
@@ -10,14 +10,15 @@ uniform float u_alpha;
     uniform sampler2D u_canvas;
 #endif
 uniform vec2 u_screen_size;
+uniform ivec2 u_offset;     // In pixels. Zero except when gpu_pan_copy moves the canvas.
 
 void
 main()
 {
 #if HAS_TEXTURE_MULTISAMPLE
-    vec4 color = texelFetch(u_canvas, ivec2(gl_FragCoord.xy), gl_SampleID);
+    vec4 color = texelFetch(u_canvas, ivec2(gl_FragCoord.xy) - u_offset, gl_SampleID);
 #else
-    vec2 screen_point = vec2(gl_FragCoord.x, gl_FragCoord.y);
+    vec2 screen_point = vec2(gl_FragCoord.x, gl_FragCoord.y) - vec2(u_offset);
     vec2 coord = screen_point / u_screen_size;
     vec4 color = texture(u_canvas, coord);
 #endif
@@ -2,9 +2,12 @@
 // License: https://github.com/serge-rgb/milton#license
 
 #include "StrokeList.cc"
+#include "StrokeIndex.cc"
 #include "bindings.cc"
+#include "buffer_pool.cc"
 #include "canvas.cc"
 #include "color.cc"
+#include "cull.cc"
 #include "gl_helpers.cc"
 #include "gui.cc"
 #include "localization.cc"
@@ -16,6 +19,7 @@
 #include "sdl_milton.cc"
 #include "utils.cc"
 #include "vector.cc"
+#include "workers.cc"
 
 #if defined(_WIN32)
     #include "platform_windows.cc"
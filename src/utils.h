@@ -150,6 +150,8 @@ b32 is_inside_rect_scalar(Rect bounds, i32 point_x, i32 point_y);
 
 b32 is_rect_within_rect(Rect a, Rect b);
 
+b32 rect_intersects_rect(Rect a, Rect b);
+
 Rect rect_from_xywh(i32 x, i32 y, i32 w, i32 h);
 
 wchar_t*    str_trim_to_last_slash(wchar_t* str);
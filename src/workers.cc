@@ -0,0 +1,101 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+#include "workers.h"
+
+static void
+workers_do_jobs(WorkerPool* pool)
+{
+    for ( ;; ) {
+        i64 job_i = SDL_AtomicAdd(&pool->next_job, 1);
+        if ( job_i >= pool->num_jobs ) {
+            break;
+        }
+        pool->func(pool->jobs + job_i * pool->job_size);
+    }
+}
+
+static int
+worker_thread(void* data)
+{
+    WorkerPool* pool = (WorkerPool*)data;
+    for ( ;; ) {
+        SDL_SemWait(pool->work_available);
+        if ( !SDL_AtomicGet(&pool->running) ) {
+            break;
+        }
+        workers_do_jobs(pool);
+        SDL_SemPost(pool->work_done);
+    }
+    return 0;
+}
+
+void
+workers_init(WorkerPool* pool, i32 num_threads)
+{
+    *pool = {};
+    pool->work_available = SDL_CreateSemaphore(0);
+    pool->work_done = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&pool->running, 1);
+
+    num_threads = min(num_threads, WORKERS_MAX_THREADS);
+    for ( i32 i = 0; i < num_threads; ++i ) {
+        SDL_Thread* thread = SDL_CreateThread(worker_thread, "Worker", (void*)pool);
+        if ( thread == NULL ) {
+            milton_log("Could not create worker thread: %s\n", SDL_GetError());
+            break;
+        }
+        pool->threads[pool->num_threads++] = thread;
+    }
+}
+
+void
+workers_release(WorkerPool* pool)
+{
+    SDL_AtomicSet(&pool->running, 0);
+    for ( i32 i = 0; i < pool->num_threads; ++i ) {
+        SDL_SemPost(pool->work_available);
+    }
+    for ( i32 i = 0; i < pool->num_threads; ++i ) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+    if ( pool->work_available ) {
+        SDL_DestroySemaphore(pool->work_available);
+    }
+    if ( pool->work_done ) {
+        SDL_DestroySemaphore(pool->work_done);
+    }
+    *pool = {};
+}
+
+void
+workers_run(WorkerPool* pool, WorkerFunc* func, void* jobs, i64 job_size, i64 num_jobs)
+{
+    pool->func = func;
+    pool->jobs = (u8*)jobs;
+    pool->job_size = job_size;
+    pool->num_jobs = num_jobs;
+    SDL_AtomicSet(&pool->next_job, 0);
+
+    // Don't wake up more threads than there are jobs to share.
+    i64 num_woken = min((i64)pool->num_threads, num_jobs - 1);
+    for ( i64 i = 0; i < num_woken; ++i ) {
+        SDL_SemPost(pool->work_available);
+    }
+
+    workers_do_jobs(pool);
+
+    for ( i64 i = 0; i < num_woken; ++i ) {
+        SDL_SemWait(pool->work_done);
+    }
+}
+
+i32
+workers_default_thread_count()
+{
+    i32 count = 0;
+#if MILTON_MULTITHREADED
+    count = SDL_GetCPUCount() - 1;
+#endif
+    return count;
+}
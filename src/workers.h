@@ -0,0 +1,49 @@
+// Copyright (c) 2015 Sergio Gonzalez. All rights reserved.
+// License: https://github.com/serge-rgb/milton#license
+
+// Workers
+//
+// - A pool of threads that run batches of independent jobs.
+// - workers_run is a parallel for: it calls a function on every job of an
+//   array and returns when all of them are done. The calling thread works
+//   on the batch too.
+// - Jobs must not touch OpenGL. They run on threads without a GL context.
+
+
+#pragma once
+
+#include "common.h"
+#include "platform.h"
+#include "system_includes.h"
+#include "utils.h"
+
+#define WORKERS_MAX_THREADS 15
+
+typedef void WorkerFunc(void* job);
+
+struct WorkerPool
+{
+    SDL_Thread*     threads[WORKERS_MAX_THREADS];
+    i32             num_threads;
+
+    SDL_sem*        work_available;
+    SDL_sem*        work_done;
+    SDL_atomic_t    running;
+
+    // Current batch. Only written by workers_run, while the workers sleep.
+    WorkerFunc*     func;
+    u8*             jobs;
+    i64             job_size;
+    i64             num_jobs;
+    SDL_atomic_t    next_job;
+};
+
+// With num_threads == 0, workers_run does all the work on the calling thread.
+void workers_init(WorkerPool* pool, i32 num_threads);
+void workers_release(WorkerPool* pool);
+
+// Calls func on each of the num_jobs jobs, which are job_size bytes apart.
+void workers_run(WorkerPool* pool, WorkerFunc* func, void* jobs, i64 job_size, i64 num_jobs);
+
+// One worker per core, not counting the calling thread.
+i32 workers_default_thread_count();